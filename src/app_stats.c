@@ -0,0 +1,391 @@
+/*
+ * Runtime statistics of the node
+ * All counters are atomics, so the request paths never take a lock for
+ * them and a reset from the shell can race with an update without harm,
+ * a reset only loses the updates in flight. A periodic probe on the
+ * system workqueue measures how late its work items run and samples the
+ * network data buffer pools, whose low marks the stack does not keep.
+ * The "app stats" shell command prints everything.
+ */
+
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(app_stats, LOG_LEVEL_INF);
+
+#include <zephyr/kernel.h>
+#include <zephyr/net/net_pkt.h>
+#include <zephyr/net/buf.h>
+#include <zephyr/shell/shell.h>
+
+#include "app_stats.h"
+#include "button.h"
+
+#if defined(CONFIG_APP_SLEEPY)
+#include "sleepy.h"
+#endif
+
+/**
+ * Counters of the CoAP client
+ */
+static struct {
+	atomic_t sent;
+	atomic_t journaled;
+	atomic_t retransmissions;
+	atomic_t timeouts;
+	atomic_t resets;
+	/* Requests given up while detached */
+	atomic_t unreachable;
+	atomic_t codes_2xx;
+	atomic_t codes_4xx;
+	atomic_t codes_5xx;
+	atomic_t rtt_count;
+	atomic_t rtt_total_ms;
+	atomic_t rtt_min_ms;
+	atomic_t rtt_max_ms;
+} client = {
+	.rtt_min_ms = ATOMIC_INIT(INT32_MAX),
+};
+
+/**
+ * Lateness of the system workqueue and buffer pool low marks
+ */
+static struct {
+	atomic_t count;
+	atomic_t last_us;
+	atomic_t max_us;
+	atomic_t total_us;
+	/* Lowest free count of the data pools seen by the probe */
+	atomic_t rx_data_min_free;
+	atomic_t tx_data_min_free;
+} probe = {
+	.rx_data_min_free = ATOMIC_INIT(INT32_MAX),
+	.tx_data_min_free = ATOMIC_INIT(INT32_MAX),
+};
+
+static int64_t probe_due_ticks;
+
+/**
+ * Function used to raise an atomic to value if it is below
+ */
+static void atomic_raise(atomic_t *target, atomic_val_t value)
+{
+	atomic_val_t old;
+
+	do {
+		old = atomic_get(target);
+		if (value <= old) {
+			return;
+		}
+	} while (!atomic_cas(target, old, value));
+}
+
+/**
+ * Function used to lower an atomic to value if it is above
+ */
+static void atomic_lower(atomic_t *target, atomic_val_t value)
+{
+	atomic_val_t old;
+
+	do {
+		old = atomic_get(target);
+		if (value >= old) {
+			return;
+		}
+	} while (!atomic_cas(target, old, value));
+}
+
+/**
+ * Function used to count a response code or handler result by class
+ */
+static void count_code(int code, atomic_t *codes_2xx, atomic_t *codes_4xx, atomic_t *codes_5xx)
+{
+	switch (code >> 5) {
+	case 2:
+		atomic_inc(codes_2xx);
+		break;
+	case 4:
+		atomic_inc(codes_4xx);
+		break;
+	case 5:
+		atomic_inc(codes_5xx);
+		break;
+	default:
+		break;
+	}
+}
+
+/**
+ * Function used to count a call of a server handler and its result
+ */
+void app_stats_handler_done(struct app_stats_handler *handler, int ret)
+{
+	atomic_inc(&handler->calls);
+
+	if (ret < 0) {
+		atomic_inc(&handler->errors);
+	} else if (ret == 0) {
+		atomic_inc(&handler->sent);
+	} else {
+		count_code(ret, &handler->codes_2xx, &handler->codes_4xx, &handler->codes_5xx);
+	}
+}
+
+/**
+ * Function used to count a request sent by the CoAP client
+ */
+void app_stats_client_sent(void)
+{
+	atomic_inc(&client.sent);
+}
+
+/**
+ * Function used to count a request journaled while detached
+ */
+void app_stats_client_journaled(void)
+{
+	atomic_inc(&client.journaled);
+}
+
+/**
+ * Function used to count a retransmission of the CoAP client
+ */
+void app_stats_client_retransmit(void)
+{
+	atomic_inc(&client.retransmissions);
+}
+
+/**
+ * Function used to count a completed client request
+ */
+void app_stats_client_complete(int code, uint32_t rtt_ms)
+{
+	switch (code) {
+	case -ETIMEDOUT:
+		atomic_inc(&client.timeouts);
+		return;
+	case -ECONNRESET:
+		atomic_inc(&client.resets);
+		return;
+	case -ENETUNREACH:
+		atomic_inc(&client.unreachable);
+		return;
+	default:
+		break;
+	}
+
+	if (code < 0) {
+		return;
+	}
+
+	count_code(code, &client.codes_2xx, &client.codes_4xx, &client.codes_5xx);
+
+	atomic_inc(&client.rtt_count);
+	atomic_add(&client.rtt_total_ms, rtt_ms);
+	atomic_lower(&client.rtt_min_ms, rtt_ms);
+	atomic_raise(&client.rtt_max_ms, rtt_ms);
+}
+
+/**
+ * Work handler measuring its own lateness and sampling the buffer pools
+ */
+static void probe_handler(struct k_work *work)
+{
+	struct k_work_delayable *dwork = k_work_delayable_from_work(work);
+	int64_t now = k_uptime_ticks();
+	uint32_t late_us = (uint32_t)k_ticks_to_us_floor64(MAX(now - probe_due_ticks, 0));
+	struct k_mem_slab *rx, *tx;
+	struct net_buf_pool *rx_data, *tx_data;
+
+	atomic_inc(&probe.count);
+	atomic_set(&probe.last_us, late_us);
+	atomic_add(&probe.total_us, late_us);
+	atomic_raise(&probe.max_us, late_us);
+
+	net_pkt_get_info(&rx, &tx, &rx_data, &tx_data);
+	atomic_lower(&probe.rx_data_min_free, atomic_get(&rx_data->avail_count));
+	atomic_lower(&probe.tx_data_min_free, atomic_get(&tx_data->avail_count));
+
+	probe_due_ticks = now + k_ms_to_ticks_ceil64(CONFIG_APP_STATS_PROBE_MS);
+	k_work_schedule(dwork, K_TICKS(probe_due_ticks - now));
+}
+
+static K_WORK_DELAYABLE_DEFINE(probe_work, probe_handler);
+
+static int init_app_stats(void)
+{
+	probe_due_ticks = k_uptime_ticks() + k_ms_to_ticks_ceil64(CONFIG_APP_STATS_PROBE_MS);
+	k_work_schedule(&probe_work, K_MSEC(CONFIG_APP_STATS_PROBE_MS));
+
+	return 0;
+}
+
+SYS_INIT(init_app_stats, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
+
+static void print_client(const struct shell *sh)
+{
+	atomic_val_t rtt_count = atomic_get(&client.rtt_count);
+
+	shell_print(sh, "client: sent %ld, journaled %ld, retransmissions %ld",
+		    atomic_get(&client.sent), atomic_get(&client.journaled),
+		    atomic_get(&client.retransmissions));
+	shell_print(sh, "client: timeouts %ld, resets %ld, unreachable %ld",
+		    atomic_get(&client.timeouts), atomic_get(&client.resets),
+		    atomic_get(&client.unreachable));
+	shell_print(sh, "client: responses 2.xx %ld, 4.xx %ld, 5.xx %ld",
+		    atomic_get(&client.codes_2xx), atomic_get(&client.codes_4xx),
+		    atomic_get(&client.codes_5xx));
+	if (rtt_count > 0) {
+		shell_print(sh, "client: rtt min %ld ms, avg %ld ms, max %ld ms",
+			    atomic_get(&client.rtt_min_ms),
+			    atomic_get(&client.rtt_total_ms) / rtt_count,
+			    atomic_get(&client.rtt_max_ms));
+	}
+}
+
+static void print_server(const struct shell *sh)
+{
+	shell_print(sh, "server: %-28s %6s %6s %6s %6s %6s %6s", "handler", "calls", "2.xx",
+		    "4.xx", "5.xx", "sent", "errors");
+
+	STRUCT_SECTION_FOREACH(app_stats_handler, handler) {
+		shell_print(sh, "server: %-28s %6ld %6ld %6ld %6ld %6ld %6ld", handler->name,
+			    atomic_get(&handler->calls), atomic_get(&handler->codes_2xx),
+			    atomic_get(&handler->codes_4xx), atomic_get(&handler->codes_5xx),
+			    atomic_get(&handler->sent), atomic_get(&handler->errors));
+	}
+}
+
+static void print_buffers(const struct shell *sh)
+{
+	struct k_mem_slab *rx, *tx;
+	struct net_buf_pool *rx_data, *tx_data;
+
+	net_pkt_get_info(&rx, &tx, &rx_data, &tx_data);
+
+	shell_print(sh, "buffers: rx pkt max used %u of %u, tx pkt max used %u of %u",
+		    k_mem_slab_max_used_get(rx), rx->info.num_blocks,
+		    k_mem_slab_max_used_get(tx), tx->info.num_blocks);
+	// The data pools only count free buffers, the probe samples them, so this is
+	// no high-water mark, peaks between two probes are missed
+	shell_print(sh, "buffers: rx data sampled peak %ld of %u, tx data sampled peak %ld of %u "
+		    "(every %d ms)",
+		    rx_data->buf_count - MIN(atomic_get(&probe.rx_data_min_free),
+					     rx_data->buf_count),
+		    rx_data->buf_count,
+		    tx_data->buf_count - MIN(atomic_get(&probe.tx_data_min_free),
+					     tx_data->buf_count),
+		    tx_data->buf_count, CONFIG_APP_STATS_PROBE_MS);
+}
+
+static void print_workq(const struct shell *sh)
+{
+	atomic_val_t count = atomic_get(&probe.count);
+	struct button_latency button;
+
+	if (count > 0) {
+		shell_print(sh, "workq: latency last %ld us, avg %ld us, max %ld us, %ld probes",
+			    atomic_get(&probe.last_us), atomic_get(&probe.total_us) / count,
+			    atomic_get(&probe.max_us), count);
+	}
+
+	button_get_latency(&button);
+	shell_print(sh, "button: dispatch latency last %u us, max %u us, %u events",
+		    button.last_us, button.max_us, button.count);
+
+#if defined(CONFIG_APP_SLEEPY)
+	struct sleepy_stats sleepy;
+
+	sleepy_get_stats(&sleepy);
+	shell_print(sh, "sleepy: %s", sleepy_mode_str(sleepy.mode));
+	for (int i = 0; i < SLEEPY_MODE_COUNT; i++) {
+		shell_print(sh, "sleepy: %s period %u ms, %llu ms, rtt avg %u ms max %u ms",
+			    sleepy_mode_str(i), sleepy.modes[i].period_ms, sleepy.modes[i].time_ms,
+			    sleepy.modes[i].rtt_avg_ms, sleepy.modes[i].rtt_max_ms);
+	}
+#endif
+}
+
+static int cmd_stats_all(const struct shell *sh, size_t argc, char **argv)
+{
+	print_client(sh);
+	print_server(sh);
+	print_buffers(sh);
+	print_workq(sh);
+
+	return 0;
+}
+
+static int cmd_stats_client(const struct shell *sh, size_t argc, char **argv)
+{
+	print_client(sh);
+	return 0;
+}
+
+static int cmd_stats_server(const struct shell *sh, size_t argc, char **argv)
+{
+	print_server(sh);
+	return 0;
+}
+
+static int cmd_stats_buffers(const struct shell *sh, size_t argc, char **argv)
+{
+	print_buffers(sh);
+	return 0;
+}
+
+static int cmd_stats_workq(const struct shell *sh, size_t argc, char **argv)
+{
+	print_workq(sh);
+	return 0;
+}
+
+static int cmd_stats_reset(const struct shell *sh, size_t argc, char **argv)
+{
+	struct k_mem_slab *rx, *tx;
+	struct net_buf_pool *rx_data, *tx_data;
+	atomic_t *counters[] = {
+		&client.sent, &client.journaled, &client.retransmissions, &client.timeouts,
+		&client.resets, &client.unreachable, &client.codes_2xx, &client.codes_4xx,
+		&client.codes_5xx, &client.rtt_count, &client.rtt_total_ms, &client.rtt_max_ms,
+		&probe.count, &probe.last_us, &probe.max_us, &probe.total_us,
+	};
+
+	for (size_t i = 0; i < ARRAY_SIZE(counters); i++) {
+		atomic_clear(counters[i]);
+	}
+	atomic_set(&client.rtt_min_ms, INT32_MAX);
+	atomic_set(&probe.rx_data_min_free, INT32_MAX);
+	atomic_set(&probe.tx_data_min_free, INT32_MAX);
+
+	net_pkt_get_info(&rx, &tx, &rx_data, &tx_data);
+	k_mem_slab_runtime_stats_reset_max(rx);
+	k_mem_slab_runtime_stats_reset_max(tx);
+
+	STRUCT_SECTION_FOREACH(app_stats_handler, handler) {
+		atomic_clear(&handler->calls);
+		atomic_clear(&handler->codes_2xx);
+		atomic_clear(&handler->codes_4xx);
+		atomic_clear(&handler->codes_5xx);
+		atomic_clear(&handler->sent);
+		atomic_clear(&handler->errors);
+	}
+
+	return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(sub_app_stats,
+	SHELL_CMD(client, NULL, "CoAP client requests, responses and round trip times",
+		  cmd_stats_client),
+	SHELL_CMD(server, NULL, "CoAP server requests and results per handler", cmd_stats_server),
+	SHELL_CMD(buffers, NULL, "Network buffer high-water marks", cmd_stats_buffers),
+	SHELL_CMD(workq, NULL, "System workqueue and button dispatch latency", cmd_stats_workq),
+	SHELL_CMD(reset, NULL, "Reset the counters", cmd_stats_reset),
+	SHELL_SUBCMD_SET_END
+);
+
+SHELL_STATIC_SUBCMD_SET_CREATE(sub_app,
+	SHELL_CMD(stats, &sub_app_stats, "Runtime statistics, all without subcommand",
+		  cmd_stats_all),
+	SHELL_SUBCMD_SET_END
+);
+
+SHELL_CMD_REGISTER(app, &sub_app, "Application commands", NULL);
@@ -0,0 +1,58 @@
+#ifndef __APP_STATS_H__
+#define __APP_STATS_H__
+
+#include <stdint.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/iterable_sections.h>
+
+/**
+ * Counters of a CoAP server handler
+ * Handlers either send the response themselves and return 0, or return the
+ * response code the server sends for them
+ */
+struct app_stats_handler {
+	const char *name;
+	atomic_t calls;
+	/* Response codes returned by class */
+	atomic_t codes_2xx;
+	atomic_t codes_4xx;
+	atomic_t codes_5xx;
+	/* Responses sent by the handler itself */
+	atomic_t sent;
+	/* Negative return values */
+	atomic_t errors;
+};
+
+#define APP_STATS_HANDLER_DEFINE(_name)						\
+	STRUCT_SECTION_ITERABLE(app_stats_handler, _name##_stats) = {		\
+		.name = #_name,							\
+	}
+
+/**
+ * Function used to count a call of a server handler and its result
+ */
+void app_stats_handler_done(struct app_stats_handler *handler, int ret);
+
+/**
+ * Function used to count a request sent by the CoAP client
+ */
+void app_stats_client_sent(void);
+
+/**
+ * Function used to count a request journaled while detached
+ */
+void app_stats_client_journaled(void);
+
+/**
+ * Function used to count a retransmission of the CoAP client
+ */
+void app_stats_client_retransmit(void);
+
+/**
+ * Function used to count a completed client request
+ * code is the response code or a negative error code, rtt_ms the time
+ * since the first transmission
+ */
+void app_stats_client_complete(int code, uint32_t rtt_ms);
+
+#endif
@@ -0,0 +1,19 @@
+#ifndef __APP_TRACE_H__
+#define __APP_TRACE_H__
+
+/**
+ * Trace points of the request lifecycle
+ * Emitted as named events of the tracing subsystem, e.g. into a CTF stream.
+ * Names are kept below the 20 characters CTF stores. Without
+ * CONFIG_APP_TRACE the trace points compile to nothing.
+ */
+#if defined(CONFIG_APP_TRACE)
+#include <zephyr/tracing/tracing.h>
+
+#define APP_TRACE(_name, _arg0, _arg1)						\
+	sys_trace_named_event(_name, (uint32_t)(_arg0), (uint32_t)(_arg1))
+#else
+#define APP_TRACE(_name, _arg0, _arg1) do { } while (false)
+#endif
+
+#endif
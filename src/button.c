@@ -0,0 +1,346 @@
+/*
+ * Debounced button events
+ * The GPIO ISR only records the cycle counter at the first edge of a
+ * transition and starts the settle timer. When the timer expires the pin
+ * is sampled once: if it differs from the debounced level the transition
+ * is accepted, otherwise it was a bounce or glitch. Edges while the timer
+ * runs do not restart it, so every event is dispatched at most the settle
+ * time plus the dispatch latency after its first edge.
+ *
+ * Gestures are classified from the debounced transitions: a press held for
+ * the long press time is a long press, a second press within the double
+ * press window after a release is a double press, and a release followed
+ * by no press within that window is a click. Only one gesture is posted
+ * per interaction, a click therefore waits for the window to expire.
+ */
+
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(button, LOG_LEVEL_DBG);
+
+#include <zephyr/kernel.h>
+#include <zephyr/drivers/gpio.h>
+
+#if defined(CONFIG_APP_BUTTON_EMUL)
+#include <stdlib.h>
+#include <zephyr/drivers/gpio/gpio_emul.h>
+#include <zephyr/shell/shell.h>
+#endif
+
+#include "app_trace.h"
+#include "button.h"
+#include "events.h"
+
+#define BUTTON_WORKQ_STACK_SIZE 2048
+#define BUTTON_WORKQ_PRIORITY 4
+
+#define BUTTON_EVT_QUEUE_LEN 8
+
+// Button initialization
+// app-button -> button of boards without the Arduino Nano 33 BLE pinout, e.g. native_sim
+#if DT_NODE_EXISTS(DT_ALIAS(app_button))
+static const struct gpio_dt_spec button = GPIO_DT_SPEC_GET(DT_ALIAS(app_button), gpios);
+#else
+static const struct gpio_dt_spec button = {DEVICE_DT_GET(DT_NODELABEL(gpio1)), 12, (GPIO_PULL_UP | GPIO_ACTIVE_LOW)};
+#endif
+static struct gpio_callback button_cb_data;
+
+/* Events on their way from interrupt context to the button channel */
+K_MSGQ_DEFINE(button_msgq, sizeof(struct button_event), BUTTON_EVT_QUEUE_LEN, 4);
+K_THREAD_STACK_DEFINE(button_workq_stack_area, BUTTON_WORKQ_STACK_SIZE);
+static struct k_work_q button_workq;
+
+/**
+ * Debouncer state, only touched from the GPIO ISR and the timer expiry
+ */
+static struct {
+	bool pressed;
+	atomic_t settling;
+	uint32_t edge_cycles;
+	/* A release waits for a second press before it becomes a click */
+	bool click_pending;
+	/* The gesture of the current interaction has been posted */
+	bool gesture_done;
+} debounce;
+
+static struct button_latency latency;
+static struct k_spinlock latency_lock;
+
+/**
+ * Function used to publish the queued events on the button channel
+ */
+static void dispatch_work_handler(struct k_work *work)
+{
+	struct button_event msg;
+	k_spinlock_key_t key;
+	uint32_t us;
+
+	ARG_UNUSED(work);
+
+	while (k_msgq_get(&button_msgq, &msg, K_NO_WAIT) == 0) {
+		us = k_cyc_to_us_floor32(k_cycle_get_32() - msg.cycles);
+
+		key = k_spin_lock(&latency_lock);
+		latency.last_us = us;
+		latency.max_us = MAX(latency.max_us, us);
+		latency.count++;
+		k_spin_unlock(&latency_lock, key);
+
+		if (us > CONFIG_APP_BUTTON_LATENCY_BUDGET_US) {
+			LOG_WRN("%s dispatched after %u us", button_evt_str(msg.evt), us);
+		} else {
+			LOG_DBG("%s dispatched after %u us", button_evt_str(msg.evt), us);
+		}
+
+		if (zbus_chan_pub(&button_chan, &msg, K_MSEC(CONFIG_APP_BUTTON_DEBOUNCE_MS)) < 0) {
+			LOG_WRN("Cannot publish %s", button_evt_str(msg.evt));
+		}
+	}
+}
+
+static K_WORK_DEFINE(dispatch_work, dispatch_work_handler);
+
+/**
+ * Function used to hand an event from interrupt context to the work queue
+ */
+static void post_event(enum button_evt evt, uint32_t cycles)
+{
+	struct button_event msg = {
+		.evt = evt,
+		.cycles = cycles,
+	};
+
+	if (k_msgq_put(&button_msgq, &msg, K_NO_WAIT) < 0) {
+		LOG_WRN("Button event queue full, dropping %s", button_evt_str(evt));
+		return;
+	}
+
+	k_work_submit_to_queue(&button_workq, &dispatch_work);
+}
+
+/**
+ * Expiry function of the long press timer
+ */
+static void long_press_expired(struct k_timer *timer)
+{
+	ARG_UNUSED(timer);
+
+	debounce.gesture_done = true;
+	post_event(BUTTON_EVT_LONG_PRESS, k_cycle_get_32());
+}
+
+static K_TIMER_DEFINE(long_press_timer, long_press_expired, NULL);
+
+/**
+ * Expiry function of the double press timer
+ * No second press followed the release, the interaction was a click
+ */
+static void click_expired(struct k_timer *timer)
+{
+	ARG_UNUSED(timer);
+
+	debounce.click_pending = false;
+	post_event(BUTTON_EVT_CLICK, k_cycle_get_32());
+}
+
+static K_TIMER_DEFINE(click_timer, click_expired, NULL);
+
+/**
+ * Expiry function of the settle timer
+ * Samples the pin once the bouncing is over
+ */
+static void settle_expired(struct k_timer *timer)
+{
+	bool pressed = gpio_pin_get_dt(&button) > 0;
+
+	ARG_UNUSED(timer);
+
+	atomic_clear(&debounce.settling);
+
+	APP_TRACE("btn_settle", pressed, pressed != debounce.pressed);
+
+	if (pressed == debounce.pressed) {
+		return;
+	}
+
+	debounce.pressed = pressed;
+
+	if (!pressed) {
+		k_timer_stop(&long_press_timer);
+		post_event(BUTTON_EVT_RELEASED, debounce.edge_cycles);
+
+		// Long and double presses are posted while the button is down
+		if (debounce.gesture_done) {
+			debounce.gesture_done = false;
+			return;
+		}
+
+		debounce.click_pending = true;
+		k_timer_start(&click_timer, K_MSEC(CONFIG_APP_BUTTON_DOUBLE_PRESS_MS), K_NO_WAIT);
+		return;
+	}
+
+	post_event(BUTTON_EVT_PRESSED, debounce.edge_cycles);
+
+	if (debounce.click_pending) {
+		k_timer_stop(&click_timer);
+		debounce.click_pending = false;
+		// The second press ends the interaction, holding it is no long press
+		debounce.gesture_done = true;
+		post_event(BUTTON_EVT_DOUBLE_PRESS, debounce.edge_cycles);
+		return;
+	}
+
+	k_timer_start(&long_press_timer, K_MSEC(CONFIG_APP_BUTTON_LONG_PRESS_MS), K_NO_WAIT);
+}
+
+static K_TIMER_DEFINE(settle_timer, settle_expired, NULL);
+
+/**
+ * Button callback function, runs in interrupt context
+ * Timestamps the first edge of a transition and starts the settle timer
+ */
+static void button_isr(const struct device *dev, struct gpio_callback *cb, uint32_t pins)
+{
+	uint32_t cycles = k_cycle_get_32();
+
+	APP_TRACE("btn_isr", pins, 0);
+
+	if (atomic_set(&debounce.settling, 1)) {
+		return;
+	}
+
+	debounce.edge_cycles = cycles;
+	k_timer_start(&settle_timer, K_MSEC(CONFIG_APP_BUTTON_DEBOUNCE_MS), K_NO_WAIT);
+}
+
+/**
+ * Helper function to turn a button event into a string
+ */
+const char *button_evt_str(enum button_evt evt)
+{
+	switch (evt) {
+	case BUTTON_EVT_PRESSED:
+		return "Pressed";
+	case BUTTON_EVT_RELEASED:
+		return "Released";
+	case BUTTON_EVT_LONG_PRESS:
+		return "Long press";
+	case BUTTON_EVT_DOUBLE_PRESS:
+		return "Double press";
+	case BUTTON_EVT_CLICK:
+		return "Click";
+	default:
+		return "Unknown";
+	}
+}
+
+/**
+ * Function used to read the measured dispatch latency
+ */
+void button_get_latency(struct button_latency *out)
+{
+	k_spinlock_key_t key = k_spin_lock(&latency_lock);
+
+	*out = latency;
+	k_spin_unlock(&latency_lock, key);
+}
+
+/**
+ * Function used to initialize the buttons
+ */
+int init_buttons(void)
+{
+	int err;
+
+	if (!gpio_is_ready_dt(&button)) {
+		LOG_ERR("Error: button device %s is not ready\n",
+		       button.port->name);
+		return -EIO;
+	}
+
+	err = gpio_pin_configure_dt(&button, GPIO_INPUT);
+	if (err) {
+		return err;
+	}
+
+#if defined(CONFIG_APP_BUTTON_EMUL)
+	// Emulated inputs start low, which reads as pressed on an active low button
+	gpio_emul_input_set(button.port, button.pin, (button.dt_flags & GPIO_ACTIVE_LOW) ? 1 : 0);
+#endif
+
+	k_work_queue_start(&button_workq, button_workq_stack_area,
+			   K_THREAD_STACK_SIZEOF(button_workq_stack_area),
+			   BUTTON_WORKQ_PRIORITY, NULL);
+	k_thread_name_set(&button_workq.thread, "button_workq");
+
+	debounce.pressed = gpio_pin_get_dt(&button) > 0;
+
+	err = gpio_pin_interrupt_configure_dt(&button, GPIO_INT_EDGE_BOTH);
+	if (err) {
+		return err;
+	}
+
+	gpio_init_callback(&button_cb_data, button_isr, BIT(button.pin));
+	err = gpio_add_callback(button.port, &button_cb_data);
+	if (err) {
+		return err;
+	}
+
+	return 0;
+}
+
+#if defined(CONFIG_APP_BUTTON_EMUL)
+/**
+ * Function used to hold the emulated button for the given time
+ */
+static void emul_press(uint32_t hold_ms)
+{
+	bool active_low = button.dt_flags & GPIO_ACTIVE_LOW;
+
+	gpio_emul_input_set(button.port, button.pin, active_low ? 0 : 1);
+	k_msleep(hold_ms);
+	gpio_emul_input_set(button.port, button.pin, active_low ? 1 : 0);
+}
+
+static int cmd_button_press(const struct shell *sh, size_t argc, char **argv)
+{
+	uint32_t hold_ms = 100;
+
+	if (argc > 1) {
+		hold_ms = strtoul(argv[1], NULL, 10);
+	}
+	if (hold_ms <= CONFIG_APP_BUTTON_DEBOUNCE_MS) {
+		shell_error(sh, "Hold time must exceed the settle time of %d ms",
+			    CONFIG_APP_BUTTON_DEBOUNCE_MS);
+		return -EINVAL;
+	}
+
+	emul_press(hold_ms);
+	return 0;
+}
+
+static int cmd_button_double(const struct shell *sh, size_t argc, char **argv)
+{
+	uint32_t gap_ms = CONFIG_APP_BUTTON_DOUBLE_PRESS_MS / 4;
+
+	emul_press(gap_ms);
+	k_msleep(gap_ms);
+	emul_press(gap_ms);
+	return 0;
+}
+
+static int cmd_button_long(const struct shell *sh, size_t argc, char **argv)
+{
+	emul_press(CONFIG_APP_BUTTON_LONG_PRESS_MS + 100);
+	return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(sub_button,
+	SHELL_CMD_ARG(press, NULL, "Press the button [hold time in ms]", cmd_button_press, 1, 1),
+	SHELL_CMD(double, NULL, "Double press the button", cmd_button_double),
+	SHELL_CMD(long, NULL, "Long press the button", cmd_button_long),
+	SHELL_SUBCMD_SET_END
+);
+
+SHELL_CMD_REGISTER(button, &sub_button, "Emulated button", NULL);
+#endif
@@ -0,0 +1,55 @@
+#ifndef __BUTTON_H__
+#define __BUTTON_H__
+
+#include <stdint.h>
+
+/**
+ * Button events
+ * PRESSED and RELEASED follow every debounced transition. Each interaction
+ * additionally ends in exactly one gesture: CLICK, DOUBLE_PRESS or
+ * LONG_PRESS. A click is only known once the double press window passed
+ * without a second press.
+ */
+enum button_evt {
+	BUTTON_EVT_PRESSED,
+	BUTTON_EVT_RELEASED,
+	BUTTON_EVT_LONG_PRESS,
+	BUTTON_EVT_DOUBLE_PRESS,
+	BUTTON_EVT_CLICK
+};
+
+/**
+ * Debounced button event as published on the button channel
+ */
+struct button_event {
+	enum button_evt evt;
+	/* Cycle counter at the edge that caused the event */
+	uint32_t cycles;
+};
+
+/**
+ * Latency from the first edge of a transition to the dispatch of its event
+ */
+struct button_latency {
+	uint32_t last_us;
+	uint32_t max_us;
+	uint32_t count;
+};
+
+/**
+ * Function used to initialize the buttons
+ * Events are published on the button channel
+ */
+int init_buttons(void);
+
+/**
+ * Function used to read the measured dispatch latency
+ */
+void button_get_latency(struct button_latency *latency);
+
+/**
+ * Helper function to turn a button event into a string
+ */
+const char *button_evt_str(enum button_evt evt);
+
+#endif
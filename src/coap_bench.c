@@ -0,0 +1,323 @@
+/*
+ * CoAP packet micro-benchmark
+ * Times the builders the node uses on its request paths. The timing API
+ * counts CPU cycles with the DWT on Cortex-M. On native_sim it reads the
+ * simulated time, which stands still while code runs, so the monotonic
+ * clock of the host is read there instead. Every case runs for a number of
+ * iterations after a short warm up, the samples are reported as minimum,
+ * median, 99th percentile and maximum. Interrupts stay enabled, a single
+ * preempted sample only moves the maximum.
+ */
+
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(coap_bench, LOG_LEVEL_INF);
+
+#include <stdlib.h>
+#include <zephyr/kernel.h>
+#include <zephyr/net/coap.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/timing/timing.h>
+
+#include "coap_bench.h"
+#if defined(CONFIG_NATIVE_LIBRARY)
+#include "coap_bench_host.h"
+#endif
+#include "coap_client.h"
+#include "coap_server.h"
+
+#define BENCH_MSG_LEN 256
+#define BENCH_WARMUP 16
+
+static const char * const toggle_path[] = { "42770", "0", "8", NULL };
+static const char * const ontime_path[] = { "42770", "0", "3", NULL };
+static const uint8_t bench_token[COAP_TOKEN_MAX_LEN] = { 1, 2, 3, 4, 5, 6, 7, 8 };
+
+/* Packets shared by the cases, prepared by prepare_packets() */
+static uint8_t request_buf[BENCH_MSG_LEN];
+static uint16_t request_len;
+static uint8_t response_buf[BENCH_MSG_LEN];
+static uint16_t response_len;
+static struct coap_packet parsed_request;
+
+/* Scratch space of the timed calls */
+static uint8_t scratch_buf[BENCH_MSG_LEN];
+static struct coap_packet scratch;
+
+static uint32_t samples[CONFIG_APP_COAP_BENCH_ITERATIONS];
+static K_MUTEX_DEFINE(bench_mutex);
+
+/**
+ * Benchmark case, returns a negative error code on failure
+ */
+struct bench_case {
+	const char *name;
+	int (*run)(void);
+};
+
+static int bench_empty(void)
+{
+	return 0;
+}
+
+static int bench_request_build(void)
+{
+	return coap_request_build(&scratch, scratch_buf, sizeof(scratch_buf), COAP_TYPE_CON,
+				  COAP_METHOD_PUT, bench_token, sizeof(bench_token), 0x1234,
+				  toggle_path, NULL, 0);
+}
+
+static int bench_request_build_payload(void)
+{
+	return coap_request_build(&scratch, scratch_buf, sizeof(scratch_buf), COAP_TYPE_CON,
+				  COAP_METHOD_PUT, bench_token, sizeof(bench_token), 0x1234,
+				  ontime_path, (const uint8_t *)"20", 2);
+}
+
+static int bench_response_build(void)
+{
+	return on_off_object_state_build(&scratch, scratch_buf, sizeof(scratch_buf),
+					 COAP_TYPE_ACK, bench_token, sizeof(bench_token),
+					 0x1234, false, &parsed_request);
+}
+
+static int bench_notification_build(void)
+{
+	return on_off_object_state_build(&scratch, scratch_buf, sizeof(scratch_buf),
+					 COAP_TYPE_CON, bench_token, sizeof(bench_token),
+					 0x1234, true, NULL);
+}
+
+static int bench_request_parse(void)
+{
+	return coap_packet_parse(&scratch, request_buf, request_len, NULL, 0);
+}
+
+static int bench_response_parse(void)
+{
+	return coap_packet_parse(&scratch, response_buf, response_len, NULL, 0);
+}
+
+static int bench_option_encode(void)
+{
+	static const uint8_t etag[4] = { 0, 0, 0, 42 };
+	int ret;
+
+	ret = coap_packet_init(&scratch, scratch_buf, sizeof(scratch_buf), COAP_VERSION_1,
+			       COAP_TYPE_CON, 0, NULL, COAP_RESPONSE_CODE_CONTENT, 0x1234);
+	if (ret < 0) {
+		return ret;
+	}
+
+	ret = coap_packet_append_option(&scratch, COAP_OPTION_ETAG, etag, sizeof(etag));
+	if (ret < 0) {
+		return ret;
+	}
+
+	ret = coap_append_option_int(&scratch, COAP_OPTION_OBSERVE, 0x123456);
+	if (ret < 0) {
+		return ret;
+	}
+
+	return coap_append_option_int(&scratch, COAP_OPTION_CONTENT_FORMAT,
+				      COAP_CONTENT_FORMAT_TEXT_PLAIN);
+}
+
+static int bench_option_find(void)
+{
+	struct coap_option options[4];
+	int count;
+
+	count = coap_find_options(&parsed_request, COAP_OPTION_URI_PATH, options,
+				  ARRAY_SIZE(options));
+
+	return count == 3 ? 0 : -EINVAL;
+}
+
+static const struct bench_case cases[] = {
+	// Cost of the measurement itself, subtract it when comparing small cases
+	{ "timer_overhead", bench_empty },
+	{ "request_build", bench_request_build },
+	{ "request_build_payload", bench_request_build_payload },
+	{ "response_build", bench_response_build },
+	{ "notification_build", bench_notification_build },
+	{ "request_parse", bench_request_parse },
+	{ "response_parse", bench_response_parse },
+	{ "option_encode", bench_option_encode },
+	{ "option_find", bench_option_find },
+};
+
+/**
+ * Function used to encode the packets the parse cases work on
+ */
+static int prepare_packets(void)
+{
+	struct coap_packet packet;
+	int ret;
+
+	ret = coap_request_build(&packet, request_buf, sizeof(request_buf), COAP_TYPE_CON,
+				 COAP_METHOD_GET, bench_token, sizeof(bench_token), 0x1234,
+				 toggle_path, NULL, 0);
+	if (ret < 0) {
+		return ret;
+	}
+	request_len = packet.offset;
+
+	ret = coap_packet_parse(&parsed_request, request_buf, request_len, NULL, 0);
+	if (ret < 0) {
+		return ret;
+	}
+
+	ret = on_off_object_state_build(&packet, response_buf, sizeof(response_buf),
+					COAP_TYPE_ACK, bench_token, sizeof(bench_token), 0x1234,
+					true, NULL);
+	if (ret < 0) {
+		return ret;
+	}
+	response_len = packet.offset;
+
+	return 0;
+}
+
+static int compare_u32(const void *a, const void *b)
+{
+	uint32_t x = *(const uint32_t *)a;
+	uint32_t y = *(const uint32_t *)b;
+
+	return (x > y) - (x < y);
+}
+
+#if defined(CONFIG_NATIVE_LIBRARY)
+/* Samples are host ns */
+typedef uint64_t bench_stamp_t;
+
+static inline bench_stamp_t bench_stamp(void)
+{
+	return coap_bench_host_ns();
+}
+
+static inline uint32_t bench_sample(bench_stamp_t start, bench_stamp_t end)
+{
+	return (uint32_t)(end - start);
+}
+
+static uint32_t sample_to_ns(uint32_t sample)
+{
+	return sample;
+}
+#else
+/* Samples are cycles of the timing API */
+typedef timing_t bench_stamp_t;
+
+static inline bench_stamp_t bench_stamp(void)
+{
+	return timing_counter_get();
+}
+
+static inline uint32_t bench_sample(bench_stamp_t start, bench_stamp_t end)
+{
+	return (uint32_t)timing_cycles_get(&start, &end);
+}
+
+static uint32_t sample_to_ns(uint32_t sample)
+{
+	return (uint32_t)timing_cycles_to_ns(sample);
+}
+#endif
+
+/**
+ * Function used to time a single case
+ */
+static int run_case(const struct bench_case *bench, uint32_t iterations)
+{
+	bench_stamp_t start, end;
+	int ret;
+
+	for (uint32_t i = 0; i < BENCH_WARMUP; i++) {
+		ret = bench->run();
+		if (ret < 0) {
+			LOG_ERR("%s failed (%d)", bench->name, ret);
+			return ret;
+		}
+	}
+
+	for (uint32_t i = 0; i < iterations; i++) {
+		start = bench_stamp();
+		bench->run();
+		end = bench_stamp();
+		samples[i] = bench_sample(start, end);
+	}
+
+	qsort(samples, iterations, sizeof(samples[0]), compare_u32);
+
+	LOG_INF("%-22s min %6u ns  median %6u ns  p99 %6u ns  max %6u ns", bench->name,
+		sample_to_ns(samples[0]), sample_to_ns(samples[iterations / 2]),
+		sample_to_ns(samples[MIN(iterations * 99 / 100, iterations - 1)]),
+		sample_to_ns(samples[iterations - 1]));
+
+	return 0;
+}
+
+/**
+ * Function used to run every case
+ */
+int coap_bench_run(uint32_t iterations)
+{
+	int ret;
+
+	if (iterations == 0 || iterations > ARRAY_SIZE(samples)) {
+		return -EINVAL;
+	}
+
+	k_mutex_lock(&bench_mutex, K_FOREVER);
+
+	timing_init();
+	timing_start();
+
+	ret = prepare_packets();
+	if (ret < 0) {
+		LOG_ERR("Cannot prepare the packets (%d)", ret);
+		goto end;
+	}
+
+#if defined(CONFIG_NATIVE_LIBRARY)
+	LOG_INF("%u iterations, host clock", iterations);
+#else
+	LOG_INF("%u iterations, %u cycles/s", iterations,
+		(uint32_t)timing_freq_get());
+#endif
+
+	for (size_t i = 0; i < ARRAY_SIZE(cases); i++) {
+		ret = run_case(&cases[i], iterations);
+		if (ret < 0) {
+			break;
+		}
+	}
+
+end:
+	timing_stop();
+	k_mutex_unlock(&bench_mutex);
+
+	return ret;
+}
+
+#if defined(CONFIG_SHELL)
+static int cmd_bench(const struct shell *sh, size_t argc, char **argv)
+{
+	uint32_t iterations = CONFIG_APP_COAP_BENCH_ITERATIONS;
+	int ret;
+
+	if (argc > 1) {
+		iterations = strtoul(argv[1], NULL, 10);
+	}
+
+	ret = coap_bench_run(iterations);
+	if (ret == -EINVAL) {
+		shell_error(sh, "Iterations must be 1 to %d", CONFIG_APP_COAP_BENCH_ITERATIONS);
+	}
+
+	return ret;
+}
+
+SHELL_CMD_ARG_REGISTER(bench, NULL, "Run the CoAP micro-benchmark [iterations]", cmd_bench,
+		       1, 1);
+#endif
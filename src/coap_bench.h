@@ -0,0 +1,12 @@
+#ifndef __COAP_BENCH_H__
+#define __COAP_BENCH_H__
+
+#include <stdint.h>
+
+/**
+ * Function used to time the CoAP builders and parsers
+ * The results are logged per case as min, median, p99 and max
+ */
+int coap_bench_run(uint32_t iterations);
+
+#endif
@@ -0,0 +1,22 @@
+/*
+ * Host clock of the micro-benchmark on native_sim
+ * Built with the native simulator against the C library of the host, the
+ * clock keeps running while the embedded code runs
+ */
+
+#include <stdint.h>
+#include <time.h>
+
+#include "coap_bench_host.h"
+
+/**
+ * Function used to read the monotonic clock of the host in ns
+ */
+uint64_t coap_bench_host_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
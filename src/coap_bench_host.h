@@ -0,0 +1,12 @@
+#ifndef __COAP_BENCH_HOST_H__
+#define __COAP_BENCH_HOST_H__
+
+#include <stdint.h>
+
+/**
+ * Function used to read the monotonic clock of the host in ns
+ * Only available on native_sim
+ */
+uint64_t coap_bench_host_ns(void);
+
+#endif
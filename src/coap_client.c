@@ -1,248 +1,601 @@
 #include <zephyr/logging/log.h>
 LOG_MODULE_REGISTER(coap_client, LOG_LEVEL_DBG);
 
+#include <zephyr/kernel.h>
+#include <zephyr/random/random.h>
 #include <zephyr/net/socket.h>
 #include <zephyr/net/udp.h>
 #include <zephyr/net/coap.h>
 #include "net_private.h"
 
+#include "app_trace.h"
 #include "coap_client.h"
+#include "connectivity.h"
+#include "events.h"
+#include "handler_profile.h"
+#include "journal.h"
 
-/* CoAP socket fd */
-static int sock;
+#if defined(CONFIG_APP_BRIDGE_DISCOVERY)
+#include "discovery.h"
+#endif
+
+#if defined(CONFIG_APP_STATS)
+#include "app_stats.h"
+#endif
+
+#if defined(CONFIG_APP_SLEEPY)
+#include "sleepy.h"
+#endif
+
+#if defined(CONFIG_APP_THREAD_START)
+#include "thread_start.h"
+#endif
+
+#if defined(CONFIG_LWM2M)
+#include "lwm2m_client.h"
+#endif
 
 #define MAX_COAP_MSG_LEN 256
 
+#define RX_THREAD_STACK_SIZE 1536
+#define RX_THREAD_PRIORITY 7
+
+/**
+ * Request waiting for its response
+ * The encoded request is kept for retransmissions
+ */
+struct coap_request {
+	uint8_t data[MAX_COAP_MSG_LEN];
+	/* Bridge the request was sent to, retransmissions go to the same one */
+	struct sockaddr_in6 peer;
+	uint16_t len;
+	uint16_t id;
+	uint8_t token[COAP_TOKEN_MAX_LEN];
+	uint8_t tkl;
+	/* Set once an empty ACK announced a separate response */
+	bool acked;
+	/* Retransmission held back until the node is attached */
+	bool queued;
+	uint8_t retransmissions;
+	uint32_t timeout_ms;
+	/* Uptime of the first transmission */
+	int64_t sent_ms;
+#if defined(CONFIG_APP_SLEEPY)
+	/* Polling mode at the first transmission */
+	enum sleepy_mode sleepy_mode;
+#endif
+	/* Uptime at which the request is retransmitted or given up, queued
+	 * requests are given up at this time
+	 */
+	int64_t expiry_ms;
+	coap_response_cb_t cb;
+	void *user_data;
+};
+
+/* CoAP socket fd */
+static int sock = -1;
+
+#if !defined(CONFIG_APP_BRIDGE_DISCOVERY)
+/* Bridge address configured at build time */
+static struct sockaddr_in6 bridge;
+#endif
+
+/* Requests in flight, a NULL callback marks a free slot */
+static struct coap_request requests[CONFIG_APP_COAP_CLIENT_MAX_REQUESTS];
+static K_MUTEX_DEFINE(requests_mutex);
+
+static void retransmit_handler(struct k_work *work);
+static K_WORK_DELAYABLE_DEFINE(retransmit_work, retransmit_handler);
+
 /**
- * Function used to handle a coap reply
- * Prints the response to a coap request
+ * Function used to schedule the retransmission work for the next expiry
+ * Must be called with requests_mutex held
  */
-static int process_simple_coap_reply(void)
+static void schedule_expiry(void)
 {
-	struct coap_packet reply;
-	uint8_t *data;
-	int rcvd;
-	int ret;
+	int64_t next = INT64_MAX;
 
-	data = (uint8_t *)k_malloc(MAX_COAP_MSG_LEN);
-	if (!data) {
-		return -ENOMEM;
+	for (size_t i = 0; i < ARRAY_SIZE(requests); i++) {
+		if (requests[i].cb != NULL) {
+			next = MIN(next, requests[i].expiry_ms);
+		}
 	}
 
-	rcvd = recv(sock, data, MAX_COAP_MSG_LEN, MSG_DONTWAIT);
-	if (rcvd == 0) {
-		ret = -EIO;
-		goto end;
+	if (next == INT64_MAX) {
+		k_work_cancel_delayable(&retransmit_work);
+		return;
 	}
 
-	if (rcvd < 0) {
-		if (errno == EAGAIN || errno == EWOULDBLOCK) {
-			ret = 0;
-		} else {
-			ret = -errno;
-		}
+	k_work_reschedule(&retransmit_work, K_MSEC(MAX(next - k_uptime_get(), 0)));
+}
 
-		goto end;
+/**
+ * Function used to release a request and invoke its callback
+ * Must be called with requests_mutex held, the callback runs after unlocking
+ */
+static void complete(struct coap_request *req, int code, const uint8_t *payload, uint16_t len)
+{
+	coap_response_cb_t cb = req->cb;
+	void *user_data = req->user_data;
+	// The slot can be reused as soon as the mutex is released
+	int64_t rtt_ms = k_uptime_get() - req->sent_ms;
+#if defined(CONFIG_APP_SLEEPY)
+	enum sleepy_mode sleepy_mode = req->sleepy_mode;
+#endif
+
+	req->cb = NULL;
+	schedule_expiry();
+	k_mutex_unlock(&requests_mutex);
+
+#if defined(CONFIG_APP_SLEEPY)
+	sleepy_activity_end(sleepy_mode, code >= 0 ? (int32_t)rtt_ms : -1);
+#endif
+
+#if defined(CONFIG_APP_THREAD_START)
+	if (code >= 0) {
+		thread_start_request_done();
 	}
+#endif
 
-	net_hexdump("Response", data, rcvd);
+#if defined(CONFIG_APP_STATS)
+	app_stats_client_complete(code, (uint32_t)rtt_ms);
+#endif
 
-	ret = coap_packet_parse(&reply, data, rcvd, NULL, 0);
-	if (ret < 0) {
-		LOG_ERR("Invalid data received");
+	cb(code, payload, len, user_data);
+
+	k_mutex_lock(&requests_mutex, K_FOREVER);
+}
+
+/**
+ * Function used to send a request and arm its retransmission
+ * Must be called with requests_mutex held
+ */
+static int transmit(struct coap_request *req)
+{
+	req->queued = false;
+
+	if (req->retransmissions == 0) {
+		// Randomized initial timeout as described in RFC 7252 4.8
+		req->timeout_ms = CONFIG_COAP_INIT_ACK_TIMEOUT_MS +
+				  sys_rand32_get() % (CONFIG_COAP_INIT_ACK_TIMEOUT_MS / 2 + 1);
 	}
 
-end:
-	k_free(data);
+	req->expiry_ms = k_uptime_get() + req->timeout_ms;
+
+	APP_TRACE("req_send", req->id, req->retransmissions);
 
-	return ret;
+	if (sendto(sock, req->data, req->len, 0, (struct sockaddr *)&req->peer,
+		   sizeof(req->peer)) < 0) {
+		return -errno;
+	}
+
+	return 0;
 }
 
+/**
+ * Work handler retransmitting requests whose ACK timed out
+ */
+static void retransmit_handler(struct k_work *work)
+{
+	int64_t now = k_uptime_get();
+	int ret;
+
+	k_mutex_lock(&requests_mutex, K_FOREVER);
+
+	for (size_t i = 0; i < ARRAY_SIZE(requests); i++) {
+		struct coap_request *req = &requests[i];
+
+		if (req->cb == NULL || req->expiry_ms > now) {
+			continue;
+		}
+
+		if (req->queued) {
+			LOG_WRN("Request %u given up, not attached", req->id);
+			complete(req, -ENETUNREACH, NULL, 0);
+			continue;
+		}
+
+		if (req->acked || req->retransmissions >= CONFIG_COAP_MAX_RETRANSMIT) {
+			LOG_WRN("Request %u timed out", req->id);
+			APP_TRACE("req_timeout", req->id, req->retransmissions);
+#if defined(CONFIG_APP_BRIDGE_DISCOVERY)
+			if (!req->acked) {
+				// Fail over to the next bridge for the following requests
+				discovery_report_failure(&req->peer);
+			}
+#endif
+			complete(req, -ETIMEDOUT, NULL, 0);
+			continue;
+		}
+
+		if (!connectivity_is_attached()) {
+			// Hold the retransmission back instead of sending into a detached stack
+			req->queued = true;
+			req->expiry_ms = now + CONFIG_APP_COAP_CLIENT_QUEUE_TIMEOUT_MS;
+			continue;
+		}
+
+		// Exponential back-off as described in RFC 7252 4.2
+		req->retransmissions++;
+		req->timeout_ms *= 2;
+		APP_TRACE("req_retx", req->id, req->retransmissions);
+#if defined(CONFIG_APP_STATS)
+		app_stats_client_retransmit();
+#endif
+
+		ret = transmit(req);
+		if (ret < 0) {
+			LOG_WRN("Cannot retransmit request %u (%d)", req->id, ret);
+		}
+	}
+
+	schedule_expiry();
+	k_mutex_unlock(&requests_mutex);
+}
 
 /**
- * Function used to initialize the coap client
+ * Work handler sending the retransmissions held back while detached
  */
-int init_coap_client()
+static void flush_handler(struct k_work *work)
 {
-	int ret = 0;
-	struct sockaddr_in6 addr6;
+	int ret;
 
-	addr6.sin6_family = AF_INET6;
-	addr6.sin6_port = htons(COAP_PORT);
-	addr6.sin6_scope_id = 0U;
+	k_mutex_lock(&requests_mutex, K_FOREVER);
 
-	inet_pton(AF_INET6, CONFIG_NET_CONFIG_PEER_IPV6_ADDR,
-		  &addr6.sin6_addr);
+	for (size_t i = 0; i < ARRAY_SIZE(requests) && connectivity_is_attached(); i++) {
+		if (requests[i].cb == NULL || !requests[i].queued) {
+			continue;
+		}
 
-	sock = socket(addr6.sin6_family, SOCK_DGRAM, IPPROTO_UDP);
-	if (sock < 0) {
-		LOG_ERR("Failed to create UDP socket %d", errno);
-		return -errno;
+		ret = transmit(&requests[i]);
+		if (ret < 0) {
+			LOG_WRN("Cannot retransmit held request %u (%d)", requests[i].id, ret);
+		}
 	}
 
-	ret = connect(sock, (struct sockaddr *)&addr6, sizeof(addr6));
-	if (ret < 0) {
-		LOG_ERR("Cannot connect to UDP remote : %d", errno);
-		return -errno;
+	schedule_expiry();
+	k_mutex_unlock(&requests_mutex);
+}
+
+static K_WORK_DEFINE(flush_work, flush_handler);
+
+/**
+ * Listener used to flush the held retransmissions once the node attached
+ */
+static void conn_event_handler(const struct zbus_channel *chan)
+{
+	const struct conn_event *event = zbus_chan_const_msg(chan);
+
+	if (event->state == CONN_STATE_ATTACHED) {
+		k_work_submit(&flush_work);
 	}
+}
 
-	return 0;
+ZBUS_LISTENER_DEFINE(coap_client_conn_listener, conn_event_handler);
+ZBUS_CHAN_ADD_OBS(conn_chan, coap_client_conn_listener, 1);
+
+/**
+ * Function used to acknowledge a confirmable separate response
+ */
+static void send_ack(const struct coap_packet *response, const struct sockaddr_in6 *from)
+{
+	uint8_t data[4];
+	struct coap_packet ack;
+
+	if (coap_packet_init(&ack, data, sizeof(data), COAP_VERSION_1, COAP_TYPE_ACK, 0, NULL,
+			     COAP_CODE_EMPTY, coap_header_get_id(response)) == 0) {
+		(void)sendto(sock, ack.data, ack.offset, 0, (const struct sockaddr *)from,
+			     sizeof(*from));
+	}
 }
 
 /**
- * Function used to send a PUT request to the Toggle ressource
+ * Function used to check whether a message comes from the peer of a request
  */
-int matter_on_off_toggle_put(void)
+static bool from_peer(const struct coap_request *req, const struct sockaddr_in6 *from)
 {
-	const char * const on_off_toggle_path[] = { "42770", "0", "8", NULL };
-	struct coap_packet request;
-	const char * const *p;
-	uint8_t *data;
-	int r;
+	return from->sin6_port == req->peer.sin6_port &&
+	       net_ipv6_addr_cmp(&from->sin6_addr, &req->peer.sin6_addr);
+}
+
+/**
+ * Function used to match a received message with its request
+ * Only messages from the bridge a request was sent to complete it
+ */
+static void process_coap_reply(const uint8_t *data, int len, const struct sockaddr_in6 *from)
+{
+	struct coap_packet reply;
+	uint8_t token[COAP_TOKEN_MAX_LEN];
+	const uint8_t *payload;
+	uint16_t payload_len;
+	uint8_t type, code, tkl;
+	uint16_t id;
+	int ret;
 
-	data = (uint8_t *)k_malloc(MAX_COAP_MSG_LEN);
-	if (!data) {
-		return -ENOMEM;
+	net_hexdump("Response", data, len);
+
+	ret = coap_packet_parse(&reply, (uint8_t *)data, len, NULL, 0);
+	if (ret < 0) {
+		LOG_ERR("Invalid data received");
+		return;
 	}
 
-	r = coap_packet_init(&request, data, MAX_COAP_MSG_LEN,
-			     COAP_VERSION_1, COAP_TYPE_CON,
-			     COAP_TOKEN_MAX_LEN, coap_next_token(),
-			     COAP_METHOD_PUT, coap_next_id());
-	if (r < 0) {
-		LOG_ERR("Failed to init CoAP message");
-		goto end;
+	type = coap_header_get_type(&reply);
+	code = coap_header_get_code(&reply);
+	id = coap_header_get_id(&reply);
+	tkl = coap_header_get_token(&reply, token);
+	payload = coap_packet_get_payload(&reply, &payload_len);
+
+	if (type == COAP_TYPE_CON) {
+		send_ack(&reply, from);
 	}
 
-	for (p = on_off_toggle_path; p && *p; p++) {
-		r = coap_packet_append_option(&request, COAP_OPTION_URI_PATH,
-					      *p, strlen(*p));
-		if (r < 0) {
-			LOG_ERR("Unable add option to request");
-			goto end;
+	k_mutex_lock(&requests_mutex, K_FOREVER);
+
+	for (size_t i = 0; i < ARRAY_SIZE(requests); i++) {
+		struct coap_request *req = &requests[i];
+
+		if (req->cb == NULL || !from_peer(req, from)) {
+			continue;
+		}
+
+		if (code == COAP_CODE_EMPTY) {
+			if (type == COAP_TYPE_ACK && id == req->id) {
+				APP_TRACE("req_ack", req->id, 0);
+				// The response follows separately
+				req->acked = true;
+				req->expiry_ms = k_uptime_get() +
+						 CONFIG_APP_COAP_CLIENT_RESPONSE_TIMEOUT_MS;
+				schedule_expiry();
+			} else if (type == COAP_TYPE_RESET && id == req->id) {
+				complete(req, -ECONNRESET, NULL, 0);
+			}
+			continue;
+		}
+
+		if (tkl == req->tkl && memcmp(token, req->token, tkl) == 0) {
+			// A piggybacked response is the ACK as well
+			APP_TRACE("req_rsp", req->id, code);
+			complete(req, code, payload, payload_len);
+			break;
 		}
 	}
 
-	net_hexdump("Request", request.data, request.offset);
+	k_mutex_unlock(&requests_mutex);
+}
 
-	r = send(sock, request.data, request.offset, 0);
+HANDLER_PROFILE_DEFINE(coap_reply);
 
-end:
-	k_free(data);
+/**
+ * Thread receiving the responses of the bridge
+ */
+static void rx_thread(void *p1, void *p2, void *p3)
+{
+	static uint8_t data[MAX_COAP_MSG_LEN];
+	struct handler_probe probe;
+	struct sockaddr_in6 from;
+	socklen_t from_len;
+	int rcvd;
 
-	return r;
+	while (true) {
+		from_len = sizeof(from);
+		rcvd = recvfrom(sock, data, sizeof(data), 0, (struct sockaddr *)&from, &from_len);
+		if (rcvd <= 0) {
+			LOG_ERR("Cannot receive from the bridge (%d)", errno);
+			k_sleep(K_SECONDS(1));
+			continue;
+		}
+
+		HANDLER_PROFILE_BEGIN(&probe);
+		process_coap_reply(data, rcvd, &from);
+		HANDLER_PROFILE_END(coap_reply, &probe);
+	}
 }
 
+K_THREAD_STACK_DEFINE(rx_thread_stack, RX_THREAD_STACK_SIZE);
+static struct k_thread rx_thread_data;
+
 /**
- * Function used to send a GET request to the OnOff ressource
+ * Function used to initialize the coap client
  */
-int matter_on_off_onoff_get()
+int init_coap_client(void)
 {
-	const char * const on_off_onoff_path[] = { "42770", "0", "5", NULL };
-	struct coap_packet request;
-	const char * const *p;
-	uint8_t *data;
-	int r;
+#if !defined(CONFIG_APP_BRIDGE_DISCOVERY)
+	bridge.sin6_family = AF_INET6;
+	bridge.sin6_port = htons(COAP_PORT);
+	bridge.sin6_scope_id = 0U;
+
+	inet_pton(AF_INET6, CONFIG_NET_CONFIG_PEER_IPV6_ADDR,
+		  &bridge.sin6_addr);
+#endif
 
-	data = (uint8_t *)k_malloc(MAX_COAP_MSG_LEN);
-	if (!data) {
-		return -ENOMEM;
+	// Not connected, the bridge can change between requests
+	sock = socket(AF_INET6, SOCK_DGRAM, IPPROTO_UDP);
+	if (sock < 0) {
+		LOG_ERR("Failed to create UDP socket %d", errno);
+		return -errno;
 	}
 
-	r = coap_packet_init(&request, data, MAX_COAP_MSG_LEN,
-			     COAP_VERSION_1, COAP_TYPE_CON,
-			     COAP_TOKEN_MAX_LEN, coap_next_token(),
-			     COAP_METHOD_GET, coap_next_id());
+	k_thread_create(&rx_thread_data, rx_thread_stack,
+			K_THREAD_STACK_SIZEOF(rx_thread_stack), rx_thread,
+			NULL, NULL, NULL, RX_THREAD_PRIORITY, 0, K_NO_WAIT);
+	k_thread_name_set(&rx_thread_data, "coap_client_rx");
+
+	return 0;
+}
+
+/**
+ * Function used to get the address of the bridge
+ */
+static int get_bridge(struct sockaddr_in6 *addr)
+{
+#if defined(CONFIG_APP_BRIDGE_DISCOVERY)
+	return discovery_get_bridge(addr);
+#else
+	*addr = bridge;
+	return 0;
+#endif
+}
+
+/**
+ * Function used to encode a request into buf
+ */
+int coap_request_build(struct coap_packet *request, uint8_t *buf, uint16_t buf_len,
+		       uint8_t type, uint8_t method, const uint8_t *token, uint8_t tkl, uint16_t id,
+		       const char * const *path, const uint8_t *payload, uint16_t payload_len)
+{
+	const char * const *p;
+	int r;
+
+	r = coap_packet_init(request, buf, buf_len, COAP_VERSION_1, type, tkl, token,
+			     method, id);
 	if (r < 0) {
 		LOG_ERR("Failed to init CoAP message");
-		goto end;
+		return r;
 	}
 
-	for (p = on_off_onoff_path; p && *p; p++) {
-		r = coap_packet_append_option(&request, COAP_OPTION_URI_PATH,
+	for (p = path; p && *p; p++) {
+		r = coap_packet_append_option(request, COAP_OPTION_URI_PATH,
 					      *p, strlen(*p));
 		if (r < 0) {
 			LOG_ERR("Unable add option to request");
-			goto end;
+			return r;
 		}
 	}
 
-	net_hexdump("Request", request.data, request.offset);
-
-	r = send(sock, request.data, request.offset, 0);
-
-	r = process_simple_coap_reply();
+	if (payload_len > 0) {
+		r = coap_packet_append_payload_marker(request);
+		if (r < 0) {
+			LOG_ERR("Unable to append payload marker");
+			return r;
+		}
 
-end:
-	k_free(data);
+		r = coap_packet_append_payload(request, payload, payload_len);
+		if (r < 0) {
+			LOG_ERR("Not able to append payload");
+			return r;
+		}
+	}
 
-	return r;
+	return 0;
 }
 
+HANDLER_PROFILE_DEFINE(coap_request);
+
 /**
- * Function used to send a PUT request to the OnTime ressource
+ * Function used to send a confirmable request to the bridge without journaling it
  */
-int matter_on_off_ontime_put()
+int coap_request_transmit(uint8_t method, const char * const *path, const uint8_t *payload,
+			  uint16_t payload_len, coap_response_cb_t cb, void *user_data)
 {
-	uint8_t payload[] = "20";
-	const char * const on_off_ontime_path[] = { "42770", "0", "3", NULL };
+	struct coap_request *req = NULL;
+	struct handler_probe probe;
 	struct coap_packet request;
-	const char * const *p;
-	uint8_t *data;
+	struct sockaddr_in6 peer;
 	int r;
 
-	data = (uint8_t *)k_malloc(MAX_COAP_MSG_LEN);
-	if (!data) {
-		return -ENOMEM;
+	if (sock < 0) {
+		return -ENOTCONN;
 	}
 
-	r = coap_packet_init(&request, data, MAX_COAP_MSG_LEN,
-			     COAP_VERSION_1, COAP_TYPE_CON,
-			     COAP_TOKEN_MAX_LEN, coap_next_token(),
-			     COAP_METHOD_PUT, coap_next_id());
-	if (r < 0) {
-		LOG_ERR("Failed to init CoAP message");
-		goto end;
+	if (cb == NULL) {
+		return -EINVAL;
 	}
 
-	for (p = on_off_ontime_path; p && *p; p++) {
-		r = coap_packet_append_option(&request, COAP_OPTION_URI_PATH,
-					      *p, strlen(*p));
-		if (r < 0) {
-			LOG_ERR("Unable add option to request");
-			goto end;
+	if (!connectivity_is_attached() || get_bridge(&peer) < 0) {
+		return -ENETUNREACH;
+	}
+
+	k_mutex_lock(&requests_mutex, K_FOREVER);
+	HANDLER_PROFILE_BEGIN(&probe);
+
+	for (size_t i = 0; i < ARRAY_SIZE(requests); i++) {
+		if (requests[i].cb == NULL) {
+			req = &requests[i];
+			break;
 		}
 	}
 
+	if (req == NULL) {
+		r = -EBUSY;
+		goto end;
+	}
+
+	req->id = coap_next_id();
+	req->tkl = COAP_TOKEN_MAX_LEN;
+	memcpy(req->token, coap_next_token(), COAP_TOKEN_MAX_LEN);
 
-	r = coap_packet_append_payload_marker(&request);
+	APP_TRACE("req_build", req->id, 0);
+	r = coap_request_build(&request, req->data, sizeof(req->data), COAP_TYPE_CON, method,
+			       req->token, req->tkl, req->id, path, payload, payload_len);
+	APP_TRACE("req_built", req->id, request.offset);
 	if (r < 0) {
-		LOG_ERR("Unable to append payload marker");
 		goto end;
 	}
 
-	r = coap_packet_append_payload(&request, (uint8_t *)payload, sizeof(payload) - 1);
+	net_hexdump("Request", request.data, request.offset);
+
+	req->peer = peer;
+	req->len = request.offset;
+	req->acked = false;
+	req->retransmissions = 0;
+
+	r = transmit(req);
 	if (r < 0) {
-		LOG_ERR("Not able to append payload");
 		goto end;
 	}
 
-	net_hexdump("Request", request.data, request.offset);
+	req->cb = cb;
+	req->user_data = user_data;
+	req->sent_ms = k_uptime_get();
+	schedule_expiry();
+	r = 0;
+
+#if defined(CONFIG_APP_SLEEPY)
+	// Poll fast until the response arrived
+	req->sleepy_mode = sleepy_activity_begin();
+#endif
 
-	r = send(sock, request.data, request.offset, 0);
+#if defined(CONFIG_APP_STATS)
+	app_stats_client_sent();
+#endif
 
 end:
-	k_free(data);
+	HANDLER_PROFILE_END(coap_request, &probe);
+	k_mutex_unlock(&requests_mutex);
+
+#if defined(CONFIG_LWM2M)
+	if (r == 0) {
+		// The radio is awake anyway, let a due registration update ride along
+		lwm2m_client_uplink_hint();
+	}
+#endif
 
 	return r;
 }
 
 /**
- * Function used to close the coap client socket
+ * Function used to send a confirmable request to the bridge
  */
-int close_socket(void)
+int coap_request_send(uint8_t method, const char * const *path, const uint8_t *payload,
+		      uint16_t payload_len, coap_response_cb_t cb, void *user_data)
 {
-    /* Close the socket */
-	(void)close(sock);
-    return 0;
+	int r;
+
+	APP_TRACE("req_enqueue", method, 0);
+
+	// Older requests are still journaled, this one must not overtake them
+	if (!journal_pending()) {
+		r = coap_request_transmit(method, path, payload, payload_len, cb, user_data);
+		if (r != -ENETUNREACH) {
+			return r;
+		}
+	}
+
+	// Replayed by the journal once attached and the bridge is known
+	APP_TRACE("req_journal", method, 0);
+#if defined(CONFIG_APP_STATS)
+	app_stats_client_journaled();
+#endif
+	return journal_add(method, path, payload, payload_len, cb, user_data);
 }
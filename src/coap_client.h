@@ -1,31 +1,46 @@
 #ifndef __OT_COAP_CLIENT_H__
 #define __OT_COAP_CLIENT_H__
 
+#include <stdint.h>
+#include <zephyr/net/coap.h>
+
 #define COAP_PORT 5683
 
 /**
- * Function used to initialize the coap client
+ * Callback invoked once per request
+ * code is the CoAP response code or a negative error code if no response
+ * arrived, payload is only valid during the callback
  */
-int init_coap_client();
+typedef void (*coap_response_cb_t)(int code, const uint8_t *payload, uint16_t len,
+				   void *user_data);
 
 /**
- * Function used to send a PUT request to the Toggle ressource
+ * Function used to initialize the coap client
  */
-int matter_on_off_toggle_put();
+int init_coap_client(void);
 
 /**
- * Function used to send a GET request to the OnOff ressource
+ * Function used to encode a request into buf
+ * path is a NULL terminated list of Uri-Path segments
  */
-int matter_on_off_onoff_get();
+int coap_request_build(struct coap_packet *request, uint8_t *buf, uint16_t buf_len,
+		       uint8_t type, uint8_t method, const uint8_t *token, uint8_t tkl, uint16_t id,
+		       const char * const *path, const uint8_t *payload, uint16_t payload_len);
 
 /**
- * Function used to send a PUT request to the OnTime ressource
+ * Function used to send a confirmable request to the bridge without journaling it
+ * Returns -ENETUNREACH while detached or without a known bridge, cb is only
+ * taken over by the client if 0 is returned
  */
-int matter_on_off_ontime_put();
+int coap_request_transmit(uint8_t method, const char * const *path, const uint8_t *payload,
+			  uint16_t payload_len, coap_response_cb_t cb, void *user_data);
 
 /**
- * Function used to close the coap client socket
+ * Function used to send a confirmable request to the bridge
+ * Returns immediately, cb is invoked from the client once the request completed
+ * While detached or without a known bridge the request is journaled instead
  */
-int close_socket();
+int coap_request_send(uint8_t method, const char * const *path, const uint8_t *payload,
+		      uint16_t payload_len, coap_response_cb_t cb, void *user_data);
 
-#endif
\ No newline at end of file
+#endif
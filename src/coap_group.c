@@ -0,0 +1,377 @@
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(coap_group, LOG_LEVEL_DBG);
+
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/random/random.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/net/net_if.h>
+#include <zephyr/net/net_ip.h>
+#include <zephyr/net/socket.h>
+#include <zephyr/sys/byteorder.h>
+
+#include "coap_group.h"
+
+#define ALL_COAP_NODES_REALM_LOCAL "ff03::fd"
+
+#define COAP_PORT 5683
+
+#define GROUP_THREAD_STACK_SIZE 1024
+// Above the CoAP server thread, which runs at the lowest application priority
+#define GROUP_THREAD_PRIORITY 5
+
+// Group datagrams remembered for the classification of the server's copy
+#define GROUP_RECENT_MAX 4
+#define GROUP_RECENT_MS 1000
+
+/* No-Response option, see RFC 7967 */
+#define GROUP_OPTION_NO_RESPONSE 258
+#define NO_RESPONSE_SUPPRESS_2XX BIT(1)
+#define NO_RESPONSE_SUPPRESS_4XX BIT(3)
+#define NO_RESPONSE_SUPPRESS_5XX BIT(4)
+
+/**
+ * Response that is held back until its leisure time has passed
+ * Only one response is kept, group responses that arrive while it is
+ * still pending are suppressed
+ */
+struct leisure_response {
+	struct k_work_delayable work;
+	const struct coap_resource *resource;
+	struct sockaddr_in6 addr;
+	socklen_t addr_len;
+	uint8_t data[CONFIG_COAP_SERVER_MESSAGE_SIZE];
+	uint16_t len;
+	atomic_t busy;
+};
+
+static struct leisure_response leisure;
+
+/**
+ * Datagram received on a group socket, identified by its sender and message ID
+ */
+struct group_request {
+	struct in6_addr addr;
+	uint16_t port;
+	uint16_t id;
+	int64_t received_ms;
+	bool valid;
+};
+
+static struct group_request recent[GROUP_RECENT_MAX];
+static size_t recent_next;
+static struct k_spinlock recent_lock;
+
+// One socket per joined group, bound to the group address
+static struct pollfd group_fds[CONFIG_APP_COAP_GROUP_MAX];
+static size_t group_count;
+
+K_THREAD_STACK_DEFINE(group_thread_stack, GROUP_THREAD_STACK_SIZE);
+static struct k_thread group_thread_data;
+
+/**
+ * Function used to open the socket receiving the requests sent to a group
+ * The stack hands a multicast datagram to every matching socket, so the
+ * CoAP server bound to the unspecified address gets its own copy and is the
+ * only one handling the request. The copy on the group socket only tells
+ * that the request was sent to a group.
+ */
+static int open_group_socket(const struct in6_addr *addr)
+{
+	struct sockaddr_in6 local = {
+		.sin6_family = AF_INET6,
+		.sin6_port = htons(COAP_PORT),
+		.sin6_addr = *addr,
+	};
+	int reuse = 1;
+	int fd;
+
+	if (group_count == ARRAY_SIZE(group_fds)) {
+		LOG_ERR("Too many CoAP groups, increase CONFIG_APP_COAP_GROUP_MAX");
+		return -ENOMEM;
+	}
+
+	fd = socket(AF_INET6, SOCK_DGRAM, IPPROTO_UDP);
+	if (fd < 0) {
+		LOG_ERR("Failed to create group socket %d", errno);
+		return -errno;
+	}
+
+	// The CoAP server already uses the port on the unspecified address
+	if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) < 0 ||
+	    bind(fd, (struct sockaddr *)&local, sizeof(local)) < 0) {
+		LOG_ERR("Failed to bind group socket %d", errno);
+		close(fd);
+		return -errno;
+	}
+
+	group_fds[group_count].fd = fd;
+	group_fds[group_count].events = POLLIN;
+	group_count++;
+
+	return 0;
+}
+
+/**
+ * Function used to join a single multicast group on the given interface
+ */
+static int join_group(struct net_if *iface, const char *addr_str)
+{
+	struct net_if_mcast_addr *maddr;
+	struct in6_addr addr;
+
+	if (net_addr_pton(AF_INET6, addr_str, &addr) < 0 || !net_ipv6_is_addr_mcast(&addr)) {
+		LOG_ERR("Invalid group address %s", addr_str);
+		return -EINVAL;
+	}
+
+	maddr = net_if_ipv6_maddr_lookup(&addr, &iface);
+	if (!maddr) {
+		maddr = net_if_ipv6_maddr_add(iface, &addr);
+		if (!maddr) {
+			LOG_ERR("Cannot add group address %s", addr_str);
+			return -ENOMEM;
+		}
+	}
+
+	net_if_ipv6_maddr_join(iface, maddr);
+	LOG_INF("Joined CoAP group %s", addr_str);
+
+	return open_group_socket(&addr);
+}
+
+/**
+ * Callback function for the leisure work item
+ * Sends the response once the leisure time has passed
+ */
+static void leisure_expired(struct k_work *work)
+{
+	ARG_UNUSED(work);
+	struct coap_packet response;
+	int ret;
+
+	ret = coap_packet_parse(&response, leisure.data, leisure.len, NULL, 0);
+	if (ret == 0) {
+		ret = coap_resource_send(leisure.resource, &response,
+					 (struct sockaddr *)&leisure.addr, leisure.addr_len, NULL);
+	}
+
+	if (ret < 0) {
+		LOG_ERR("Failed to send group response: %d", ret);
+	}
+
+	atomic_clear(&leisure.busy);
+}
+
+/**
+ * Function used to check the No-Response option of a request against a response code
+ */
+static bool no_response_requested(const struct coap_packet *request, uint8_t code)
+{
+	struct coap_option option;
+	uint32_t suppress;
+
+	if (coap_find_options(request, GROUP_OPTION_NO_RESPONSE, &option, 1) != 1) {
+		return false;
+	}
+
+	suppress = coap_option_value_to_int(&option);
+
+	switch (code >> 5) {
+	case 2:
+		return suppress & NO_RESPONSE_SUPPRESS_2XX;
+	case 4:
+		return suppress & NO_RESPONSE_SUPPRESS_4XX;
+	case 5:
+		return suppress & NO_RESPONSE_SUPPRESS_5XX;
+	default:
+		return false;
+	}
+}
+
+/**
+ * Function used to remember a datagram received on a group socket
+ */
+static void record_group_request(const uint8_t *data, size_t len,
+				 const struct sockaddr_in6 *from)
+{
+	k_spinlock_key_t key;
+
+	// Version, type and token length, code and message ID
+	if (len < 4) {
+		return;
+	}
+
+	key = k_spin_lock(&recent_lock);
+
+	recent[recent_next] = (struct group_request){
+		.addr = from->sin6_addr,
+		.port = from->sin6_port,
+		.id = sys_get_be16(&data[2]),
+		.received_ms = k_uptime_get(),
+		.valid = true,
+	};
+	recent_next = (recent_next + 1) % ARRAY_SIZE(recent);
+
+	k_spin_unlock(&recent_lock, key);
+}
+
+/**
+ * Thread receiving the requests sent to the joined groups
+ * The datagrams are queued to the group socket and the socket of the CoAP
+ * server at once, this thread has the higher priority and records its copy
+ * before the server handles the request
+ */
+static void group_thread(void *p1, void *p2, void *p3)
+{
+	// Only the header is needed, the rest of the datagram is discarded
+	uint8_t data[4];
+	struct sockaddr_in6 from;
+	socklen_t from_len;
+	ssize_t rcvd;
+
+	while (true) {
+		if (poll(group_fds, group_count, -1) < 0) {
+			LOG_ERR("Cannot poll the group sockets (%d)", errno);
+			k_sleep(K_SECONDS(1));
+			continue;
+		}
+
+		for (size_t i = 0; i < group_count; i++) {
+			if (!(group_fds[i].revents & POLLIN)) {
+				continue;
+			}
+
+			from_len = sizeof(from);
+			rcvd = recvfrom(group_fds[i].fd, data, sizeof(data), 0,
+					(struct sockaddr *)&from, &from_len);
+			if (rcvd <= 0 || from.sin6_family != AF_INET6) {
+				continue;
+			}
+
+			record_group_request(data, rcvd, &from);
+		}
+	}
+}
+
+/**
+ * Function used to join the configured CoAP multicast groups
+ */
+int coap_group_init(void)
+{
+	char addrs[] = CONFIG_APP_COAP_GROUP_ADDRS;
+	struct net_if *iface;
+	char *saveptr;
+	char *token;
+	int ret = 0;
+
+	k_work_init_delayable(&leisure.work, leisure_expired);
+
+	iface = net_if_get_default();
+	if (!iface) {
+		LOG_ERR("No network interface to join groups on");
+		return -ENODEV;
+	}
+
+	if (IS_ENABLED(CONFIG_APP_COAP_GROUP_ALL_NODES)) {
+		ret = join_group(iface, ALL_COAP_NODES_REALM_LOCAL);
+	}
+
+	for (token = strtok_r(addrs, " ,", &saveptr); token;
+	     token = strtok_r(NULL, " ,", &saveptr)) {
+		int err = join_group(iface, token);
+
+		if (err < 0) {
+			ret = err;
+		}
+	}
+
+	if (group_count > 0) {
+		k_thread_create(&group_thread_data, group_thread_stack,
+				K_THREAD_STACK_SIZEOF(group_thread_stack), group_thread,
+				NULL, NULL, NULL, GROUP_THREAD_PRIORITY, 0, K_NO_WAIT);
+		k_thread_name_set(&group_thread_data, "coap_group");
+	}
+
+	return ret;
+}
+
+/**
+ * Function used to check whether a request has to be treated as a group request
+ * A request is one if the same sender sent a datagram with its message ID
+ * to a group socket shortly before
+ */
+bool coap_group_is_group_request(const struct coap_packet *request,
+				 const struct sockaddr *addr)
+{
+	const struct sockaddr_in6 *from = (const struct sockaddr_in6 *)addr;
+	uint16_t id = coap_header_get_id(request);
+	int64_t now = k_uptime_get();
+	bool found = false;
+	k_spinlock_key_t key;
+
+	if (addr->sa_family != AF_INET6) {
+		return false;
+	}
+
+	key = k_spin_lock(&recent_lock);
+
+	for (size_t i = 0; i < ARRAY_SIZE(recent); i++) {
+		if (recent[i].valid && recent[i].id == id && recent[i].port == from->sin6_port &&
+		    now - recent[i].received_ms < GROUP_RECENT_MS &&
+		    net_ipv6_addr_cmp(&recent[i].addr, &from->sin6_addr)) {
+			found = true;
+			break;
+		}
+	}
+
+	k_spin_unlock(&recent_lock, key);
+
+	return found;
+}
+
+/**
+ * Function used to send a response with RFC 7390 response suppression
+ */
+int coap_group_respond(const struct coap_resource *resource, const struct coap_packet *request,
+		       const struct coap_packet *response, const struct sockaddr *addr,
+		       socklen_t addr_len)
+{
+	uint32_t delay_ms;
+
+	if (no_response_requested(request, coap_header_get_code(response))) {
+		return 0;
+	}
+
+	if (!coap_group_is_group_request(request, addr)) {
+		return coap_resource_send(resource, response, addr, addr_len, NULL);
+	}
+
+	// Multicast requests must not be confirmable, see RFC 7252 section 8.1
+	if (coap_header_get_type(request) == COAP_TYPE_CON) {
+		LOG_DBG("Not answering confirmable group request");
+		return 0;
+	}
+
+	if (CONFIG_APP_COAP_GROUP_LEISURE_MS == 0 || addr_len > sizeof(leisure.addr) ||
+	    response->offset > sizeof(leisure.data)) {
+		return 0;
+	}
+
+	// Another group response is still waiting for its leisure, suppress this one
+	if (atomic_set(&leisure.busy, 1)) {
+		LOG_DBG("Suppressing group response, leisure slot busy");
+		return 0;
+	}
+
+	leisure.resource = resource;
+	memcpy(&leisure.addr, addr, addr_len);
+	leisure.addr_len = addr_len;
+	memcpy(leisure.data, response->data, response->offset);
+	leisure.len = response->offset;
+
+	delay_ms = sys_rand32_get() % (CONFIG_APP_COAP_GROUP_LEISURE_MS + 1);
+	k_work_schedule(&leisure.work, K_MSEC(delay_ms));
+
+	return 0;
+}
@@ -0,0 +1,28 @@
+#ifndef __COAP_GROUP_H__
+#define __COAP_GROUP_H__
+
+#include <zephyr/net/coap.h>
+#include <zephyr/net/coap_service.h>
+
+/**
+ * Function used to join the configured CoAP multicast groups
+ */
+int coap_group_init(void);
+
+/**
+ * Function used to check whether a request has to be treated as a group request
+ * addr is the sender of the request as passed to the resource handler
+ */
+bool coap_group_is_group_request(const struct coap_packet *request,
+				 const struct sockaddr *addr);
+
+/**
+ * Function used to send a response with RFC 7390 response suppression
+ * Honors the No-Response option and delays responses to group requests
+ * by a random leisure time
+ */
+int coap_group_respond(const struct coap_resource *resource, const struct coap_packet *request,
+		       const struct coap_packet *response, const struct sockaddr *addr,
+		       socklen_t addr_len);
+
+#endif
@@ -0,0 +1,471 @@
+/*
+ * CoAP server of the on/off object
+ * Resources of the light under /42769/0, the state resource supports ETag
+ * revalidation and Observe, observers are notified on every light change.
+ */
+
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(coap_server, LOG_LEVEL_DBG);
+
+#include <zephyr/kernel.h>
+#include <string.h>
+#include <zephyr/net/coap.h>
+#include <zephyr/net/coap_service.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/zbus/zbus.h>
+
+#include "coap_server.h"
+#include "events.h"
+#include "handler_profile.h"
+#include "light.h"
+#if defined(CONFIG_APP_SLEEPY)
+#include "sleepy.h"
+#endif
+#if defined(CONFIG_APP_COAP_GROUP)
+#include "coap_group.h"
+#endif
+
+// CoAP Server Service Definition
+// Started from main once the stored state is restored
+COAP_SERVICE_DEFINE(coap_server, NULL, 5683, 0);
+
+/**
+ * Function used to encode the light version as a CoAP ETag
+ */
+static void on_off_object_state_etag(uint32_t version, uint8_t etag[sizeof(uint32_t)])
+{
+	sys_put_be32(version, etag);
+}
+
+/**
+ * Function used to build a response for the onoff resource
+ *
+ * The ETag is derived from the light version so a client revalidating with
+ * the current tag gets a 2.03 Valid without payload. ETag, Observe sequence
+ * and payload come from the same snapshot, so they always describe the same
+ * state.
+ */
+int on_off_object_state_build(struct coap_packet *response, uint8_t *buf, size_t buf_len,
+			      uint8_t type, const uint8_t *token, uint8_t tkl, uint16_t id,
+			      bool observe, const struct coap_packet *request)
+{
+	struct light_state state;
+	uint8_t etag[sizeof(uint32_t)];
+	uint8_t code = COAP_RESPONSE_CODE_CONTENT;
+	char payload;
+	struct coap_option option;
+	int ret;
+
+	light_get_state(&state);
+	payload = state.on ? '1' : '0';
+
+	on_off_object_state_etag(state.version, etag);
+
+	if (request != NULL &&
+	    coap_find_options(request, COAP_OPTION_ETAG, &option, 1) == 1 &&
+	    option.len == sizeof(etag) && memcmp(option.value, etag, sizeof(etag)) == 0) {
+		code = COAP_RESPONSE_CODE_VALID;
+	}
+
+	ret = coap_packet_init(response, buf, buf_len, COAP_VERSION_1, type, tkl, token, code, id);
+	if (ret < 0) {
+		return ret;
+	}
+
+	// Options have to be appended in ascending order: ETag, Observe, Content-Format
+	ret = coap_packet_append_option(response, COAP_OPTION_ETAG, etag, sizeof(etag));
+	if (ret < 0) {
+		return ret;
+	}
+
+	if (observe) {
+		ret = coap_append_option_int(response, COAP_OPTION_OBSERVE, state.version & 0xFFFFFF);
+		if (ret < 0) {
+			return ret;
+		}
+	}
+
+	if (code == COAP_RESPONSE_CODE_VALID) {
+		return 0;
+	}
+
+	ret = coap_append_option_int(response, COAP_OPTION_CONTENT_FORMAT,
+				     COAP_CONTENT_FORMAT_TEXT_PLAIN);
+	if (ret < 0) {
+		return ret;
+	}
+
+	ret = coap_packet_append_payload_marker(response);
+	if (ret < 0) {
+		return ret;
+	}
+
+	return coap_packet_append_payload(response, (uint8_t *)&payload, sizeof(payload));
+}
+
+/**
+ * GET request handler for the onoff resource
+ */
+static int on_off_object_state_get(struct coap_resource *resource, struct coap_packet *request,
+                  struct sockaddr *addr, socklen_t addr_len)
+{
+    uint8_t data[CONFIG_COAP_SERVER_MESSAGE_SIZE];
+    struct coap_packet response;
+    uint16_t id;
+    uint8_t token[COAP_TOKEN_MAX_LEN];
+    uint8_t tkl, type;
+    bool observe;
+    int ret;
+
+    type = coap_header_get_type(request);
+    id = coap_header_get_id(request);
+    tkl = coap_header_get_token(request, token);
+
+    /* Register the client as observer if requested */
+    observe = coap_resource_parse_observe(resource, request, addr) == 0;
+
+    /* Determine response type */
+    type = (type == COAP_TYPE_CON) ? COAP_TYPE_ACK : COAP_TYPE_NON_CON;
+
+    ret = on_off_object_state_build(&response, data, sizeof(data), type, token, tkl, id,
+                                    observe, request);
+    if (ret < 0) {
+        LOG_ERR("Failed to build state response (%d)", ret);
+        return ret;
+    }
+
+    /* Send to response back to the client */
+#if defined(CONFIG_APP_COAP_GROUP)
+    return coap_group_respond(resource, request, &response, addr, addr_len);
+#else
+    return coap_resource_send(resource, &response, addr, addr_len, NULL);
+#endif
+}
+
+HANDLER_PROFILE_WRAP(on_off_object_state_get)
+
+/**
+ * Notify handler for observers of the onoff resource
+ */
+static void on_off_object_state_notify(struct coap_resource *resource,
+				       struct coap_observer *observer)
+{
+	uint8_t data[CONFIG_COAP_SERVER_MESSAGE_SIZE];
+	struct coap_packet notification;
+	int ret;
+
+	ret = on_off_object_state_build(&notification, data, sizeof(data), COAP_TYPE_CON,
+					observer->token, observer->tkl, coap_next_id(), true,
+					NULL);
+	if (ret < 0) {
+		LOG_ERR("Failed to build state notification (%d)", ret);
+		return;
+	}
+
+	ret = coap_resource_send(resource, &notification, &observer->addr,
+				 sizeof(observer->addr), NULL);
+	if (ret < 0) {
+		LOG_ERR("Failed to send state notification (%d)", ret);
+		return;
+	}
+
+#if defined(CONFIG_APP_SLEEPY)
+	// Poll fast until the observer acknowledged the notification
+	sleepy_expect(CONFIG_COAP_INIT_ACK_TIMEOUT_MS * 2);
+#endif
+}
+
+/**
+ * PUT request handler for the onoff resource
+ */
+static int on_off_object_state_put(struct coap_resource *resource, struct coap_packet *request,
+                  struct sockaddr *addr, socklen_t addr_len)
+{
+	const uint8_t *data;
+	uint16_t data_len;
+
+	// The payload is not terminated and its length is up to the peer, only look at
+	// the first byte
+	data = coap_packet_get_payload(request, &data_len);
+	if (data == NULL || data_len == 0) {
+		LOG_INF("Missing Payload");
+		return COAP_RESPONSE_CODE_BAD_REQUEST;
+	}
+
+	if (data[0] == '0') {
+		LOG_INF("Disabling LED");
+		light_set(false);
+	} else if (data[0] == '1') {
+		LOG_INF("Enabling LED");
+		light_set(true);
+	} else {
+		LOG_INF("Invalid Payload");
+		LOG_HEXDUMP_INF(data, MIN(data_len, 16), "Payload:");
+		return COAP_RESPONSE_CODE_BAD_REQUEST;
+	}
+
+    return COAP_RESPONSE_CODE_CHANGED;
+}
+
+HANDLER_PROFILE_WRAP(on_off_object_state_put)
+
+/**
+ * Add the state ressource as a CoAP ressource
+ */
+static const char * const on_off_object_state_path[] = { "42769", "0", "1", NULL};
+COAP_RESOURCE_DEFINE(on_off_object_state_resource, coap_server, {
+    .path = on_off_object_state_path,
+    .get = HANDLER_PROFILED(on_off_object_state_get),
+	.put = HANDLER_PROFILED(on_off_object_state_put),
+	.notify = on_off_object_state_notify,
+});
+
+HANDLER_PROFILE_DEFINE(state_notify);
+
+/**
+ * Work item used to notify observers outside of the publishing context
+ */
+static void state_notify_work_handler(struct k_work *work)
+{
+	struct handler_probe probe;
+
+	APP_TRACE("srv_notify", light_get_version(), 0);
+	HANDLER_PROFILE_BEGIN(&probe);
+	coap_resource_notify(&on_off_object_state_resource);
+	HANDLER_PROFILE_END(state_notify, &probe);
+}
+
+static K_WORK_DEFINE(state_notify_work, state_notify_work_handler);
+
+/**
+ * Listener used to trigger observer notifications on light changes
+ */
+static void light_event_handler(const struct zbus_channel *chan)
+{
+	k_work_submit(&state_notify_work);
+}
+
+ZBUS_LISTENER_DEFINE(light_listener, light_event_handler);
+ZBUS_CHAN_ADD_OBS(light_chan, light_listener, 2);
+
+/**
+ * PUT request handler for the on resource
+ */
+static int on_off_object_on_put(struct coap_resource *resource, struct coap_packet *request,
+                  struct sockaddr *addr, socklen_t addr_len)
+{
+	light_set(true);
+	return COAP_RESPONSE_CODE_CHANGED;
+}
+
+HANDLER_PROFILE_WRAP(on_off_object_on_put)
+
+/**
+ * Add the on ressource as a CoAP ressource
+ */
+static const char * const on_off_object_on_path[] = { "42769", "0", "2", NULL};
+COAP_RESOURCE_DEFINE(on_off_object_on_resource, coap_server, {
+    .path = on_off_object_on_path,
+    .put = HANDLER_PROFILED(on_off_object_on_put),
+});
+
+/**
+ * PUT request handler for the off resource
+ */
+static int on_off_object_off_put(struct coap_resource *resource, struct coap_packet *request,
+                  struct sockaddr *addr, socklen_t addr_len)
+{
+	light_set(false);
+	return COAP_RESPONSE_CODE_CHANGED;
+}
+
+HANDLER_PROFILE_WRAP(on_off_object_off_put)
+
+/**
+ * Add the off ressource as a CoAP ressource
+ */
+static const char * const on_off_object_off_path[] = { "42769", "0", "3", NULL};
+COAP_RESOURCE_DEFINE(on_off_object_off_resource, coap_server, {
+    .path = on_off_object_off_path,
+    .put = HANDLER_PROFILED(on_off_object_off_put),
+});
+
+/**
+ * PUT request handler for the switch ressource
+ */
+static int on_off_object_switch_put(struct coap_resource *resource, struct coap_packet *request,
+                  struct sockaddr *addr, socklen_t addr_len)
+{
+	light_toggle();
+	return COAP_RESPONSE_CODE_CHANGED;
+}
+
+HANDLER_PROFILE_WRAP(on_off_object_switch_put)
+
+/**
+ * Add the switch ressource as a CoAP ressource
+ */
+static const char * const on_off_object_switch_path[] = { "42769", "0", "4", NULL};
+COAP_RESOURCE_DEFINE(on_off_object_switch_resource, coap_server, {
+    .path = on_off_object_switch_path,
+    .put = HANDLER_PROFILED(on_off_object_switch_put),
+});
+
+/**
+ * Function used to parse a decimal number from a CoAP payload or option
+ */
+static int parse_uint(const uint8_t *data, uint16_t len, uint32_t max, uint32_t *value)
+{
+	uint32_t result = 0;
+
+	if (data == NULL || len == 0) {
+		return -EINVAL;
+	}
+
+	for (uint16_t i = 0; i < len; i++) {
+		if (data[i] < '0' || data[i] > '9') {
+			return -EINVAL;
+		}
+
+		result = result * 10 + (data[i] - '0');
+		if (result > max) {
+			return -ERANGE;
+		}
+	}
+
+	*value = result;
+
+	return 0;
+}
+
+/**
+ * Function used to build a response for the dimmer resource
+ */
+static int on_off_object_dimmer_build(struct coap_packet *response, uint8_t *buf, size_t buf_len,
+				      uint8_t type, const uint8_t *token, uint8_t tkl, uint16_t id)
+{
+	struct light_state state;
+	char payload[sizeof("100")];
+	int len;
+	int ret;
+
+	light_get_state(&state);
+	len = snprintk(payload, sizeof(payload), "%u", state.dimmer);
+
+	ret = coap_packet_init(response, buf, buf_len, COAP_VERSION_1, type, tkl, token,
+			       COAP_RESPONSE_CODE_CONTENT, id);
+	if (ret < 0) {
+		return ret;
+	}
+
+	ret = coap_append_option_int(response, COAP_OPTION_CONTENT_FORMAT,
+				     COAP_CONTENT_FORMAT_TEXT_PLAIN);
+	if (ret < 0) {
+		return ret;
+	}
+
+	ret = coap_packet_append_payload_marker(response);
+	if (ret < 0) {
+		return ret;
+	}
+
+	return coap_packet_append_payload(response, (uint8_t *)payload, len);
+}
+
+/**
+ * GET request handler for the dimmer resource
+ */
+static int on_off_object_dimmer_get(struct coap_resource *resource, struct coap_packet *request,
+                  struct sockaddr *addr, socklen_t addr_len)
+{
+    uint8_t data[CONFIG_COAP_SERVER_MESSAGE_SIZE];
+    struct coap_packet response;
+    uint8_t token[COAP_TOKEN_MAX_LEN];
+    uint8_t tkl, type;
+    int ret;
+
+    type = coap_header_get_type(request);
+    tkl = coap_header_get_token(request, token);
+    type = (type == COAP_TYPE_CON) ? COAP_TYPE_ACK : COAP_TYPE_NON_CON;
+
+    ret = on_off_object_dimmer_build(&response, data, sizeof(data), type, token, tkl,
+                                     coap_header_get_id(request));
+    if (ret < 0) {
+        LOG_ERR("Failed to build dimmer response (%d)", ret);
+        return ret;
+    }
+
+#if defined(CONFIG_APP_COAP_GROUP)
+    return coap_group_respond(resource, request, &response, addr, addr_len);
+#else
+    return coap_resource_send(resource, &response, addr, addr_len, NULL);
+#endif
+}
+
+HANDLER_PROFILE_WRAP(on_off_object_dimmer_get)
+
+/**
+ * PUT request handler for the dimmer resource
+ * The payload is the level in percent, the transition time in ms can be
+ * given with the query tt=<ms>
+ */
+static int on_off_object_dimmer_put(struct coap_resource *resource, struct coap_packet *request,
+                  struct sockaddr *addr, socklen_t addr_len)
+{
+	static const char tt_query[] = "tt=";
+	struct coap_option options[4];
+	const uint8_t *data;
+	uint16_t data_len;
+	uint32_t level;
+	uint32_t transition_ms = UINT32_MAX;
+	int count;
+
+	data = coap_packet_get_payload(request, &data_len);
+	if (parse_uint(data, data_len, LIGHT_DIMMER_MAX, &level) < 0) {
+		LOG_INF("Invalid dimmer payload");
+		return COAP_RESPONSE_CODE_BAD_REQUEST;
+	}
+
+	count = coap_find_options(request, COAP_OPTION_URI_QUERY, options, ARRAY_SIZE(options));
+	for (int i = 0; i < count; i++) {
+		if (options[i].len <= sizeof(tt_query) - 1 ||
+		    memcmp(options[i].value, tt_query, sizeof(tt_query) - 1) != 0) {
+			continue;
+		}
+
+		if (parse_uint(options[i].value + sizeof(tt_query) - 1,
+			       options[i].len - (sizeof(tt_query) - 1), UINT16_MAX * 100U,
+			       &transition_ms) < 0) {
+			LOG_INF("Invalid transition time");
+			return COAP_RESPONSE_CODE_BAD_REQUEST;
+		}
+	}
+
+	if (transition_ms == UINT32_MAX) {
+		light_set_dimmer(level);
+	} else {
+		light_move_to_level(level, transition_ms);
+	}
+
+	return COAP_RESPONSE_CODE_CHANGED;
+}
+
+HANDLER_PROFILE_WRAP(on_off_object_dimmer_put)
+
+/**
+ * Add the dimmer ressource as a CoAP ressource
+ */
+static const char * const on_off_object_dimmer_path[] = { "42769", "0", "5", NULL};
+COAP_RESOURCE_DEFINE(on_off_object_dimmer_resource, coap_server, {
+    .path = on_off_object_dimmer_path,
+    .get = HANDLER_PROFILED(on_off_object_dimmer_get),
+    .put = HANDLER_PROFILED(on_off_object_dimmer_put),
+});
+
+/**
+ * Function used to start the CoAP server
+ */
+int init_coap_server(void)
+{
+	return coap_service_start(&coap_server);
+}
@@ -0,0 +1,21 @@
+#ifndef __COAP_SERVER_H__
+#define __COAP_SERVER_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <zephyr/net/coap.h>
+
+/**
+ * Function used to build a response for the onoff resource
+ * request is the request to answer, NULL for an Observe notification
+ */
+int on_off_object_state_build(struct coap_packet *response, uint8_t *buf, size_t buf_len,
+			      uint8_t type, const uint8_t *token, uint8_t tkl, uint16_t id,
+			      bool observe, const struct coap_packet *request);
+
+/**
+ * Function used to start the CoAP server
+ */
+int init_coap_server(void);
+
+#endif
@@ -0,0 +1,188 @@
+/*
+ * Connectivity manager
+ * Combines the Thread role with the IPv6 address events of the interface
+ * into a single attach state. The node only counts as attached once it has a
+ * role and a routable address, before that requests can not reach the bridge.
+ */
+
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(connectivity, LOG_LEVEL_DBG);
+
+#include <zephyr/kernel.h>
+#include <zephyr/net/net_if.h>
+#include <zephyr/net/net_mgmt.h>
+#include <zephyr/net/net_event.h>
+
+#if defined(CONFIG_NET_L2_OPENTHREAD)
+#include <zephyr/net/openthread.h>
+#include <openthread/thread.h>
+#include <openthread/dataset.h>
+#endif
+
+#include "connectivity.h"
+#include "events.h"
+
+/* Bounds the time a state change waits for a consumer reading the channel */
+#define CONN_PUB_TIMEOUT K_MSEC(10)
+
+#define CONN_IPV6_EVENTS (NET_EVENT_IPV6_ADDR_ADD | NET_EVENT_IPV6_ADDR_DEL)
+
+static struct net_mgmt_event_callback ipv6_cb;
+
+/* Last published state, the first evaluation is always published */
+static enum conn_state state = CONN_STATE_DETACHED;
+static bool published;
+static atomic_t attached;
+
+#if defined(CONFIG_NET_L2_OPENTHREAD)
+static struct openthread_state_changed_cb ot_state_cb;
+
+/* Snapshot taken in the OpenThread callback */
+static atomic_t ot_attached;
+static atomic_t ot_commissioned;
+#endif
+
+/**
+ * Function used to check for a routable address on any interface
+ */
+static bool has_global_addr(void)
+{
+	struct net_if *iface = NULL;
+
+	return net_if_ipv6_get_global_addr(NET_ADDR_PREFERRED, &iface) != NULL;
+}
+
+/**
+ * Function used to derive the attach state from the collected inputs
+ */
+static enum conn_state current_state(void)
+{
+#if defined(CONFIG_NET_L2_OPENTHREAD)
+	if (!atomic_get(&ot_commissioned)) {
+		return CONN_STATE_UNPROVISIONED;
+	}
+
+	if (!atomic_get(&ot_attached)) {
+		return CONN_STATE_DETACHED;
+	}
+#endif
+
+	return has_global_addr() ? CONN_STATE_ATTACHED : CONN_STATE_DETACHED;
+}
+
+/**
+ * Work handler publishing the attach state if it changed
+ */
+static void update_handler(struct k_work *work)
+{
+	struct conn_event event;
+	int ret;
+
+	event.state = current_state();
+	if (published && event.state == state) {
+		return;
+	}
+
+	LOG_INF("Connectivity: %s -> %s", conn_state_str(state), conn_state_str(event.state));
+
+	state = event.state;
+	published = true;
+	atomic_set(&attached, state == CONN_STATE_ATTACHED);
+
+	ret = zbus_chan_pub(&conn_chan, &event, CONN_PUB_TIMEOUT);
+	if (ret < 0) {
+		LOG_WRN("Cannot publish connectivity state (%d)", ret);
+	}
+}
+
+static K_WORK_DEFINE(update_work, update_handler);
+
+/**
+ * Handler for the IPv6 address events
+ */
+static void ipv6_event_handler(struct net_mgmt_event_callback *cb, uint32_t mgmt_event,
+			       struct net_if *iface)
+{
+	k_work_submit(&update_work);
+}
+
+#if defined(CONFIG_NET_L2_OPENTHREAD)
+/**
+ * Handler for the OpenThread state changes
+ * Runs in the OpenThread context, the role is sampled and evaluated later
+ */
+static void ot_state_changed(otChangedFlags flags, struct openthread_context *ot_context,
+			     void *user_data)
+{
+	otDeviceRole role;
+
+	if (!(flags & (OT_CHANGED_THREAD_ROLE | OT_CHANGED_ACTIVE_DATASET))) {
+		return;
+	}
+
+	role = otThreadGetDeviceRole(ot_context->instance);
+
+	LOG_DBG("Thread role: %s", otThreadDeviceRoleToString(role));
+
+	atomic_set(&ot_attached, role >= OT_DEVICE_ROLE_CHILD);
+	atomic_set(&ot_commissioned, otDatasetIsCommissioned(ot_context->instance));
+
+	k_work_submit(&update_work);
+}
+#endif
+
+/**
+ * Function used to start tracking the attach state
+ */
+int init_connectivity(void)
+{
+#if defined(CONFIG_NET_L2_OPENTHREAD)
+	struct openthread_context *ot_context = openthread_get_default_context();
+	int ret;
+
+	openthread_api_mutex_lock(ot_context);
+	atomic_set(&ot_attached,
+		   otThreadGetDeviceRole(ot_context->instance) >= OT_DEVICE_ROLE_CHILD);
+	atomic_set(&ot_commissioned, otDatasetIsCommissioned(ot_context->instance));
+	openthread_api_mutex_unlock(ot_context);
+
+	ot_state_cb.state_changed_cb = ot_state_changed;
+	ret = openthread_state_changed_cb_register(ot_context, &ot_state_cb);
+	if (ret < 0) {
+		LOG_ERR("Cannot register OpenThread state callback (%d)", ret);
+		return ret;
+	}
+#endif
+
+	net_mgmt_init_event_callback(&ipv6_cb, ipv6_event_handler, CONN_IPV6_EVENTS);
+	net_mgmt_add_event_callback(&ipv6_cb);
+
+	k_work_submit(&update_work);
+
+	return 0;
+}
+
+/**
+ * Function used to check whether requests can be sent
+ */
+bool connectivity_is_attached(void)
+{
+	return atomic_get(&attached);
+}
+
+/**
+ * Helper function to turn an attach state into a string
+ */
+const char *conn_state_str(enum conn_state state)
+{
+	switch (state) {
+	case CONN_STATE_UNPROVISIONED:
+		return "unprovisioned";
+	case CONN_STATE_DETACHED:
+		return "detached";
+	case CONN_STATE_ATTACHED:
+		return "attached";
+	default:
+		return "unknown";
+	}
+}
@@ -0,0 +1,40 @@
+#ifndef __CONNECTIVITY_H__
+#define __CONNECTIVITY_H__
+
+#include <stdbool.h>
+
+/**
+ * Attach state of the node
+ */
+enum conn_state {
+	/* No network credentials, the joiner is running */
+	CONN_STATE_UNPROVISIONED,
+	/* Credentials available but no role or no routable address */
+	CONN_STATE_DETACHED,
+	/* Attached with a routable address, the bridge can be reached */
+	CONN_STATE_ATTACHED,
+};
+
+/**
+ * Change of the attach state as published on the connectivity channel
+ */
+struct conn_event {
+	enum conn_state state;
+};
+
+/**
+ * Function used to start tracking the attach state
+ */
+int init_connectivity(void);
+
+/**
+ * Function used to check whether requests can be sent
+ */
+bool connectivity_is_attached(void);
+
+/**
+ * Helper function to turn an attach state into a string
+ */
+const char *conn_state_str(enum conn_state state);
+
+#endif
@@ -0,0 +1,301 @@
+/*
+ * DNS-SD discovery of the bridge
+ * The bridges register a CoAP service with a bridge specific subtype at the
+ * SRP server of the border router, the node browses for it through the
+ * DNS-SD proxy. The results are cached for their TTL and ordered by SRV
+ * priority, a request only copies the cached address. A bridge that does not
+ * answer is skipped until the next resolution, once all of them failed they
+ * are resolved again.
+ */
+
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(discovery, LOG_LEVEL_DBG);
+
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/net/openthread.h>
+#include <openthread/dns_client.h>
+
+#include "connectivity.h"
+#include "discovery.h"
+#include "events.h"
+#include "journal.h"
+
+/**
+ * Cached bridge
+ */
+struct bridge {
+	struct sockaddr_in6 addr;
+	uint16_t priority;
+	/* Uptime at which the resolution expires */
+	int64_t expiry_ms;
+	/* Set if the bridge did not answer */
+	bool failed;
+};
+
+/* Bridges ordered by priority, the first one not failed is used */
+static struct bridge bridges[CONFIG_APP_BRIDGE_DISCOVERY_MAX_BRIDGES];
+static size_t num_bridges;
+static K_MUTEX_DEFINE(bridges_mutex);
+
+/* Set while a browse is running */
+static atomic_t browsing;
+
+static void browse_handler(struct k_work *work);
+static K_WORK_DELAYABLE_DEFINE(browse_work, browse_handler);
+
+/**
+ * Function used to get the name of the browsed service without its subtype
+ * Instances are resolved with the service they are registered as, e.g.
+ * _coap._udp.default.service.arpa. for _bridge._sub._coap._udp.default.service.arpa.
+ */
+static const char *base_service(void)
+{
+	static const char subtype_sep[] = "._sub.";
+	const char *sub = strstr(CONFIG_APP_BRIDGE_DISCOVERY_SERVICE, subtype_sep);
+
+	return sub != NULL ? sub + sizeof(subtype_sep) - 1 : CONFIG_APP_BRIDGE_DISCOVERY_SERVICE;
+}
+
+/**
+ * Function used to start a new resolution unless one is running
+ */
+static void resolve_again(k_timeout_t delay)
+{
+	if (!atomic_get(&browsing)) {
+		k_work_schedule(&browse_work, delay);
+	}
+}
+
+/**
+ * Function used to add a resolved bridge to the cache
+ * An already cached bridge is updated
+ * Must be called with bridges_mutex held
+ */
+static void add_bridge(const otDnsServiceInfo *info)
+{
+	struct bridge bridge = {
+		.addr = {
+			.sin6_family = AF_INET6,
+			.sin6_port = htons(info->mPort),
+		},
+		.priority = info->mPriority,
+		.expiry_ms = k_uptime_get() +
+			     (int64_t)MIN(info->mTtl, info->mHostAddressTtl) * MSEC_PER_SEC,
+	};
+	size_t pos;
+
+	memcpy(&bridge.addr.sin6_addr, info->mHostAddress.mFields.m8,
+	       sizeof(bridge.addr.sin6_addr));
+
+	if (net_ipv6_is_addr_unspecified(&bridge.addr.sin6_addr)) {
+		return;
+	}
+
+	// A bridge listed twice, e.g. by a repeated resolve, is kept once
+	for (size_t i = 0; i < num_bridges; i++) {
+		if (bridges[i].addr.sin6_port == bridge.addr.sin6_port &&
+		    net_ipv6_addr_cmp(&bridges[i].addr.sin6_addr, &bridge.addr.sin6_addr)) {
+			bridge.failed = bridges[i].failed;
+			num_bridges--;
+			memmove(&bridges[i], &bridges[i + 1], (num_bridges - i) * sizeof(bridges[0]));
+			break;
+		}
+	}
+
+	// Insertion sort by priority, lower values are preferred
+	for (pos = 0; pos < num_bridges && bridges[pos].priority <= bridge.priority; pos++) {
+	}
+
+	if (pos == ARRAY_SIZE(bridges)) {
+		return;
+	}
+
+	num_bridges = MIN(num_bridges + 1, ARRAY_SIZE(bridges));
+	memmove(&bridges[pos + 1], &bridges[pos], (num_bridges - pos - 1) * sizeof(bridges[0]));
+	bridges[pos] = bridge;
+}
+
+/**
+ * Callback for resolving a service instance the browse response had no
+ * address for
+ */
+static void service_cb(otError error, const otDnsServiceResponse *response, void *context)
+{
+	otDnsServiceInfo info = { 0 };
+
+	if (error != OT_ERROR_NONE ||
+	    otDnsServiceResponseGetServiceInfo(response, &info) != OT_ERROR_NONE) {
+		LOG_WRN("Cannot resolve bridge service (%d)", error);
+		return;
+	}
+
+	k_mutex_lock(&bridges_mutex, K_FOREVER);
+	add_bridge(&info);
+	k_mutex_unlock(&bridges_mutex);
+
+	journal_replay();
+}
+
+/**
+ * Callback for the browse of the bridge service
+ * Runs in the OpenThread context
+ */
+static void browse_cb(otError error, const otDnsBrowseResponse *response, void *context)
+{
+	char label[OT_DNS_MAX_LABEL_SIZE];
+	otDnsServiceInfo info;
+	size_t found = 0;
+
+	atomic_set(&browsing, false);
+
+	if (error != OT_ERROR_NONE) {
+		LOG_WRN("Bridge browse failed (%d)", error);
+		resolve_again(K_SECONDS(CONFIG_APP_BRIDGE_DISCOVERY_RETRY_SEC));
+		return;
+	}
+
+	k_mutex_lock(&bridges_mutex, K_FOREVER);
+	num_bridges = 0;
+
+	for (uint16_t i = 0; otDnsBrowseResponseGetServiceInstance(response, i, label,
+								    sizeof(label)) == OT_ERROR_NONE; i++) {
+		memset(&info, 0, sizeof(info));
+
+		// The proxy usually adds SRV and AAAA records, resolve the rest
+		if (otDnsBrowseResponseGetServiceInfo(response, label, &info) == OT_ERROR_NONE &&
+		    !otIp6IsAddressUnspecified(&info.mHostAddress)) {
+			add_bridge(&info);
+		} else {
+			(void)otDnsClientResolveService(openthread_get_default_instance(), label,
+							base_service(), service_cb, NULL, NULL);
+		}
+
+		found++;
+	}
+
+	k_mutex_unlock(&bridges_mutex);
+
+	LOG_INF("Found %zu bridges", found);
+
+	if (found == 0) {
+		resolve_again(K_SECONDS(CONFIG_APP_BRIDGE_DISCOVERY_RETRY_SEC));
+		return;
+	}
+
+	journal_replay();
+}
+
+/**
+ * Work handler starting a browse for the bridge service
+ */
+static void browse_handler(struct k_work *work)
+{
+	struct openthread_context *ot_context = openthread_get_default_context();
+	otError error;
+
+	if (!connectivity_is_attached()) {
+		// Started again by the attach event
+		return;
+	}
+
+	atomic_set(&browsing, true);
+
+	openthread_api_mutex_lock(ot_context);
+	error = otDnsClientBrowse(ot_context->instance, CONFIG_APP_BRIDGE_DISCOVERY_SERVICE,
+				  browse_cb, NULL, NULL);
+	openthread_api_mutex_unlock(ot_context);
+
+	if (error != OT_ERROR_NONE) {
+		LOG_WRN("Cannot browse for bridges (%d)", error);
+		atomic_set(&browsing, false);
+		k_work_schedule(&browse_work, K_SECONDS(CONFIG_APP_BRIDGE_DISCOVERY_RETRY_SEC));
+	}
+}
+
+/**
+ * Listener used to resolve the bridges once the node attached
+ */
+static void conn_event_handler(const struct zbus_channel *chan)
+{
+	const struct conn_event *event = zbus_chan_const_msg(chan);
+
+	if (event->state == CONN_STATE_ATTACHED) {
+		resolve_again(K_NO_WAIT);
+	}
+}
+
+ZBUS_LISTENER_DEFINE(discovery_conn_listener, conn_event_handler);
+ZBUS_CHAN_ADD_OBS(conn_chan, discovery_conn_listener, 2);
+
+/**
+ * Function used to get the address of the bridge to use
+ */
+int discovery_get_bridge(struct sockaddr_in6 *addr)
+{
+	int64_t now = k_uptime_get();
+	int ret = -EAGAIN;
+
+	k_mutex_lock(&bridges_mutex, K_FOREVER);
+
+	for (size_t i = 0; i < num_bridges; i++) {
+		if (bridges[i].failed) {
+			continue;
+		}
+
+		// An expired entry is still used while it is resolved again
+		if (bridges[i].expiry_ms <= now) {
+			resolve_again(K_NO_WAIT);
+		}
+
+		*addr = bridges[i].addr;
+		ret = 0;
+		break;
+	}
+
+	k_mutex_unlock(&bridges_mutex);
+
+	if (ret < 0) {
+		resolve_again(K_NO_WAIT);
+	}
+
+	return ret;
+}
+
+/**
+ * Function used to report a bridge that did not answer
+ */
+void discovery_report_failure(const struct sockaddr_in6 *addr)
+{
+	bool available = false;
+
+	k_mutex_lock(&bridges_mutex, K_FOREVER);
+
+	for (size_t i = 0; i < num_bridges; i++) {
+		if (net_ipv6_addr_cmp(&bridges[i].addr.sin6_addr, &addr->sin6_addr) &&
+		    bridges[i].addr.sin6_port == addr->sin6_port) {
+			bridges[i].failed = true;
+		}
+
+		available |= !bridges[i].failed;
+	}
+
+	k_mutex_unlock(&bridges_mutex);
+
+	if (!available) {
+		LOG_WRN("No bridge answered, resolving again");
+		resolve_again(K_NO_WAIT);
+	}
+}
+
+/**
+ * Function used to start discovering the bridges
+ */
+int init_discovery(void)
+{
+	if (connectivity_is_attached()) {
+		resolve_again(K_NO_WAIT);
+	}
+
+	return 0;
+}
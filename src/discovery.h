@@ -0,0 +1,24 @@
+#ifndef __DISCOVERY_H__
+#define __DISCOVERY_H__
+
+#include <zephyr/net/net_ip.h>
+
+/**
+ * Function used to start discovering the bridges
+ * Browsing starts once the node is attached
+ */
+int init_discovery(void);
+
+/**
+ * Function used to get the address of the bridge to use
+ * Returns -EAGAIN while no bridge is known, a resolution is running then
+ */
+int discovery_get_bridge(struct sockaddr_in6 *addr);
+
+/**
+ * Function used to report a bridge that did not answer
+ * The next advertised bridge is used, once all failed they are resolved again
+ */
+void discovery_report_failure(const struct sockaddr_in6 *addr);
+
+#endif
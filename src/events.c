@@ -0,0 +1,27 @@
+#include <zephyr/zbus/zbus.h>
+
+#include "events.h"
+
+ZBUS_CHAN_DEFINE(light_chan,
+		 struct light_state,
+		 NULL,
+		 NULL,
+		 ZBUS_OBSERVERS_EMPTY,
+		 ZBUS_MSG_INIT(.dimmer = LIGHT_DIMMER_MAX)
+);
+
+ZBUS_CHAN_DEFINE(button_chan,
+		 struct button_event,
+		 NULL,
+		 NULL,
+		 ZBUS_OBSERVERS_EMPTY,
+		 ZBUS_MSG_INIT(0)
+);
+
+ZBUS_CHAN_DEFINE(conn_chan,
+		 struct conn_event,
+		 NULL,
+		 NULL,
+		 ZBUS_OBSERVERS_EMPTY,
+		 ZBUS_MSG_INIT(.state = CONN_STATE_DETACHED)
+);
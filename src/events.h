@@ -0,0 +1,26 @@
+#ifndef __EVENTS_H__
+#define __EVENTS_H__
+
+#include <zephyr/zbus/zbus.h>
+
+#include "button.h"
+#include "connectivity.h"
+#include "light.h"
+
+/*
+ * Channels connecting the producers of state changes with their consumers
+ * Observers are attached in their own modules with ZBUS_CHAN_ADD_OBS.
+ * Listeners run in the context of the publisher and must not block, slow
+ * consumers such as the network use subscribers with their own thread.
+ */
+
+/* Every change of the light, carries struct light_state */
+ZBUS_CHAN_DECLARE(light_chan);
+
+/* Debounced button events, carries struct button_event */
+ZBUS_CHAN_DECLARE(button_chan);
+
+/* Changes of the attach state, carries struct conn_event */
+ZBUS_CHAN_DECLARE(conn_chan);
+
+#endif
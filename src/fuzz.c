@@ -0,0 +1,71 @@
+/*
+ * libFuzzer harness of the CoAP server request path
+ * Only built on native_sim with CONFIG_ARCH_POSIX_LIBFUZZER. libFuzzer
+ * hands every input to the arch layer, which raises the fuzz interrupt.
+ * The input is then sent as datagram to the CoAP server over the loopback
+ * interface, so it is received, parsed and dispatched by the server itself
+ * and the handlers run on the server thread with its real stack and locks.
+ * The responses come back to the harness and are discarded.
+ */
+
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(fuzz, LOG_LEVEL_WRN);
+
+#include <errno.h>
+#include <zephyr/kernel.h>
+#include <zephyr/irq.h>
+#include <zephyr/net/socket.h>
+
+#include "coap_client.h"
+
+// Sending takes less stack than the handlers of the server thread
+#define FUZZ_STACK_SIZE CONFIG_COAP_SERVER_STACK_SIZE
+#define FUZZ_PRIORITY 7
+
+// Input of the current case, set by the arch layer before the fuzz interrupt
+extern const uint8_t *posix_fuzz_buf;
+extern size_t posix_fuzz_sz;
+
+static K_SEM_DEFINE(fuzz_sem, 0, 1);
+
+static void fuzz_isr(const void *arg)
+{
+	ARG_UNUSED(arg);
+
+	k_sem_give(&fuzz_sem);
+}
+
+static void fuzz_thread(void *p1, void *p2, void *p3)
+{
+	static uint8_t response[CONFIG_COAP_SERVER_MESSAGE_SIZE];
+	struct sockaddr_in6 server = {
+		.sin6_family = AF_INET6,
+		.sin6_port = htons(COAP_PORT),
+		.sin6_addr = IN6ADDR_LOOPBACK_INIT,
+	};
+	int sock;
+
+	sock = socket(AF_INET6, SOCK_DGRAM, IPPROTO_UDP);
+	if (sock < 0) {
+		LOG_ERR("Failed to create UDP socket %d", errno);
+		return;
+	}
+
+	IRQ_CONNECT(CONFIG_ARCH_POSIX_FUZZ_IRQ, 0, fuzz_isr, NULL, 0);
+	irq_enable(CONFIG_ARCH_POSIX_FUZZ_IRQ);
+
+	while (true) {
+		k_sem_take(&fuzz_sem, K_FOREVER);
+
+		// Responses to the previous inputs would fill the receive queue
+		while (recv(sock, response, sizeof(response), MSG_DONTWAIT) > 0) {
+		}
+
+		// The server receives at most a message of this size
+		(void)sendto(sock, posix_fuzz_buf,
+			     MIN(posix_fuzz_sz, CONFIG_COAP_SERVER_MESSAGE_SIZE), 0,
+			     (struct sockaddr *)&server, sizeof(server));
+	}
+}
+
+K_THREAD_DEFINE(fuzz, FUZZ_STACK_SIZE, fuzz_thread, NULL, NULL, NULL, FUZZ_PRIORITY, 0, 0);
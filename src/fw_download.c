@@ -0,0 +1,621 @@
+/*
+ * Firmware download with CoAP Block2 straight into the secondary image slot
+ * Every block is handed to stream_flash, which only buffers up to one write
+ * buffer before it goes to flash. The block size follows the link quality:
+ * it is halved whenever a block has to be repeated and doubled again after
+ * a run of blocks that arrived on the first attempt. The number of flushed
+ * bytes is stored in settings, so a download continues where it stopped
+ * after a reboot.
+ */
+
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(fw_download, LOG_LEVEL_DBG);
+
+#include <stdlib.h>
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/net/socket.h>
+#include <zephyr/net/coap.h>
+#include <zephyr/settings/settings.h>
+#include <zephyr/storage/flash_map.h>
+#include <zephyr/storage/stream_flash.h>
+#include <zephyr/sys/byteorder.h>
+#if defined(CONFIG_MCUBOOT_IMG_MANAGER)
+#include <zephyr/dfu/mcuboot.h>
+#endif
+
+#include "fw_download.h"
+
+#define FW_SLOT_DEVICE FIXED_PARTITION_DEVICE(slot1_partition)
+#define FW_SLOT_OFFSET FIXED_PARTITION_OFFSET(slot1_partition)
+#define FW_SLOT_SIZE FIXED_PARTITION_SIZE(slot1_partition)
+
+#define FW_SETTINGS_ROOT "fw"
+#define FW_SETTINGS_URI FW_SETTINGS_ROOT "/uri"
+#define FW_SETTINGS_ETAG FW_SETTINGS_ROOT "/etag"
+#define FW_SETTINGS_PROGRESS FW_SETTINGS_ROOT "/progress"
+
+#define FW_URI_MAX_LEN 128
+#define FW_PATH_MAX_SEGMENTS 8
+#define FW_ETAG_MAX_LEN 8
+#define FW_MSG_OVERHEAD 64
+
+#define MCUBOOT_IMAGE_MAGIC 0x96f3b83d
+
+#define FW_DOWNLOAD_STACK_SIZE 2048
+#define FW_DOWNLOAD_PRIORITY K_LOWEST_APPLICATION_THREAD_PRIO
+
+BUILD_ASSERT(IS_POWER_OF_TWO(CONFIG_APP_FW_BLOCK_SIZE_MIN) &&
+	     IS_POWER_OF_TWO(CONFIG_APP_FW_BLOCK_SIZE_MAX),
+	     "Block sizes must be powers of two");
+BUILD_ASSERT(CONFIG_APP_FW_BLOCK_SIZE_MIN >= 16 && CONFIG_APP_FW_BLOCK_SIZE_MAX <= 1024 &&
+	     CONFIG_APP_FW_BLOCK_SIZE_MIN <= CONFIG_APP_FW_BLOCK_SIZE_MAX,
+	     "Block sizes must be between 16 and 1024 bytes");
+BUILD_ASSERT(CONFIG_APP_FW_WRITE_BUF_SIZE % CONFIG_APP_FW_BLOCK_SIZE_MAX == 0,
+	     "The write buffer must hold a whole number of blocks so resumed downloads are aligned");
+
+/* Block size exponent of the Block2 option, the size is 16 << szx */
+#define SZX(size) (find_lsb_set(size) - 5)
+#define SZX_MIN SZX(CONFIG_APP_FW_BLOCK_SIZE_MIN)
+#define SZX_MAX SZX(CONFIG_APP_FW_BLOCK_SIZE_MAX)
+#define BLOCK_SIZE(szx) (16U << (szx))
+
+/**
+ * State of the current download
+ */
+struct download {
+	char uri[FW_URI_MAX_LEN];
+	struct sockaddr_in6 addr;
+	char path_buf[FW_URI_MAX_LEN];
+	const char *path[FW_PATH_MAX_SEGMENTS + 1];
+	uint8_t etag[FW_ETAG_MAX_LEN];
+	uint8_t etag_len;
+	uint8_t szx;
+	/* Blocks in a row that arrived on the first attempt */
+	uint8_t clean_blocks;
+	size_t saved_offset;
+	atomic_t busy;
+	atomic_t cancel;
+	int sock;
+};
+
+static struct download dl = {
+	.sock = -1,
+};
+
+static struct stream_flash_ctx stream;
+static uint8_t write_buf[CONFIG_APP_FW_WRITE_BUF_SIZE];
+static uint8_t request_buf[FW_MSG_OVERHEAD + FW_URI_MAX_LEN];
+static uint8_t reply_buf[FW_MSG_OVERHEAD + CONFIG_APP_FW_BLOCK_SIZE_MAX];
+
+static fw_download_cb_t download_cb;
+static K_SEM_DEFINE(start_sem, 0, 1);
+
+/**
+ * Function used to split a coap://[address]:port/path URI
+ */
+static int parse_uri(struct download *d)
+{
+	const char *scheme = "coap://";
+	char host[NET_IPV6_ADDR_LEN];
+	const char *p = d->uri;
+	const char *end;
+	uint16_t port = 5683;
+	char *saveptr;
+	char *segment;
+	size_t i = 0;
+
+	if (strncmp(p, scheme, strlen(scheme)) != 0) {
+		return -EPROTONOSUPPORT;
+	}
+	p += strlen(scheme);
+
+	if (*p != '[') {
+		return -EINVAL;
+	}
+	end = strchr(p, ']');
+	if (!end || end - p - 1 >= sizeof(host)) {
+		return -EINVAL;
+	}
+	memcpy(host, p + 1, end - p - 1);
+	host[end - p - 1] = '\0';
+	p = end + 1;
+
+	if (*p == ':') {
+		port = strtoul(p + 1, (char **)&p, 10);
+	}
+
+	if (*p != '/') {
+		return -EINVAL;
+	}
+
+	memset(&d->addr, 0, sizeof(d->addr));
+	d->addr.sin6_family = AF_INET6;
+	d->addr.sin6_port = htons(port);
+	if (inet_pton(AF_INET6, host, &d->addr.sin6_addr) != 1) {
+		return -EINVAL;
+	}
+
+	strncpy(d->path_buf, p + 1, sizeof(d->path_buf) - 1);
+	for (segment = strtok_r(d->path_buf, "/", &saveptr); segment;
+	     segment = strtok_r(NULL, "/", &saveptr)) {
+		if (i == FW_PATH_MAX_SEGMENTS) {
+			return -EINVAL;
+		}
+		d->path[i++] = segment;
+	}
+	d->path[i] = NULL;
+
+	return 0;
+}
+
+/**
+ * Function used to build and send the GET request for the block at offset
+ */
+static int request_block(size_t offset, uint8_t *token)
+{
+	struct coap_packet request;
+	const char * const *p;
+	uint32_t num = offset / BLOCK_SIZE(dl.szx);
+	int r;
+
+	r = coap_packet_init(&request, request_buf, sizeof(request_buf),
+			     COAP_VERSION_1, COAP_TYPE_CON,
+			     COAP_TOKEN_MAX_LEN, token,
+			     COAP_METHOD_GET, coap_next_id());
+	if (r < 0) {
+		return r;
+	}
+
+	for (p = dl.path; *p; p++) {
+		r = coap_packet_append_option(&request, COAP_OPTION_URI_PATH, *p, strlen(*p));
+		if (r < 0) {
+			return r;
+		}
+	}
+
+	r = coap_append_option_int(&request, COAP_OPTION_BLOCK2, (num << 4) | dl.szx);
+	if (r < 0) {
+		return r;
+	}
+
+	r = send(dl.sock, request.data, request.offset, 0);
+
+	return r < 0 ? -errno : 0;
+}
+
+/**
+ * Function used to wait for the reply matching the token of the request
+ */
+static int receive_reply(struct coap_packet *reply, const uint8_t *token)
+{
+	struct pollfd fds = {
+		.fd = dl.sock,
+		.events = POLLIN,
+	};
+	int64_t deadline = k_uptime_get() + CONFIG_APP_FW_BLOCK_TIMEOUT_MS;
+	uint8_t reply_token[COAP_TOKEN_MAX_LEN];
+	int64_t remaining;
+	int rcvd;
+
+	while ((remaining = deadline - k_uptime_get()) > 0) {
+		if (poll(&fds, 1, remaining) <= 0) {
+			break;
+		}
+
+		rcvd = recv(dl.sock, reply_buf, sizeof(reply_buf), MSG_DONTWAIT);
+		if (rcvd <= 0) {
+			continue;
+		}
+
+		if (coap_packet_parse(reply, reply_buf, rcvd, NULL, 0) < 0) {
+			continue;
+		}
+
+		// Replies to earlier attempts of the same block are stale
+		if (coap_header_get_token(reply, reply_token) == COAP_TOKEN_MAX_LEN &&
+		    memcmp(reply_token, token, COAP_TOKEN_MAX_LEN) == 0) {
+			return 0;
+		}
+	}
+
+	return -ETIMEDOUT;
+}
+
+/**
+ * Function used to check the ETag of a reply against the image being downloaded
+ * Returns -ESTALE if the image on the server changed since the download began
+ */
+static int check_etag(const struct coap_packet *reply, size_t offset)
+{
+	struct coap_option option;
+
+	if (coap_find_options(reply, COAP_OPTION_ETAG, &option, 1) != 1) {
+		return 0;
+	}
+
+	if (offset == 0 || dl.etag_len == 0) {
+		dl.etag_len = MIN(option.len, sizeof(dl.etag));
+		memcpy(dl.etag, option.value, dl.etag_len);
+		(void)settings_save_one(FW_SETTINGS_ETAG, dl.etag, dl.etag_len);
+		return 0;
+	}
+
+	if (option.len != dl.etag_len || memcmp(option.value, dl.etag, dl.etag_len) != 0) {
+		return -ESTALE;
+	}
+
+	return 0;
+}
+
+/**
+ * Function used to fetch the block at offset
+ * Shrinks the block size on every repeated attempt
+ */
+static int fetch_block(size_t offset, const uint8_t **payload, uint16_t *len, bool *more)
+{
+	uint8_t token[COAP_TOKEN_MAX_LEN];
+	struct coap_packet reply;
+	int attempt;
+	int block2;
+	int ret;
+
+	for (attempt = 0; attempt <= CONFIG_APP_FW_BLOCK_RETRIES; attempt++) {
+		if (atomic_get(&dl.cancel)) {
+			return -ECANCELED;
+		}
+
+		if (attempt > 0) {
+			dl.clean_blocks = 0;
+			if (dl.szx > SZX_MIN) {
+				dl.szx--;
+				LOG_DBG("Block lost, shrinking blocks to %u bytes", BLOCK_SIZE(dl.szx));
+			}
+		}
+
+		memcpy(token, coap_next_token(), sizeof(token));
+		ret = request_block(offset, token);
+		if (ret < 0) {
+			LOG_WRN("Cannot request block at %zu (%d)", offset, ret);
+			continue;
+		}
+
+		ret = receive_reply(&reply, token);
+		if (ret < 0) {
+			continue;
+		}
+
+		if (coap_header_get_code(&reply) != COAP_RESPONSE_CODE_CONTENT) {
+			LOG_ERR("Server answered with code 0x%02x", coap_header_get_code(&reply));
+			return -ENOENT;
+		}
+
+		ret = check_etag(&reply, offset);
+		if (ret < 0) {
+			return ret;
+		}
+
+		*payload = coap_packet_get_payload(&reply, len);
+
+		block2 = coap_get_option_int(&reply, COAP_OPTION_BLOCK2);
+		if (block2 < 0) {
+			// The whole image fit into a single response
+			*more = false;
+			return offset == 0 ? 0 : -EBADMSG;
+		}
+
+		// The server may answer with a smaller block size than requested
+		if ((block2 & 0x07) < dl.szx) {
+			dl.szx = block2 & 0x07;
+		}
+		if (((size_t)(block2 >> 4) << (dl.szx + 4)) != offset) {
+			LOG_WRN("Unexpected block %d", block2 >> 4);
+			continue;
+		}
+
+		*more = block2 & 0x08;
+		if (attempt == 0 && dl.clean_blocks < UINT8_MAX) {
+			dl.clean_blocks++;
+		}
+
+		return 0;
+	}
+
+	return -ETIMEDOUT;
+}
+
+/**
+ * Function used to double the block size after a run of clean blocks
+ * Blocks must stay aligned, so it only grows on a matching offset
+ */
+static void grow_block_size(size_t offset)
+{
+	if (dl.szx >= SZX_MAX || dl.clean_blocks < CONFIG_APP_FW_BLOCK_GROW_AFTER ||
+	    offset % BLOCK_SIZE(dl.szx + 1) != 0) {
+		return;
+	}
+
+	dl.szx++;
+	dl.clean_blocks = 0;
+	LOG_DBG("Link is good, growing blocks to %u bytes", BLOCK_SIZE(dl.szx));
+}
+
+/**
+ * Function used to forget the stored progress of a download
+ */
+static void clear_progress(void)
+{
+	(void)stream_flash_progress_clear(&stream, FW_SETTINGS_PROGRESS);
+	(void)settings_delete(FW_SETTINGS_URI);
+	(void)settings_delete(FW_SETTINGS_ETAG);
+}
+
+/**
+ * Function used to restart the download of the image from its beginning
+ */
+static int restart_stream(void)
+{
+	(void)stream_flash_progress_clear(&stream, FW_SETTINGS_PROGRESS);
+	dl.etag_len = 0;
+	dl.saved_offset = 0;
+
+	return stream_flash_init(&stream, FW_SLOT_DEVICE, write_buf, sizeof(write_buf),
+				 FW_SLOT_OFFSET, FW_SLOT_SIZE, NULL);
+}
+
+/**
+ * Function used to download the image
+ */
+static int download(void)
+{
+	// Blocks still sitting in the write buffer were received already
+	size_t offset = stream_flash_bytes_written(&stream) + stream.buf_bytes;
+	const uint8_t *payload;
+	bool more = true;
+	uint16_t len;
+	int ret;
+
+	// Start with the largest block size the offset is aligned to
+	dl.szx = SZX_MAX;
+	while (dl.szx > SZX_MIN && offset % BLOCK_SIZE(dl.szx) != 0) {
+		dl.szx--;
+	}
+	dl.clean_blocks = 0;
+	dl.saved_offset = offset;
+
+	dl.sock = socket(AF_INET6, SOCK_DGRAM, IPPROTO_UDP);
+	if (dl.sock < 0) {
+		return -errno;
+	}
+
+	ret = connect(dl.sock, (struct sockaddr *)&dl.addr, sizeof(dl.addr));
+	if (ret < 0) {
+		ret = -errno;
+		goto end;
+	}
+
+	LOG_INF("Downloading %s from offset %zu", dl.uri, offset);
+
+	while (more) {
+		ret = fetch_block(offset, &payload, &len, &more);
+		if (ret == -ESTALE) {
+			LOG_WRN("Image changed on the server, restarting download");
+			ret = restart_stream();
+			if (ret < 0) {
+				goto end;
+			}
+			offset = 0;
+			more = true;
+			continue;
+		}
+		if (ret < 0) {
+			goto end;
+		}
+
+		if (offset == 0 && (len < sizeof(uint32_t) ||
+				    sys_get_le32(payload) != MCUBOOT_IMAGE_MAGIC)) {
+			LOG_ERR("Not an MCUboot image");
+			ret = -EBADMSG;
+			goto end;
+		}
+
+		if (offset + len > FW_SLOT_SIZE) {
+			ret = -ENOSPC;
+			goto end;
+		}
+
+		ret = stream_flash_buffered_write(&stream, payload, len, !more);
+		if (ret < 0) {
+			LOG_ERR("Cannot write block at %zu (%d)", offset, ret);
+			goto end;
+		}
+
+		offset += len;
+		grow_block_size(offset);
+
+		if (offset - dl.saved_offset >= CONFIG_APP_FW_PROGRESS_SAVE_INTERVAL) {
+			(void)stream_flash_progress_save(&stream, FW_SETTINGS_PROGRESS);
+			dl.saved_offset = offset;
+		}
+	}
+
+	LOG_INF("Downloaded %zu bytes", offset);
+	ret = 0;
+
+end:
+	(void)close(dl.sock);
+	dl.sock = -1;
+
+	return ret;
+}
+
+/**
+ * Thread running the downloads
+ */
+static void fw_download_thread(void *p1, void *p2, void *p3)
+{
+	int attempt;
+	int ret;
+
+	while (true) {
+		k_sem_take(&start_sem, K_FOREVER);
+
+		for (attempt = 0; ; attempt++) {
+			ret = download();
+			if (ret != -ETIMEDOUT || attempt >= CONFIG_APP_FW_RESUME_ATTEMPTS ||
+			    atomic_get(&dl.cancel)) {
+				break;
+			}
+
+			LOG_WRN("Server unreachable, resuming in %d s", CONFIG_APP_FW_RESUME_DELAY_SEC);
+			k_sleep(K_SECONDS(CONFIG_APP_FW_RESUME_DELAY_SEC));
+		}
+
+		// Downloads that lost the server keep their progress and can be resumed
+		if (ret != -ETIMEDOUT) {
+			clear_progress();
+			dl.uri[0] = '\0';
+		}
+		atomic_clear(&dl.busy);
+
+		if (download_cb && ret != -ECANCELED) {
+			download_cb(ret < 0 ? FW_DOWNLOAD_EVT_ERROR : FW_DOWNLOAD_EVT_DONE, ret);
+		}
+	}
+}
+
+K_THREAD_DEFINE(fw_download_tid, FW_DOWNLOAD_STACK_SIZE, fw_download_thread,
+		NULL, NULL, NULL, FW_DOWNLOAD_PRIORITY, 0, 0);
+
+/**
+ * Callback function for loading the stored download from settings
+ */
+static int settings_load_cb(const char *key, size_t len, settings_read_cb read_cb,
+			    void *cb_arg, void *param)
+{
+	ssize_t rc;
+
+	if (strcmp(key, "uri") == 0 && len < sizeof(dl.uri)) {
+		rc = read_cb(cb_arg, dl.uri, len);
+		dl.uri[rc > 0 ? rc : 0] = '\0';
+	} else if (strcmp(key, "etag") == 0 && len <= sizeof(dl.etag)) {
+		rc = read_cb(cb_arg, dl.etag, len);
+		dl.etag_len = rc > 0 ? rc : 0;
+	}
+
+	return 0;
+}
+
+/**
+ * Function used to initialize the firmware download
+ */
+int init_fw_download(fw_download_cb_t cb)
+{
+	int ret;
+
+	download_cb = cb;
+
+	ret = settings_subsys_init();
+	if (ret < 0) {
+		return ret;
+	}
+
+	ret = stream_flash_init(&stream, FW_SLOT_DEVICE, write_buf, sizeof(write_buf),
+				FW_SLOT_OFFSET, FW_SLOT_SIZE, NULL);
+	if (ret < 0) {
+		LOG_ERR("Cannot initialize the image slot (%d)", ret);
+		return ret;
+	}
+
+	(void)settings_load_subtree_direct(FW_SETTINGS_ROOT, settings_load_cb, NULL);
+	if (dl.uri[0] == '\0' || parse_uri(&dl) < 0) {
+		clear_progress();
+		return 0;
+	}
+
+	ret = stream_flash_progress_load(&stream, FW_SETTINGS_PROGRESS);
+	if (ret < 0) {
+		(void)restart_stream();
+	}
+
+	LOG_INF("Resuming download of %s at %zu", dl.uri, stream_flash_bytes_written(&stream));
+	atomic_set(&dl.busy, 1);
+	k_sem_give(&start_sem);
+
+	return 1;
+}
+
+/**
+ * Function used to start the download of the image at the given coap:// URI
+ * A download of the same URI that lost the server continues where it stopped
+ */
+int fw_download_start(const char *uri)
+{
+	bool resume;
+	int ret;
+
+	if (strlen(uri) >= sizeof(dl.uri)) {
+		return -EINVAL;
+	}
+
+	if (atomic_set(&dl.busy, 1)) {
+		return -EBUSY;
+	}
+
+	resume = strcmp(dl.uri, uri) == 0;
+
+	strcpy(dl.uri, uri);
+	ret = parse_uri(&dl);
+	if (ret < 0) {
+		LOG_ERR("Invalid firmware URI %s", uri);
+		goto error;
+	}
+
+	if (!resume) {
+		ret = restart_stream();
+		if (ret < 0) {
+			goto error;
+		}
+	}
+
+	ret = settings_save_one(FW_SETTINGS_URI, dl.uri, strlen(dl.uri));
+	if (ret < 0) {
+		goto error;
+	}
+
+	atomic_clear(&dl.cancel);
+	k_sem_give(&start_sem);
+
+	return 0;
+
+error:
+	dl.uri[0] = '\0';
+	atomic_clear(&dl.busy);
+
+	return ret;
+}
+
+/**
+ * Function used to cancel a running download and forget its progress
+ */
+void fw_download_cancel(void)
+{
+	if (atomic_get(&dl.busy)) {
+		atomic_set(&dl.cancel, 1);
+	} else {
+		clear_progress();
+		dl.uri[0] = '\0';
+	}
+}
+
+/**
+ * Function used to mark the downloaded image for the next boot
+ */
+int fw_download_apply(void)
+{
+#if defined(CONFIG_MCUBOOT_IMG_MANAGER)
+	return boot_request_upgrade(BOOT_UPGRADE_TEST);
+#else
+	return -ENOTSUP;
+#endif
+}
@@ -0,0 +1,37 @@
+#ifndef __FW_DOWNLOAD_H__
+#define __FW_DOWNLOAD_H__
+
+enum fw_download_evt {
+	FW_DOWNLOAD_EVT_DONE,
+	FW_DOWNLOAD_EVT_ERROR
+};
+
+/**
+ * Callback invoked when a download finished or failed
+ * err holds the negative error code for FW_DOWNLOAD_EVT_ERROR
+ */
+typedef void (*fw_download_cb_t)(enum fw_download_evt evt, int err);
+
+/**
+ * Function used to initialize the firmware download
+ * Resumes a download that was interrupted by a reboot, returns 1 in that case
+ */
+int init_fw_download(fw_download_cb_t cb);
+
+/**
+ * Function used to start the download of the image at the given coap:// URI
+ * into the secondary image slot
+ */
+int fw_download_start(const char *uri);
+
+/**
+ * Function used to cancel a running download and forget its progress
+ */
+void fw_download_cancel(void);
+
+/**
+ * Function used to mark the downloaded image for the next boot
+ */
+int fw_download_apply(void);
+
+#endif
@@ -0,0 +1,168 @@
+/*
+ * Cost of the CoAP handlers
+ * Every profiled call is timed with the cycle counter and checked against
+ * CONFIG_APP_HANDLER_PROFILE_BUDGET_US. The request paths are meant to run
+ * without heap, a listener on the system heap accounts every allocation to
+ * the calls running in the allocating thread. Handlers profiled at the same
+ * time in other threads do not see each other's allocations.
+ */
+
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(handler_profile, LOG_LEVEL_DBG);
+
+#include <zephyr/kernel.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/sys/heap_listener.h>
+
+#include "handler_profile.h"
+
+#if defined(CONFIG_HEAP_MEM_POOL_SIZE) && CONFIG_HEAP_MEM_POOL_SIZE > 0
+#define PROFILE_HEAP 1
+extern struct k_heap _system_heap;
+#endif
+
+static struct k_spinlock profile_lock;
+
+/* Calls being measured, nested calls of a thread are all listed */
+static sys_slist_t active_probes = SYS_SLIST_STATIC_INIT(&active_probes);
+
+#if defined(PROFILE_HEAP)
+/**
+ * Callback function for allocations from the system heap
+ */
+static void heap_alloc_cb(uintptr_t heap_id, void *mem, size_t bytes)
+{
+	struct handler_probe *probe;
+	k_tid_t thread = k_current_get();
+	k_spinlock_key_t key = k_spin_lock(&profile_lock);
+
+	ARG_UNUSED(heap_id);
+	ARG_UNUSED(mem);
+
+	SYS_SLIST_FOR_EACH_CONTAINER(&active_probes, probe, node) {
+		if (probe->thread == thread) {
+			probe->heap_bytes += bytes;
+		}
+	}
+
+	k_spin_unlock(&profile_lock, key);
+}
+
+HEAP_LISTENER_ALLOC_DEFINE(heap_listener, HEAP_ID_FROM_POINTER(&_system_heap.heap),
+			   heap_alloc_cb);
+
+/**
+ * Function used to register the heap listener once
+ */
+static int handler_profile_init(void)
+{
+	heap_listener_register(&heap_listener);
+
+	return 0;
+}
+
+SYS_INIT(handler_profile_init, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
+#endif
+
+/**
+ * Function used to start measuring a call
+ */
+void handler_profile_begin(struct handler_probe *probe)
+{
+	k_spinlock_key_t key = k_spin_lock(&profile_lock);
+
+	probe->thread = k_current_get();
+	probe->heap_bytes = 0;
+	sys_slist_append(&active_probes, &probe->node);
+
+	k_spin_unlock(&profile_lock, key);
+
+	probe->start_cycles = k_cycle_get_32();
+}
+
+/**
+ * Function used to finish measuring a call and account it to its handler
+ */
+void handler_profile_end(struct handler_profile *profile, struct handler_probe *probe)
+{
+	uint32_t cycles = k_cycle_get_32() - probe->start_cycles;
+	uint32_t us = k_cyc_to_us_ceil32(cycles);
+	bool over_budget = us > CONFIG_APP_HANDLER_PROFILE_BUDGET_US;
+	k_spinlock_key_t key = k_spin_lock(&profile_lock);
+	size_t heap_bytes = probe->heap_bytes;
+
+	(void)sys_slist_find_and_remove(&active_probes, &probe->node);
+
+	profile->count++;
+	profile->last_cycles = cycles;
+	profile->max_cycles = MAX(profile->max_cycles, cycles);
+	profile->total_cycles += cycles;
+	if (over_budget) {
+		profile->overruns++;
+	}
+	if (heap_bytes > 0) {
+		profile->heap_calls++;
+		profile->heap_max_bytes = MAX(profile->heap_max_bytes, heap_bytes);
+	}
+
+	k_spin_unlock(&profile_lock, key);
+
+	if (over_budget) {
+		LOG_WRN("%s took %u us, budget %u us", profile->name, us,
+			CONFIG_APP_HANDLER_PROFILE_BUDGET_US);
+	}
+	if (heap_bytes > 0) {
+		LOG_WRN("%s allocated %zu bytes from the heap", profile->name, heap_bytes);
+	}
+
+	if (IS_ENABLED(CONFIG_APP_HANDLER_PROFILE_STRICT) && (over_budget || heap_bytes > 0)) {
+		// Let regressions fail CI runs on native_sim instead of going unnoticed
+		LOG_PANIC();
+		k_oops();
+	}
+}
+
+#if defined(CONFIG_SHELL)
+static int cmd_handlers_show(const struct shell *sh, size_t argc, char **argv)
+{
+	shell_print(sh, "%-28s %8s %8s %8s %8s %8s %8s", "handler", "calls", "last us",
+		    "avg us", "max us", "overruns", "heap B");
+
+	STRUCT_SECTION_FOREACH(handler_profile, profile) {
+		struct handler_profile copy;
+		k_spinlock_key_t key = k_spin_lock(&profile_lock);
+
+		copy = *profile;
+		k_spin_unlock(&profile_lock, key);
+
+		shell_print(sh, "%-28s %8u %8u %8u %8u %8u %8zu", copy.name, copy.count,
+			    k_cyc_to_us_ceil32(copy.last_cycles),
+			    copy.count ? k_cyc_to_us_ceil32(copy.total_cycles / copy.count) : 0,
+			    k_cyc_to_us_ceil32(copy.max_cycles), copy.overruns,
+			    copy.heap_max_bytes);
+	}
+
+	return 0;
+}
+
+static int cmd_handlers_reset(const struct shell *sh, size_t argc, char **argv)
+{
+	STRUCT_SECTION_FOREACH(handler_profile, profile) {
+		k_spinlock_key_t key = k_spin_lock(&profile_lock);
+		const char *name = profile->name;
+
+		*profile = (struct handler_profile){ .name = name };
+		k_spin_unlock(&profile_lock, key);
+	}
+
+	return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(sub_handlers,
+	SHELL_CMD(show, NULL, "Show the cost of the CoAP handlers", cmd_handlers_show),
+	SHELL_CMD(reset, NULL, "Reset the handler statistics", cmd_handlers_reset),
+	SHELL_SUBCMD_SET_END
+);
+
+SHELL_CMD_REGISTER(handlers, &sub_handlers, "CoAP handler profiling", cmd_handlers_show);
+#endif
@@ -0,0 +1,118 @@
+#ifndef __HANDLER_PROFILE_H__
+#define __HANDLER_PROFILE_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <zephyr/kernel.h>
+#include <zephyr/toolchain.h>
+#include <zephyr/sys/iterable_sections.h>
+#include <zephyr/sys/slist.h>
+
+#include "app_trace.h"
+
+#if defined(CONFIG_APP_STATS)
+#include "app_stats.h"
+#endif
+
+/**
+ * Cost of a CoAP handler or builder, collected over all of its calls
+ */
+struct handler_profile {
+	const char *name;
+	uint32_t count;
+	uint32_t last_cycles;
+	uint32_t max_cycles;
+	uint64_t total_cycles;
+	/* Calls that took longer than CONFIG_APP_HANDLER_PROFILE_BUDGET_US */
+	uint32_t overruns;
+	/* Calls that allocated from the system heap and the most bytes of a call */
+	uint32_t heap_calls;
+	size_t heap_max_bytes;
+};
+
+/**
+ * State of a single call, kept on the stack of the caller
+ */
+struct handler_probe {
+	sys_snode_t node;
+	k_tid_t thread;
+	uint32_t start_cycles;
+	/* Bytes the thread allocated from the system heap during the call */
+	size_t heap_bytes;
+};
+
+#if defined(CONFIG_APP_HANDLER_PROFILE)
+
+#define HANDLER_PROFILE_DEFINE(_name)						\
+	STRUCT_SECTION_ITERABLE(handler_profile, _name##_profile) = {		\
+		.name = #_name,							\
+	}
+
+#define HANDLER_PROFILE_BEGIN(_probe) handler_profile_begin(_probe)
+#define HANDLER_PROFILE_END(_name, _probe) handler_profile_end(&_name##_profile, _probe)
+
+#else
+
+// Swallows the semicolon after the definition
+#define HANDLER_PROFILE_DEFINE(_name) BUILD_ASSERT(true)
+#define HANDLER_PROFILE_BEGIN(_probe) ARG_UNUSED(_probe)
+#define HANDLER_PROFILE_END(_name, _probe)
+
+#endif
+
+#if defined(CONFIG_APP_STATS)
+#define HANDLER_STATS_DEFINE(_name) APP_STATS_HANDLER_DEFINE(_name)
+#define HANDLER_STATS_DONE(_name, _ret) app_stats_handler_done(&_name##_stats, _ret)
+#else
+#define HANDLER_STATS_DEFINE(_name) BUILD_ASSERT(true)
+#define HANDLER_STATS_DONE(_name, _ret)
+#endif
+
+#if defined(CONFIG_APP_HANDLER_PROFILE) || defined(CONFIG_APP_TRACE) || defined(CONFIG_APP_STATS)
+
+/**
+ * Defines a CoAP resource handler _fn##_profiled that measures, traces and
+ * counts every call of the request handler _fn
+ */
+#define HANDLER_PROFILE_WRAP(_fn)							\
+	HANDLER_PROFILE_DEFINE(_fn);							\
+	HANDLER_STATS_DEFINE(_fn);							\
+	static int _fn##_profiled(struct coap_resource *resource,			\
+				  struct coap_packet *request,				\
+				  struct sockaddr *addr, socklen_t addr_len)		\
+	{										\
+		struct handler_probe probe;						\
+		int ret;								\
+											\
+		APP_TRACE("srv_enter", coap_header_get_id(request),			\
+			  coap_header_get_code(request));				\
+		HANDLER_PROFILE_BEGIN(&probe);						\
+		ret = _fn(resource, request, addr, addr_len);				\
+		HANDLER_PROFILE_END(_fn, &probe);					\
+		HANDLER_STATS_DONE(_fn, ret);						\
+		APP_TRACE("srv_exit", coap_header_get_id(request), ret);		\
+		return ret;								\
+	}
+
+#define HANDLER_PROFILED(_fn) _fn##_profiled
+
+#else
+
+#define HANDLER_PROFILE_WRAP(_fn)
+#define HANDLER_PROFILED(_fn) _fn
+
+#endif
+
+/**
+ * Function used to start measuring a call
+ */
+void handler_profile_begin(struct handler_probe *probe);
+
+/**
+ * Function used to finish measuring a call and account it to its handler
+ * Calls over budget or with heap allocations are logged as warning, with
+ * CONFIG_APP_HANDLER_PROFILE_STRICT they are fatal
+ */
+void handler_profile_end(struct handler_profile *profile, struct handler_probe *probe);
+
+#endif
@@ -0,0 +1,395 @@
+/*
+ * Offline request journal
+ * Requests made while the node is detached are kept in order and replayed
+ * once it attached. Writes superseded by a later write to the same resource
+ * are dropped, so a partition heal does not replay a storm of stale values.
+ * The replay is paced, one entry is handed to the client per interval.
+ * Entries expire after CONFIG_APP_JOURNAL_MAX_AGE_SEC whether the node is
+ * attached or not, so their originators are not kept waiting.
+ */
+
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(journal, LOG_LEVEL_DBG);
+
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/net/coap.h>
+#if defined(CONFIG_APP_JOURNAL_PERSIST)
+#include <zephyr/settings/settings.h>
+#endif
+
+#include "connectivity.h"
+#include "events.h"
+#include "journal.h"
+
+#define JOURNAL_KEY "journal/records"
+
+/* Maximum number of path segments of a journaled request */
+#define JOURNAL_MAX_SEGMENTS 8
+
+/**
+ * Request as stored in the journal
+ * The path segments are stored NUL separated
+ */
+struct journal_record {
+	/* Age of the request when the journal was stored, the time the node
+	 * was off is not known and not counted
+	 */
+	uint32_t age_ms;
+	uint8_t method;
+	uint8_t path_len;
+	uint8_t payload_len;
+	char path[CONFIG_APP_JOURNAL_PATH_LEN];
+	uint8_t payload[CONFIG_APP_JOURNAL_PAYLOAD_LEN];
+};
+
+struct journal_entry {
+	struct journal_record record;
+	/* Uptime at which the request was made */
+	int64_t created_ms;
+	/* NULL for entries restored after a reboot */
+	coap_response_cb_t cb;
+	void *user_data;
+};
+
+/* Entries in the order the requests were made */
+static struct journal_entry entries[CONFIG_APP_JOURNAL_SIZE];
+static size_t count;
+static K_MUTEX_DEFINE(journal_mutex);
+
+static void replay_handler(struct k_work *work);
+static K_WORK_DELAYABLE_DEFINE(replay_work, replay_handler);
+
+static void expiry_handler(struct k_work *work);
+static K_WORK_DELAYABLE_DEFINE(expiry_work, expiry_handler);
+
+#if defined(CONFIG_APP_JOURNAL_PERSIST)
+/**
+ * Work handler writing the journal to settings
+ */
+static void save_handler(struct k_work *work)
+{
+	struct journal_record records[CONFIG_APP_JOURNAL_SIZE];
+	int64_t now = k_uptime_get();
+	size_t n;
+	int ret;
+
+	k_mutex_lock(&journal_mutex, K_FOREVER);
+	n = count;
+	for (size_t i = 0; i < n; i++) {
+		records[i] = entries[i].record;
+		records[i].age_ms = now - entries[i].created_ms;
+	}
+	k_mutex_unlock(&journal_mutex);
+
+	ret = n > 0 ? settings_save_one(JOURNAL_KEY, records, n * sizeof(records[0])) :
+		      settings_delete(JOURNAL_KEY);
+	if (ret < 0) {
+		LOG_ERR("Cannot store the journal (%d)", ret);
+	}
+}
+
+static K_WORK_DEFINE(save_work, save_handler);
+#endif
+
+/**
+ * Function used to note a change of the journal
+ */
+static void journal_changed(void)
+{
+#if defined(CONFIG_APP_JOURNAL_PERSIST)
+	k_work_submit(&save_work);
+#endif
+}
+
+/**
+ * Function used to remove an entry
+ * Must be called with journal_mutex held, the callback of the entry is
+ * invoked with result after unlocking
+ */
+static void remove_entry(size_t index, int result)
+{
+	coap_response_cb_t cb = entries[index].cb;
+	void *user_data = entries[index].user_data;
+
+	count--;
+	memmove(&entries[index], &entries[index + 1], (count - index) * sizeof(entries[0]));
+
+	if (cb != NULL) {
+		k_mutex_unlock(&journal_mutex);
+		cb(result, NULL, 0, user_data);
+		k_mutex_lock(&journal_mutex, K_FOREVER);
+	}
+}
+
+/**
+ * Function used to check whether a record supersedes older records
+ * Writes without payload such as toggles depend on the state before, they
+ * are never collapsed
+ */
+static bool supersedes(const struct journal_record *record)
+{
+	return record->method == COAP_METHOD_PUT && record->payload_len > 0;
+}
+
+/**
+ * Callback for replayed requests whose originator is gone
+ */
+static void restored_response(int code, const uint8_t *payload, uint16_t len, void *user_data)
+{
+	LOG_INF("Restored request replayed (%d)", code);
+}
+
+/**
+ * Function used to drop the entries older than the maximum age
+ * Must be called with journal_mutex held, arms the expiry of the oldest
+ * remaining entry
+ */
+static void drop_stale(void)
+{
+	int64_t max_age_ms = (int64_t)CONFIG_APP_JOURNAL_MAX_AGE_SEC * MSEC_PER_SEC;
+
+	// Commands older than the maximum age are stale by now
+	while (count > 0 && k_uptime_get() - entries[0].created_ms >= max_age_ms) {
+		LOG_WRN("Dropping stale journal entry");
+		remove_entry(0, -ETIMEDOUT);
+		journal_changed();
+	}
+
+	if (count > 0) {
+		k_work_reschedule(&expiry_work,
+				  K_TIMEOUT_ABS_MS(entries[0].created_ms + max_age_ms));
+	} else {
+		k_work_cancel_delayable(&expiry_work);
+	}
+}
+
+/**
+ * Work handler expiring the oldest entry, also while detached
+ */
+static void expiry_handler(struct k_work *work)
+{
+	k_mutex_lock(&journal_mutex, K_FOREVER);
+	drop_stale();
+	k_mutex_unlock(&journal_mutex);
+}
+
+/**
+ * Work handler replaying the journal, one entry per interval
+ */
+static void replay_handler(struct k_work *work)
+{
+	const char *segments[JOURNAL_MAX_SEGMENTS + 1];
+	struct journal_entry *entry;
+	size_t n = 0;
+	int ret;
+
+	k_mutex_lock(&journal_mutex, K_FOREVER);
+
+	drop_stale();
+
+	if (count == 0 || !connectivity_is_attached()) {
+		k_mutex_unlock(&journal_mutex);
+		return;
+	}
+
+	entry = &entries[0];
+
+	for (size_t i = 0; i < entry->record.path_len && n < JOURNAL_MAX_SEGMENTS;
+	     i += strlen(&entry->record.path[i]) + 1) {
+		segments[n++] = &entry->record.path[i];
+	}
+	segments[n] = NULL;
+
+	// Never journals, so the entry is only dropped once it really was sent, a
+	// busy client or a lost bridge keep it for the next interval
+	ret = coap_request_transmit(entry->record.method, segments, entry->record.payload,
+				    entry->record.payload_len,
+				    entry->cb != NULL ? entry->cb : restored_response,
+				    entry->user_data);
+	if (ret == 0) {
+		// The callback now belongs to the client
+		count--;
+		memmove(&entries[0], &entries[1], count * sizeof(entries[0]));
+		journal_changed();
+	} else if (ret != -EBUSY && ret != -ENETUNREACH) {
+		LOG_ERR("Cannot replay journal entry (%d)", ret);
+		remove_entry(0, ret);
+		journal_changed();
+	}
+
+	drop_stale();
+
+	if (count > 0) {
+		k_work_schedule(&replay_work, K_MSEC(CONFIG_APP_JOURNAL_REPLAY_INTERVAL_MS));
+	}
+
+	k_mutex_unlock(&journal_mutex);
+}
+
+/**
+ * Function used to replay the journal, e.g. once the bridge is known
+ */
+void journal_replay(void)
+{
+	k_work_schedule(&replay_work, K_NO_WAIT);
+}
+
+/**
+ * Listener used to start the replay once the node attached
+ */
+static void conn_event_handler(const struct zbus_channel *chan)
+{
+	const struct conn_event *event = zbus_chan_const_msg(chan);
+
+	if (event->state == CONN_STATE_ATTACHED) {
+		journal_replay();
+	}
+}
+
+ZBUS_LISTENER_DEFINE(journal_conn_listener, conn_event_handler);
+ZBUS_CHAN_ADD_OBS(conn_chan, journal_conn_listener, 3);
+
+/**
+ * Function used to keep a request until the bridge can be reached
+ */
+int journal_add(uint8_t method, const char * const *path, const uint8_t *payload,
+		uint16_t payload_len, coap_response_cb_t cb, void *user_data)
+{
+	struct journal_record record = {
+		.method = method,
+	};
+	const char * const *p;
+	size_t len;
+
+	for (p = path; p && *p; p++) {
+		len = strlen(*p) + 1;
+		if (record.path_len + len > sizeof(record.path)) {
+			return -ENAMETOOLONG;
+		}
+
+		memcpy(&record.path[record.path_len], *p, len);
+		record.path_len += len;
+	}
+
+	if (payload_len > sizeof(record.payload)) {
+		return -EMSGSIZE;
+	}
+
+	memcpy(record.payload, payload, payload_len);
+	record.payload_len = payload_len;
+
+	k_mutex_lock(&journal_mutex, K_FOREVER);
+
+	if (supersedes(&record)) {
+		for (size_t i = 0; i < count; i++) {
+			if (supersedes(&entries[i].record) &&
+			    entries[i].record.path_len == record.path_len &&
+			    memcmp(entries[i].record.path, record.path, record.path_len) == 0) {
+				LOG_DBG("Journal entry superseded");
+				remove_entry(i, -ECANCELED);
+				break;
+			}
+		}
+	}
+
+	if (count == ARRAY_SIZE(entries)) {
+		// The oldest request is the most likely one to be stale
+		LOG_WRN("Journal full, dropping the oldest entry");
+		remove_entry(0, -ENOBUFS);
+	}
+
+	entries[count].record = record;
+	entries[count].created_ms = k_uptime_get();
+	entries[count].cb = cb;
+	entries[count].user_data = user_data;
+	count++;
+
+	journal_changed();
+	drop_stale();
+
+	k_mutex_unlock(&journal_mutex);
+
+	// Paced like the entries before, an already scheduled replay is kept
+	if (connectivity_is_attached()) {
+		journal_replay();
+	}
+
+	return 0;
+}
+
+/**
+ * Function used to check whether requests wait for their replay
+ */
+bool journal_pending(void)
+{
+	bool pending;
+
+	k_mutex_lock(&journal_mutex, K_FOREVER);
+	pending = count > 0;
+	k_mutex_unlock(&journal_mutex);
+
+	return pending;
+}
+
+#if defined(CONFIG_APP_JOURNAL_PERSIST)
+/**
+ * Callback function for loading the stored journal from settings
+ */
+static int settings_load_cb(const char *key, size_t len, settings_read_cb read_cb,
+			    void *cb_arg, void *param)
+{
+	struct journal_record records[CONFIG_APP_JOURNAL_SIZE];
+	ssize_t rcvd;
+
+	if (len % sizeof(records[0]) != 0 || len > sizeof(records)) {
+		return 0;
+	}
+
+	rcvd = read_cb(cb_arg, records, len);
+	if (rcvd != len) {
+		return 0;
+	}
+
+	count = len / sizeof(records[0]);
+	for (size_t i = 0; i < count; i++) {
+		// Continue aging from the age the entry had when it was stored
+		entries[i].record = records[i];
+		entries[i].created_ms = k_uptime_get() - records[i].age_ms;
+		entries[i].cb = NULL;
+	}
+
+	return 0;
+}
+#endif
+
+/**
+ * Function used to initialize the journal
+ */
+int init_journal(void)
+{
+#if defined(CONFIG_APP_JOURNAL_PERSIST)
+	int ret;
+
+	ret = settings_subsys_init();
+	if (ret < 0) {
+		LOG_ERR("Cannot initialize settings (%d)", ret);
+		return ret;
+	}
+
+	k_mutex_lock(&journal_mutex, K_FOREVER);
+	ret = settings_load_subtree_direct(JOURNAL_KEY, settings_load_cb, NULL);
+	drop_stale();
+	k_mutex_unlock(&journal_mutex);
+	if (ret < 0) {
+		LOG_ERR("Cannot load the journal (%d)", ret);
+		return ret;
+	}
+
+	if (count > 0) {
+		LOG_INF("Restored %zu journal entries", count);
+	}
+#endif
+
+	return 0;
+}
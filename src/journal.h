@@ -0,0 +1,34 @@
+#ifndef __JOURNAL_H__
+#define __JOURNAL_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "coap_client.h"
+
+/**
+ * Function used to initialize the journal
+ * Restores the entries stored before a reboot if the journal is persistent
+ */
+int init_journal(void);
+
+/**
+ * Function used to keep a request until the bridge can be reached
+ * A PUT with payload replaces an older PUT to the same resource, the callback
+ * of the replaced request is invoked with -ECANCELED
+ */
+int journal_add(uint8_t method, const char * const *path, const uint8_t *payload,
+		uint16_t payload_len, coap_response_cb_t cb, void *user_data);
+
+/**
+ * Function used to check whether requests wait for their replay
+ * New requests have to queue up behind them to keep the order
+ */
+bool journal_pending(void);
+
+/**
+ * Function used to replay the journal, e.g. once the bridge is known
+ */
+void journal_replay(void);
+
+#endif
@@ -0,0 +1,304 @@
+/*
+ * Light actuation and its in-RAM shadow state
+ * Every actuation updates the shadow, all readers use the shadow instead of
+ * reading the output back through the driver. The version counter changes
+ * with every change of the state and is used for ETags and Observe. It
+ * starts at a random value, so the versions of the last boot are not handed
+ * out again for a different state.
+ */
+
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(light, LOG_LEVEL_DBG);
+
+#include <zephyr/kernel.h>
+#include <zephyr/drivers/gpio.h>
+#include <zephyr/random/random.h>
+
+#include "events.h"
+#include "light.h"
+
+#if defined(CONFIG_APP_LIGHT_PWM)
+#include "light_fade.h"
+
+#define LIGHT_TRANSITION_MS CONFIG_APP_LIGHT_TRANSITION_MS
+#else
+// led4 -> User LED
+#define LIGHT_LED DT_ALIAS(led4)
+
+#define LIGHT_TRANSITION_MS 0
+
+static const struct gpio_dt_spec led_user = GPIO_DT_SPEC_GET(LIGHT_LED, gpios);
+#endif
+
+/* Bounds the time a state change waits for a consumer reading the channel */
+#define LIGHT_PUB_TIMEOUT K_MSEC(10)
+
+/* Single store backing every view on the light */
+static struct light_state light = {
+	.dimmer = LIGHT_DIMMER_MAX,
+};
+
+/* Serializes actuations, so toggles can not get lost between read and write */
+static K_MUTEX_DEFINE(light_mutex);
+
+/**
+ * Function used to account the on time and energy up to now
+ * Must be called with light_mutex held before the state is modified
+ */
+static void account(int64_t now)
+{
+	if (light.on) {
+		uint64_t elapsed_ms = now - light.accounted_ms;
+
+		light.on_time_ms += elapsed_ms;
+		light.energy_mw_ms += elapsed_ms * CONFIG_APP_LIGHT_RATED_POWER_MW *
+				      light.dimmer / LIGHT_DIMMER_MAX;
+	}
+
+	light.accounted_ms = now;
+}
+
+/**
+ * Function used to publish the new state on the light channel
+ */
+static void notify_changed(const struct light_state *state)
+{
+	int ret;
+
+	ret = zbus_chan_pub(&light_chan, state, LIGHT_PUB_TIMEOUT);
+	if (ret < 0) {
+		LOG_WRN("Cannot publish light state (%d)", ret);
+	}
+}
+
+#if defined(CONFIG_APP_LIGHT_PWM)
+/**
+ * Function used to map the state to a duty cycle
+ * The level is squared to approximate the perceived brightness
+ */
+static uint16_t output_duty(bool on, uint8_t dimmer)
+{
+	if (!on) {
+		return 0;
+	}
+
+	return (uint32_t)dimmer * dimmer * LIGHT_FADE_DUTY_MAX /
+	       (LIGHT_DIMMER_MAX * LIGHT_DIMMER_MAX);
+}
+#endif
+
+/**
+ * Function used to drive the output
+ * Without PWM the output is switched only and the transition is ignored
+ */
+static int output_set(bool on, uint8_t dimmer, uint32_t transition_ms)
+{
+#if defined(CONFIG_APP_LIGHT_PWM)
+	return light_fade_to(output_duty(on, dimmer), transition_ms);
+#else
+	ARG_UNUSED(dimmer);
+	ARG_UNUSED(transition_ms);
+
+	return gpio_pin_set_dt(&led_user, on);
+#endif
+}
+
+/**
+ * Function used to drive the output and update the shadow
+ * Must be called with light_mutex held, fills state with the new state
+ * Returns 1 if the state changed
+ */
+static int apply(bool on, uint8_t dimmer, uint32_t transition_ms, struct light_state *state)
+{
+	int ret;
+
+	if (on == light.on && dimmer == light.dimmer) {
+		return 0;
+	}
+
+	ret = output_set(on, dimmer, transition_ms);
+	if (ret < 0) {
+		return ret;
+	}
+
+	account(k_uptime_get());
+	light.on = on;
+	light.dimmer = dimmer;
+	light.version++;
+	*state = light;
+
+	return 1;
+}
+
+/**
+ * Function used to initialize the light
+ */
+int init_light(void)
+{
+	int ret;
+
+#if defined(CONFIG_APP_LIGHT_PWM)
+	ret = init_light_fade(output_duty(true, light.dimmer));
+	if (ret < 0) {
+		LOG_ERR("Error %d: failed to initialize the dimmable output", ret);
+		return ret;
+	}
+#else
+	if (!gpio_is_ready_dt(&led_user)) {
+		LOG_ERR("Error: led device %s is not ready\n",
+		       led_user.port->name);
+		return -ENODEV;
+	}
+
+	// The state is kept in the shadow, the pin is never read back
+	ret = gpio_pin_configure_dt(&led_user, GPIO_OUTPUT_ACTIVE);
+	if (ret < 0) {
+		LOG_ERR("Error %d: failed to configure %s pin %d\n",
+		       ret, led_user.port->name, led_user.pin);
+		return ret;
+	}
+#endif
+
+	light.on = true;
+	light.accounted_ms = k_uptime_get();
+	// A client revalidating an ETag of the last boot must not get a 2.03
+	light.version = sys_rand32_get();
+
+	return 0;
+}
+
+/**
+ * Function used to switch the light on or off
+ */
+int light_set(bool on)
+{
+	struct light_state state;
+	int ret;
+
+	k_mutex_lock(&light_mutex, K_FOREVER);
+	ret = apply(on, light.dimmer, LIGHT_TRANSITION_MS, &state);
+	k_mutex_unlock(&light_mutex);
+
+	if (ret > 0) {
+		notify_changed(&state);
+	}
+
+	return MIN(ret, 0);
+}
+
+/**
+ * Function used to toggle the light
+ */
+int light_toggle(void)
+{
+	struct light_state state;
+	int ret;
+
+	k_mutex_lock(&light_mutex, K_FOREVER);
+	ret = apply(!light.on, light.dimmer, LIGHT_TRANSITION_MS, &state);
+	k_mutex_unlock(&light_mutex);
+
+	if (ret > 0) {
+		notify_changed(&state);
+	}
+
+	return MIN(ret, 0);
+}
+
+/**
+ * Function used to read the current state of the light
+ */
+bool light_get(void)
+{
+	return light.on;
+}
+
+/**
+ * Function used to read the version of the current state
+ */
+uint32_t light_get_version(void)
+{
+	return light.version;
+}
+
+/**
+ * Function used to set the dimmer level in percent
+ */
+int light_set_dimmer(uint8_t level)
+{
+	return light_move_to_level(level, LIGHT_TRANSITION_MS);
+}
+
+/**
+ * Function used to fade the dimmer level to a level in percent
+ * Without PWM the level is used for the energy accounting only
+ */
+int light_move_to_level(uint8_t level, uint32_t transition_ms)
+{
+	struct light_state state;
+	int ret;
+
+	if (level > LIGHT_DIMMER_MAX) {
+		return -EINVAL;
+	}
+
+	k_mutex_lock(&light_mutex, K_FOREVER);
+	ret = apply(light.on, level, transition_ms, &state);
+	k_mutex_unlock(&light_mutex);
+
+	if (ret > 0) {
+		notify_changed(&state);
+	}
+
+	return MIN(ret, 0);
+}
+
+/**
+ * Function used to read a snapshot of the state with up to date counters
+ */
+void light_get_state(struct light_state *state)
+{
+	k_mutex_lock(&light_mutex, K_FOREVER);
+	account(k_uptime_get());
+	*state = light;
+	k_mutex_unlock(&light_mutex);
+}
+
+/**
+ * Function used to reset the on time counter
+ */
+void light_reset_on_time(void)
+{
+	k_mutex_lock(&light_mutex, K_FOREVER);
+	account(k_uptime_get());
+	light.on_time_ms = 0;
+	k_mutex_unlock(&light_mutex);
+}
+
+/**
+ * Function used to restore a stored state without publishing it
+ */
+int light_restore(const struct light_state *state)
+{
+	int ret;
+
+	if (state->dimmer > LIGHT_DIMMER_MAX) {
+		return -EINVAL;
+	}
+
+	k_mutex_lock(&light_mutex, K_FOREVER);
+
+	ret = output_set(state->on, state->dimmer, 0);
+	if (ret == 0) {
+		light.on = state->on;
+		light.dimmer = state->dimmer;
+		light.on_time_ms = state->on_time_ms;
+		light.energy_mw_ms = state->energy_mw_ms;
+		light.accounted_ms = k_uptime_get();
+		light.version++;
+	}
+
+	k_mutex_unlock(&light_mutex);
+
+	return ret;
+}
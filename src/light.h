@@ -0,0 +1,76 @@
+#ifndef __LIGHT_H__
+#define __LIGHT_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define LIGHT_DIMMER_MAX 100
+
+/**
+ * State of the light shared by all object views
+ */
+struct light_state {
+	bool on;
+	/* Dimmer level in percent */
+	uint8_t dimmer;
+	/* Time the light has been on since the last reset in ms */
+	uint64_t on_time_ms;
+	/* Energy used in mW*ms */
+	uint64_t energy_mw_ms;
+	/* Uptime up to which on_time_ms and energy_mw_ms are accounted */
+	int64_t accounted_ms;
+	/* Incremented on every change of on or dimmer */
+	uint32_t version;
+};
+
+/**
+ * Function used to initialize the light
+ */
+int init_light(void);
+
+/**
+ * Function used to switch the light on or off
+ */
+int light_set(bool on);
+
+/**
+ * Function used to toggle the light
+ */
+int light_toggle(void);
+
+/**
+ * Function used to read the current state of the light
+ */
+bool light_get(void);
+
+/**
+ * Function used to read the version of the current state
+ */
+uint32_t light_get_version(void);
+
+/**
+ * Function used to set the dimmer level in percent
+ */
+int light_set_dimmer(uint8_t level);
+
+/**
+ * Function used to fade the dimmer level to a level in percent
+ */
+int light_move_to_level(uint8_t level, uint32_t transition_ms);
+
+/**
+ * Function used to read a snapshot of the state with up to date counters
+ */
+void light_get_state(struct light_state *state);
+
+/**
+ * Function used to reset the on time counter
+ */
+void light_reset_on_time(void);
+
+/**
+ * Function used to restore a stored state without publishing it
+ */
+int light_restore(const struct light_state *state);
+
+#endif
@@ -0,0 +1,21 @@
+#ifndef __LIGHT_FADE_H__
+#define __LIGHT_FADE_H__
+
+#include <stdint.h>
+
+/* Resolution of the output duty cycle */
+#define LIGHT_FADE_DUTY_MAX 1000
+
+/**
+ * Function used to initialize the dimmable output
+ * The output starts at the given duty cycle
+ */
+int init_light_fade(uint16_t duty);
+
+/**
+ * Function used to move the output to a duty cycle over the transition time
+ * A running fade is replaced, starting from the duty cycle reached so far
+ */
+int light_fade_to(uint16_t duty, uint32_t transition_ms);
+
+#endif
@@ -0,0 +1,164 @@
+/*
+ * Hardware timed fades on the nRF PWM peripheral
+ * A fade is rendered once into a sequence of duty cycles which the PWM
+ * peripheral plays by itself through EasyDMA, every value is held for a
+ * number of PWM periods. The CPU is only involved when a fade starts, after
+ * the last value the peripheral keeps repeating it without further events.
+ */
+
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(light_fade, LOG_LEVEL_DBG);
+
+#include <zephyr/kernel.h>
+#include <zephyr/drivers/gpio.h>
+#include <soc_nrf_common.h>
+#include <nrfx_pwm.h>
+
+#include "light_fade.h"
+
+// The PWM drives the pin of the user LED directly
+#define LIGHT_LED DT_ALIAS(led4)
+
+#define LIGHT_FADE_PIN NRF_DT_GPIOS_TO_PSEL(LIGHT_LED, gpios)
+#define LIGHT_FADE_INVERTED (DT_GPIO_FLAGS(LIGHT_LED, gpios) & GPIO_ACTIVE_LOW)
+
+/* 1 MHz base clock with a top value of 1000 results in a 1 kHz PWM */
+#define LIGHT_FADE_PERIOD_US 1
+
+/*
+ * Polarity bit of a sequence value, with it set the output starts high and
+ * falls at the compare value, without it starts low and rises. Set for
+ * active high outputs, so the compare value is the active part either way.
+ */
+#define LIGHT_FADE_POLARITY BIT(15)
+
+static nrfx_pwm_t pwm = NRFX_PWM_INSTANCE(1);
+
+/*
+ * Sequences played by the peripheral, a new fade is rendered into the buffer
+ * which is not played, so the running sequence is never modified
+ */
+static nrf_pwm_values_common_t fade_values[2][CONFIG_APP_LIGHT_FADE_STEPS];
+static uint8_t fade_buf;
+
+/* Current fade, used to find the duty cycle reached when it is replaced */
+static uint16_t fade_from;
+static uint16_t fade_target;
+static int64_t fade_start_ms;
+static uint32_t fade_duration_ms;
+
+/**
+ * Function used to encode a duty cycle as sequence value
+ */
+static nrf_pwm_values_common_t fade_value(uint16_t duty)
+{
+	// The compare value counts the active part of the period, like pwm_nrfx does
+	uint16_t compare = duty;
+
+	return LIGHT_FADE_INVERTED ? compare : (compare | LIGHT_FADE_POLARITY);
+}
+
+/**
+ * Function used to estimate the duty cycle currently played by the peripheral
+ * The peripheral does not expose its position, it is derived from the time
+ */
+static uint16_t fade_current(void)
+{
+	int64_t elapsed_ms = k_uptime_get() - fade_start_ms;
+
+	if (elapsed_ms >= fade_duration_ms) {
+		return fade_target;
+	}
+
+	return fade_from + ((int32_t)fade_target - fade_from) * elapsed_ms / fade_duration_ms;
+}
+
+/**
+ * Function used to play a sequence of duty cycles on the output
+ */
+static int fade_play(const nrf_pwm_values_common_t *values, uint16_t length, uint32_t repeats)
+{
+	nrf_pwm_sequence_t seq = {
+		.values.p_common = values,
+		.length = length,
+		.repeats = repeats,
+		.end_delay = 0,
+	};
+	uint32_t ret;
+
+	// Without the stop flag the last value is repeated until the next fade
+	ret = nrfx_pwm_simple_playback(&pwm, &seq, 1, 0);
+
+	return ret == 0 ? 0 : -EIO;
+}
+
+/**
+ * Function used to initialize the dimmable output
+ */
+int init_light_fade(uint16_t duty)
+{
+	nrfx_pwm_config_t config = NRFX_PWM_DEFAULT_CONFIG(LIGHT_FADE_PIN,
+							   NRF_PWM_PIN_NOT_CONNECTED,
+							   NRF_PWM_PIN_NOT_CONNECTED,
+							   NRF_PWM_PIN_NOT_CONNECTED);
+	nrfx_err_t err;
+
+	config.base_clock = NRF_PWM_CLK_1MHz;
+	config.count_mode = NRF_PWM_MODE_UP;
+	config.top_value = LIGHT_FADE_DUTY_MAX;
+	config.load_mode = NRF_PWM_LOAD_COMMON;
+	config.step_mode = NRF_PWM_STEP_AUTO;
+
+	err = nrfx_pwm_init(&pwm, &config, NULL, NULL);
+	if (err != NRFX_SUCCESS) {
+		LOG_ERR("Cannot initialize PWM (error: %d)", err);
+		return -EIO;
+	}
+
+	fade_from = duty;
+	fade_target = duty;
+	fade_values[fade_buf][0] = fade_value(duty);
+
+	return fade_play(fade_values[fade_buf], 1, 0);
+}
+
+/**
+ * Function used to move the output to a duty cycle over the transition time
+ */
+int light_fade_to(uint16_t duty, uint32_t transition_ms)
+{
+	nrf_pwm_values_common_t *values;
+	uint16_t from, steps, distance;
+	uint32_t periods;
+
+	if (duty > LIGHT_FADE_DUTY_MAX) {
+		return -EINVAL;
+	}
+
+	from = fade_current();
+	distance = from > duty ? from - duty : duty - from;
+	// Transitions above 4294 s overflow in 32 bits, the quotient fits again
+	periods = (uint64_t)transition_ms * USEC_PER_MSEC /
+		  (LIGHT_FADE_DUTY_MAX * LIGHT_FADE_PERIOD_US);
+
+	// At most one step per PWM period and one step per duty change
+	steps = MIN(MIN(periods, distance), CONFIG_APP_LIGHT_FADE_STEPS);
+	steps = MAX(steps, 1);
+
+	fade_buf ^= 1;
+	values = fade_values[fade_buf];
+
+	for (uint16_t i = 1; i <= steps; i++) {
+		int32_t delta = ((int32_t)duty - from) * i / steps;
+
+		values[i - 1] = fade_value(from + delta);
+	}
+
+	fade_from = from;
+	fade_target = duty;
+	fade_start_ms = k_uptime_get();
+	fade_duration_ms = transition_ms;
+
+	// Every value is played repeats + 1 periods
+	return fade_play(values, steps, periods > steps ? periods / steps - 1 : 0);
+}
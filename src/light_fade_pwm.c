@@ -0,0 +1,105 @@
+/*
+ * Fades on a generic PWM output
+ * Used where the PWM peripheral can not play sequences by itself, e.g. the
+ * PWM emulator of native_sim. The duty cycle is updated in coarse steps of
+ * CONFIG_APP_LIGHT_FADE_STEP_MS, so a fade costs a bounded number of wakeups.
+ */
+
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(light_fade, LOG_LEVEL_DBG);
+
+#include <zephyr/kernel.h>
+#include <zephyr/drivers/pwm.h>
+
+#include "light_fade.h"
+
+// light-pwm -> PWM channel driving the light
+static const struct pwm_dt_spec light_pwm = PWM_DT_SPEC_GET(DT_ALIAS(light_pwm));
+
+/* Current fade */
+static uint16_t fade_from;
+static uint16_t fade_target;
+static uint16_t fade_current;
+static int64_t fade_start_ms;
+static uint32_t fade_duration_ms;
+
+/**
+ * Function used to set the duty cycle of the output
+ */
+static int fade_set(uint16_t duty)
+{
+	uint32_t pulse = (uint64_t)light_pwm.period * duty / LIGHT_FADE_DUTY_MAX;
+	int ret;
+
+	ret = pwm_set_pulse_dt(&light_pwm, pulse);
+	if (ret < 0) {
+		LOG_ERR("Cannot set PWM pulse (error: %d)", ret);
+		return ret;
+	}
+
+	fade_current = duty;
+
+	return 0;
+}
+
+/**
+ * Function used to advance the running fade by one step
+ */
+static void fade_step_handler(struct k_work *work)
+{
+	struct k_work_delayable *dwork = k_work_delayable_from_work(work);
+	int64_t elapsed_ms = k_uptime_get() - fade_start_ms;
+
+	if (elapsed_ms >= fade_duration_ms) {
+		fade_set(fade_target);
+		return;
+	}
+
+	fade_set(fade_from + ((int32_t)fade_target - fade_from) * elapsed_ms / fade_duration_ms);
+	k_work_schedule(dwork, K_MSEC(CONFIG_APP_LIGHT_FADE_STEP_MS));
+}
+
+static K_WORK_DELAYABLE_DEFINE(fade_step_work, fade_step_handler);
+
+/**
+ * Function used to initialize the dimmable output
+ */
+int init_light_fade(uint16_t duty)
+{
+	if (!pwm_is_ready_dt(&light_pwm)) {
+		LOG_ERR("Error: PWM device %s is not ready", light_pwm.dev->name);
+		return -ENODEV;
+	}
+
+	fade_target = duty;
+
+	return fade_set(duty);
+}
+
+/**
+ * Function used to move the output to a duty cycle over the transition time
+ */
+int light_fade_to(uint16_t duty, uint32_t transition_ms)
+{
+	struct k_work_sync sync;
+
+	if (duty > LIGHT_FADE_DUTY_MAX) {
+		return -EINVAL;
+	}
+
+	k_work_cancel_delayable_sync(&fade_step_work, &sync);
+
+	fade_target = duty;
+
+	if (transition_ms < CONFIG_APP_LIGHT_FADE_STEP_MS) {
+		return fade_set(duty);
+	}
+
+	fade_from = fade_current;
+	fade_start_ms = k_uptime_get();
+	fade_duration_ms = transition_ms;
+
+	k_work_schedule(&fade_step_work, K_MSEC(CONFIG_APP_LIGHT_FADE_STEP_MS));
+
+	return 0;
+}
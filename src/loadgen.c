@@ -0,0 +1,624 @@
+/*
+ * CoAP load generator
+ * Sends requests to a single resource at a fixed rate, or as fast as the
+ * in-flight window allows with a rate of 0, and measures the round trip
+ * time from the first transmission to the response. Confirmable requests
+ * are retransmitted like the CoAP client does, a request without response
+ * after the last retransmission (CON) or CONFIG_APP_LOADGEN_TIMEOUT_MS
+ * (NON) counts as lost. Requests due while the window is full are skipped
+ * and counted as throttled, so the offered rate stays visible.
+ *
+ * A single thread owns the socket and the in-flight table, the shell only
+ * starts and stops runs and reads a snapshot of the results.
+ */
+
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(loadgen, LOG_LEVEL_INF);
+
+#include <stdlib.h>
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/random/random.h>
+#include <zephyr/net/socket.h>
+#include <zephyr/net/coap.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/sys/byteorder.h>
+
+#include "coap_client.h"
+
+#define LOADGEN_MSG_LEN 128
+#define LOADGEN_PATH_LEN 32
+#define LOADGEN_MAX_SEGMENTS 6
+#define LOADGEN_PAYLOAD_LEN 16
+
+#define LOADGEN_MAX_RATE 10000
+
+#define LOADGEN_STACK_SIZE 2048
+#define LOADGEN_PRIORITY 8
+
+// Upper bounds of the RTT histogram buckets in ms, the last bucket is open
+static const uint32_t bucket_le_ms[] = {
+	1, 2, 5, 10, 20, 50, 100, 200, 500, 1000, 2000, 5000,
+};
+
+#define LOADGEN_BUCKETS (ARRAY_SIZE(bucket_le_ms) + 1)
+
+/**
+ * Parameters of a run
+ */
+struct loadgen_config {
+	struct sockaddr_in6 target;
+	char path[LOADGEN_PATH_LEN];
+	uint8_t method;
+	uint8_t type;
+	uint8_t payload[LOADGEN_PAYLOAD_LEN];
+	uint16_t payload_len;
+	/* Requests per second, 0 sends whenever the window has room */
+	uint32_t rate;
+	uint32_t inflight;
+	uint32_t duration_s;
+};
+
+/**
+ * Results of a run
+ */
+struct loadgen_stats {
+	bool running;
+	int64_t duration_ms;
+	uint32_t sent;
+	uint32_t retransmissions;
+	uint32_t responses;
+	/* Responses with a 4.xx or 5.xx code, included in responses */
+	uint32_t errors;
+	uint32_t resets;
+	uint32_t lost;
+	uint32_t throttled;
+	/* Responses matching no request, e.g. to a retransmission */
+	uint32_t unmatched;
+	uint32_t rtt_min_us;
+	uint32_t rtt_max_us;
+	uint64_t rtt_total_us;
+	uint32_t buckets[LOADGEN_BUCKETS];
+};
+
+/**
+ * Request in flight
+ */
+struct loadgen_slot {
+	bool used;
+	/* Set once an empty ACK announced a separate response */
+	bool acked;
+	uint16_t id;
+	uint32_t seq;
+	uint8_t retransmissions;
+	uint32_t timeout_ms;
+	int64_t sent_us;
+	int64_t expiry_us;
+	uint16_t len;
+	uint8_t data[LOADGEN_MSG_LEN];
+};
+
+static struct loadgen_slot slots[CONFIG_APP_LOADGEN_MAX_INFLIGHT];
+static uint32_t slots_used;
+static uint32_t next_seq;
+static int sock = -1;
+
+static struct loadgen_config config;
+static struct loadgen_stats stats;
+static K_MUTEX_DEFINE(stats_mutex);
+
+static atomic_t stop_requested;
+static K_SEM_DEFINE(start_sem, 0, 1);
+
+// Uri-Path segments of config.path, split in place
+static char path_buf[LOADGEN_PATH_LEN];
+static const char *path_segments[LOADGEN_MAX_SEGMENTS + 1];
+
+static int64_t now_us(void)
+{
+	return k_ticks_to_us_floor64(k_uptime_ticks());
+}
+
+/**
+ * Function used to split the configured path into Uri-Path segments
+ */
+static int split_path(void)
+{
+	size_t count = 0;
+	char *save;
+	char *segment;
+
+	strcpy(path_buf, config.path);
+
+	for (segment = strtok_r(path_buf, "/", &save); segment != NULL;
+	     segment = strtok_r(NULL, "/", &save)) {
+		if (count == LOADGEN_MAX_SEGMENTS) {
+			return -E2BIG;
+		}
+		path_segments[count++] = segment;
+	}
+
+	path_segments[count] = NULL;
+
+	return 0;
+}
+
+/**
+ * Function used to account a completed request
+ */
+static void record_response(struct loadgen_slot *slot, uint8_t code)
+{
+	uint32_t rtt_us = (uint32_t)(now_us() - slot->sent_us);
+	size_t bucket = 0;
+
+	while (bucket < ARRAY_SIZE(bucket_le_ms) && rtt_us > bucket_le_ms[bucket] * 1000U) {
+		bucket++;
+	}
+
+	k_mutex_lock(&stats_mutex, K_FOREVER);
+	stats.responses++;
+	// Client and server error classes
+	if ((code >> 5) >= 4) {
+		stats.errors++;
+	}
+	stats.rtt_min_us = MIN(stats.rtt_min_us, rtt_us);
+	stats.rtt_max_us = MAX(stats.rtt_max_us, rtt_us);
+	stats.rtt_total_us += rtt_us;
+	stats.buckets[bucket]++;
+	k_mutex_unlock(&stats_mutex);
+}
+
+static void release(struct loadgen_slot *slot)
+{
+	slot->used = false;
+	slots_used--;
+}
+
+/**
+ * Function used to send the next request of the run
+ * Returns -EAGAIN if the window is full
+ */
+static int send_request(void)
+{
+	struct loadgen_slot *slot = NULL;
+	struct coap_packet request;
+	uint8_t token[sizeof(uint32_t)];
+	int ret;
+
+	for (size_t i = 0; i < config.inflight; i++) {
+		if (!slots[i].used) {
+			slot = &slots[i];
+			break;
+		}
+	}
+
+	if (slot == NULL) {
+		k_mutex_lock(&stats_mutex, K_FOREVER);
+		stats.throttled++;
+		k_mutex_unlock(&stats_mutex);
+		return -EAGAIN;
+	}
+
+	slot->seq = next_seq++;
+	slot->id = coap_next_id();
+	sys_put_be32(slot->seq, token);
+
+	ret = coap_request_build(&request, slot->data, sizeof(slot->data), config.type,
+				 config.method, token, sizeof(token), slot->id, path_segments,
+				 config.payload, config.payload_len);
+	if (ret < 0) {
+		return ret;
+	}
+
+	slot->len = request.offset;
+	slot->acked = false;
+	slot->retransmissions = 0;
+	slot->sent_us = now_us();
+
+	if (config.type == COAP_TYPE_CON) {
+		slot->timeout_ms = CONFIG_COAP_INIT_ACK_TIMEOUT_MS +
+				   sys_rand32_get() % (CONFIG_COAP_INIT_ACK_TIMEOUT_MS / 2 + 1);
+	} else {
+		slot->timeout_ms = CONFIG_APP_LOADGEN_TIMEOUT_MS;
+	}
+	slot->expiry_us = slot->sent_us + slot->timeout_ms * 1000LL;
+
+	ret = sendto(sock, slot->data, slot->len, 0, (const struct sockaddr *)&config.target,
+		     sizeof(config.target));
+	if (ret < 0) {
+		// Counted as lost once it expires, like a datagram dropped on the way
+		LOG_DBG("Send failed (%d)", errno);
+	}
+
+	slot->used = true;
+	slots_used++;
+
+	k_mutex_lock(&stats_mutex, K_FOREVER);
+	stats.sent++;
+	k_mutex_unlock(&stats_mutex);
+
+	return 0;
+}
+
+/**
+ * Function used to retransmit or give up the requests that timed out
+ * Returns the earliest expiry of the requests still in flight
+ */
+static int64_t process_expiries(int64_t now)
+{
+	int64_t next = INT64_MAX;
+
+	for (size_t i = 0; i < ARRAY_SIZE(slots); i++) {
+		struct loadgen_slot *slot = &slots[i];
+
+		if (!slot->used) {
+			continue;
+		}
+
+		if (slot->expiry_us <= now) {
+			if (config.type == COAP_TYPE_CON && !slot->acked &&
+			    slot->retransmissions < CONFIG_COAP_MAX_RETRANSMIT) {
+				slot->retransmissions++;
+				slot->timeout_ms *= 2;
+				slot->expiry_us = now + slot->timeout_ms * 1000LL;
+				(void)sendto(sock, slot->data, slot->len, 0,
+					     (const struct sockaddr *)&config.target,
+					     sizeof(config.target));
+
+				k_mutex_lock(&stats_mutex, K_FOREVER);
+				stats.retransmissions++;
+				k_mutex_unlock(&stats_mutex);
+			} else {
+				release(slot);
+
+				k_mutex_lock(&stats_mutex, K_FOREVER);
+				stats.lost++;
+				k_mutex_unlock(&stats_mutex);
+				continue;
+			}
+		}
+
+		next = MIN(next, slot->expiry_us);
+	}
+
+	return next;
+}
+
+/**
+ * Function used to match a received message with its request
+ */
+static void process_reply(uint8_t *data, int len, const struct sockaddr_in6 *from)
+{
+	struct coap_packet reply;
+	uint8_t token[COAP_TOKEN_MAX_LEN];
+	uint8_t type, code, tkl;
+	uint16_t id;
+
+	if (coap_packet_parse(&reply, data, len, NULL, 0) < 0) {
+		return;
+	}
+
+	type = coap_header_get_type(&reply);
+	code = coap_header_get_code(&reply);
+	id = coap_header_get_id(&reply);
+	tkl = coap_header_get_token(&reply, token);
+
+	if (type == COAP_TYPE_CON) {
+		uint8_t ack_data[4];
+		struct coap_packet ack;
+
+		if (coap_packet_init(&ack, ack_data, sizeof(ack_data), COAP_VERSION_1,
+				     COAP_TYPE_ACK, 0, NULL, COAP_CODE_EMPTY, id) == 0) {
+			(void)sendto(sock, ack.data, ack.offset, 0, (const struct sockaddr *)from,
+				     sizeof(*from));
+		}
+	}
+
+	for (size_t i = 0; i < ARRAY_SIZE(slots); i++) {
+		struct loadgen_slot *slot = &slots[i];
+
+		if (!slot->used) {
+			continue;
+		}
+
+		if (code == COAP_CODE_EMPTY) {
+			if (id != slot->id) {
+				continue;
+			}
+
+			if (type == COAP_TYPE_ACK) {
+				// The response follows separately
+				slot->acked = true;
+				slot->expiry_us = now_us() + CONFIG_APP_LOADGEN_TIMEOUT_MS * 1000LL;
+			} else if (type == COAP_TYPE_RESET) {
+				release(slot);
+
+				k_mutex_lock(&stats_mutex, K_FOREVER);
+				stats.resets++;
+				k_mutex_unlock(&stats_mutex);
+			}
+			return;
+		}
+
+		if (tkl == sizeof(uint32_t) && sys_get_be32(token) == slot->seq) {
+			record_response(slot, code);
+			release(slot);
+			return;
+		}
+	}
+
+	k_mutex_lock(&stats_mutex, K_FOREVER);
+	stats.unmatched++;
+	k_mutex_unlock(&stats_mutex);
+}
+
+/**
+ * Function used to execute a run until its end or a stop request
+ */
+static void run(void)
+{
+	static uint8_t data[LOADGEN_MSG_LEN];
+	uint64_t interval_us = config.rate ? USEC_PER_SEC / config.rate : 0;
+	int64_t start_us = now_us();
+	int64_t end_us = start_us + (int64_t)config.duration_s * USEC_PER_SEC;
+	int64_t next_send_us = start_us;
+	struct zsock_pollfd fds = { .events = ZSOCK_POLLIN };
+	struct sockaddr_in6 from;
+	socklen_t from_len;
+	int64_t now, next;
+	bool sending;
+	int rcvd;
+
+	sock = socket(AF_INET6, SOCK_DGRAM, IPPROTO_UDP);
+	if (sock < 0) {
+		LOG_ERR("Failed to create UDP socket %d", errno);
+		goto end;
+	}
+	fds.fd = sock;
+
+	memset(slots, 0, sizeof(slots));
+	slots_used = 0;
+
+	while (true) {
+		now = now_us();
+		sending = now < end_us && !atomic_get(&stop_requested);
+
+		if (!sending && slots_used == 0) {
+			break;
+		}
+
+		if (sending && config.rate == 0) {
+			while (slots_used < config.inflight && send_request() == 0) {
+			}
+		} else if (sending) {
+			// Requests due while a response was processed are sent late, requests
+			// due while the window is full are skipped
+			while (next_send_us <= now) {
+				(void)send_request();
+				next_send_us += interval_us;
+			}
+		}
+
+		next = process_expiries(now);
+		if (sending && config.rate != 0) {
+			next = MIN(next, next_send_us);
+		}
+		if (sending) {
+			next = MIN(next, end_us);
+		}
+
+		rcvd = zsock_poll(&fds, 1, next == INT64_MAX ? 100 :
+				  (int)DIV_ROUND_UP(MAX(next - now_us(), 0), USEC_PER_MSEC));
+		if (rcvd <= 0 || !(fds.revents & ZSOCK_POLLIN)) {
+			continue;
+		}
+
+		from_len = sizeof(from);
+		rcvd = recvfrom(sock, data, sizeof(data), 0, (struct sockaddr *)&from, &from_len);
+		if (rcvd > 0) {
+			process_reply(data, rcvd, &from);
+		}
+	}
+
+	close(sock);
+	sock = -1;
+
+end:
+	k_mutex_lock(&stats_mutex, K_FOREVER);
+	stats.running = false;
+	stats.duration_ms = (now_us() - start_us) / USEC_PER_MSEC;
+	k_mutex_unlock(&stats_mutex);
+
+	LOG_INF("Run finished after %lld ms", stats.duration_ms);
+}
+
+static void loadgen_thread(void *p1, void *p2, void *p3)
+{
+	while (true) {
+		k_sem_take(&start_sem, K_FOREVER);
+		run();
+	}
+}
+
+K_THREAD_DEFINE(loadgen, LOADGEN_STACK_SIZE, loadgen_thread, NULL, NULL, NULL,
+		LOADGEN_PRIORITY, 0, 0);
+
+/**
+ * Function used to print the results, as table or as CSV
+ */
+static void print_stats(const struct shell *sh, bool csv)
+{
+	struct loadgen_stats copy;
+	uint32_t lower = 0;
+
+	k_mutex_lock(&stats_mutex, K_FOREVER);
+	copy = stats;
+	k_mutex_unlock(&stats_mutex);
+
+	if (csv) {
+		shell_print(sh, "metric,value");
+		shell_print(sh, "running,%d", copy.running);
+		shell_print(sh, "duration_ms,%lld", copy.duration_ms);
+		shell_print(sh, "rate,%u", config.rate);
+		shell_print(sh, "inflight,%u", config.inflight);
+		shell_print(sh, "sent,%u", copy.sent);
+		shell_print(sh, "retransmissions,%u", copy.retransmissions);
+		shell_print(sh, "responses,%u", copy.responses);
+		shell_print(sh, "errors,%u", copy.errors);
+		shell_print(sh, "resets,%u", copy.resets);
+		shell_print(sh, "lost,%u", copy.lost);
+		shell_print(sh, "throttled,%u", copy.throttled);
+		shell_print(sh, "unmatched,%u", copy.unmatched);
+		shell_print(sh, "rtt_min_us,%u", copy.responses ? copy.rtt_min_us : 0);
+		shell_print(sh, "rtt_avg_us,%llu",
+			    copy.responses ? copy.rtt_total_us / copy.responses : 0);
+		shell_print(sh, "rtt_max_us,%u", copy.rtt_max_us);
+		shell_print(sh, "rtt_gt_ms,rtt_le_ms,count");
+		for (size_t i = 0; i < LOADGEN_BUCKETS; i++) {
+			if (i < ARRAY_SIZE(bucket_le_ms)) {
+				shell_print(sh, "%u,%u,%u", lower, bucket_le_ms[i],
+					    copy.buckets[i]);
+				lower = bucket_le_ms[i];
+			} else {
+				shell_print(sh, "%u,,%u", lower, copy.buckets[i]);
+			}
+		}
+		return;
+	}
+
+	shell_print(sh, "%s, %lld ms", copy.running ? "running" : "stopped",
+		    copy.duration_ms);
+	shell_print(sh, "sent %u, retransmissions %u, responses %u (errors %u), resets %u",
+		    copy.sent, copy.retransmissions, copy.responses, copy.errors, copy.resets);
+	shell_print(sh, "lost %u, throttled %u, unmatched %u", copy.lost, copy.throttled,
+		    copy.unmatched);
+	if (copy.responses > 0) {
+		shell_print(sh, "rtt min %u us, avg %llu us, max %u us", copy.rtt_min_us,
+			    copy.rtt_total_us / copy.responses, copy.rtt_max_us);
+	}
+	for (size_t i = 0; i < LOADGEN_BUCKETS; i++) {
+		if (i < ARRAY_SIZE(bucket_le_ms)) {
+			shell_print(sh, "  <= %5u ms: %u", bucket_le_ms[i], copy.buckets[i]);
+		} else {
+			shell_print(sh, "   > %5u ms: %u", bucket_le_ms[i - 1], copy.buckets[i]);
+		}
+	}
+}
+
+/**
+ * loadgen start <addr> <path> [rate] [inflight] [seconds] [non] [put=<payload>]
+ */
+static int cmd_loadgen_start(const struct shell *sh, size_t argc, char **argv)
+{
+	struct loadgen_config next = {
+		.method = COAP_METHOD_GET,
+		.type = COAP_TYPE_CON,
+		.rate = 10,
+		.inflight = 1,
+		.duration_s = 10,
+	};
+
+	k_mutex_lock(&stats_mutex, K_FOREVER);
+	if (stats.running) {
+		k_mutex_unlock(&stats_mutex);
+		shell_error(sh, "A run is active, stop it first");
+		return -EBUSY;
+	}
+	k_mutex_unlock(&stats_mutex);
+
+	next.target.sin6_family = AF_INET6;
+	next.target.sin6_port = htons(COAP_PORT);
+	if (inet_pton(AF_INET6, argv[1], &next.target.sin6_addr) != 1) {
+		shell_error(sh, "Invalid IPv6 address %s", argv[1]);
+		return -EINVAL;
+	}
+
+	if (strlen(argv[2]) >= sizeof(next.path)) {
+		shell_error(sh, "Path too long");
+		return -EINVAL;
+	}
+	strcpy(next.path, argv[2]);
+
+	if (argc > 3) {
+		next.rate = strtoul(argv[3], NULL, 10);
+	}
+	if (argc > 4) {
+		next.inflight = strtoul(argv[4], NULL, 10);
+	}
+	if (argc > 5) {
+		next.duration_s = strtoul(argv[5], NULL, 10);
+	}
+	for (size_t i = 6; i < argc; i++) {
+		if (strcmp(argv[i], "non") == 0) {
+			next.type = COAP_TYPE_NON_CON;
+		} else if (strncmp(argv[i], "put=", 4) == 0 &&
+			   strlen(argv[i] + 4) <= sizeof(next.payload)) {
+			next.method = COAP_METHOD_PUT;
+			next.payload_len = strlen(argv[i] + 4);
+			memcpy(next.payload, argv[i] + 4, next.payload_len);
+		} else {
+			shell_error(sh, "Unknown argument %s", argv[i]);
+			return -EINVAL;
+		}
+	}
+
+	if (next.inflight == 0 || next.inflight > CONFIG_APP_LOADGEN_MAX_INFLIGHT ||
+	    next.rate > LOADGEN_MAX_RATE || next.duration_s == 0) {
+		shell_error(sh, "In flight must be 1 to %d, rate at most %d",
+			    CONFIG_APP_LOADGEN_MAX_INFLIGHT, LOADGEN_MAX_RATE);
+		return -EINVAL;
+	}
+
+	config = next;
+	if (split_path() < 0) {
+		shell_error(sh, "Path has too many segments");
+		return -EINVAL;
+	}
+
+	k_mutex_lock(&stats_mutex, K_FOREVER);
+	stats = (struct loadgen_stats){ .running = true, .rtt_min_us = UINT32_MAX };
+	k_mutex_unlock(&stats_mutex);
+
+	atomic_clear(&stop_requested);
+	k_sem_give(&start_sem);
+
+	shell_print(sh, "%s %s to %s, %u/s, %u in flight, %u s",
+		    next.method == COAP_METHOD_PUT ? "PUT" : "GET",
+		    next.type == COAP_TYPE_CON ? "CON" : "NON", argv[1], next.rate,
+		    next.inflight, next.duration_s);
+
+	return 0;
+}
+
+static int cmd_loadgen_stop(const struct shell *sh, size_t argc, char **argv)
+{
+	// The requests in flight still complete or expire
+	atomic_set(&stop_requested, 1);
+	return 0;
+}
+
+static int cmd_loadgen_show(const struct shell *sh, size_t argc, char **argv)
+{
+	print_stats(sh, false);
+	return 0;
+}
+
+static int cmd_loadgen_csv(const struct shell *sh, size_t argc, char **argv)
+{
+	print_stats(sh, true);
+	return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(sub_loadgen,
+	SHELL_CMD_ARG(start, NULL,
+		      "<addr> <path> [rate/s, 0 = window bound] [in flight] [seconds] [non] "
+		      "[put=<payload>]",
+		      cmd_loadgen_start, 3, 5),
+	SHELL_CMD(stop, NULL, "Stop sending, requests in flight still complete",
+		  cmd_loadgen_stop),
+	SHELL_CMD(show, NULL, "Show the results of the last run", cmd_loadgen_show),
+	SHELL_CMD(csv, NULL, "Print the results of the last run as CSV", cmd_loadgen_csv),
+	SHELL_SUBCMD_SET_END
+);
+
+SHELL_CMD_REGISTER(loadgen, &sub_loadgen, "CoAP load generator", NULL);
@@ -0,0 +1,282 @@
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(lwm2m_client, LOG_LEVEL_DBG);
+
+#include <zephyr/kernel.h>
+#include <zephyr/net/lwm2m.h>
+#include <zephyr/sys/reboot.h>
+
+#include "events.h"
+#include "lwm2m_client.h"
+#if defined(CONFIG_APP_LWM2M_SEND)
+#include "lwm2m_send.h"
+#endif
+#if defined(CONFIG_APP_FW_UPDATE)
+#include "lwm2m_firmware.h"
+#endif
+#if defined(CONFIG_APP_LWM2M_THREAD_METRICS)
+#include "lwm2m_obj_thread.h"
+#endif
+#if defined(CONFIG_APP_SLEEPY)
+#include "sleepy.h"
+#endif
+
+#define CLIENT_MANUFACTURER "Arduino"
+#define CLIENT_MODEL_NUMBER "Nano 33 BLE"
+#define CLIENT_FIRMWARE_VER "1.0"
+
+#define SERVER_SSID 1
+
+// Fall back to the bridge address if no dedicated server is configured
+#define SERVER_URI (sizeof(CONFIG_APP_LWM2M_SERVER) > 1 ? CONFIG_APP_LWM2M_SERVER : \
+		    "coap://[" CONFIG_NET_CONFIG_PEER_IPV6_ADDR "]:5683")
+
+static struct lwm2m_ctx client_ctx;
+
+/* Uptime of the last successful registration or registration update */
+static int64_t last_update_ms;
+static atomic_t registered;
+/* Set once the objects are set up and may follow the light */
+static atomic_t started;
+
+#define LIGHT_THREAD_STACK_SIZE 1536
+#define LIGHT_THREAD_PRIORITY 7
+
+// The engine is a slow consumer, it follows the light from its own thread and
+// gets a copy of every published state, so quick changes are not collapsed
+ZBUS_MSG_SUBSCRIBER_DEFINE(lwm2m_light_sub);
+ZBUS_CHAN_ADD_OBS(light_chan, lwm2m_light_sub, 3);
+
+#if defined(CONFIG_ZBUS_MSG_SUBSCRIBER_BUF_ALLOC_STATIC)
+BUILD_ASSERT(sizeof(struct light_state) <= CONFIG_ZBUS_MSG_SUBSCRIBER_NET_BUF_STATIC_DATA_SIZE,
+	     "Light state does not fit into the message subscriber buffers");
+#endif
+
+#if defined(CONFIG_APP_SLEEPY)
+/**
+ * Callback invoked by the engine before it sends a message
+ * Registration updates, Send and confirmable notifications wait for a
+ * response, the node polls fast until it arrived
+ */
+static void set_socket_state(int fd, enum lwm2m_socket_states state)
+{
+	ARG_UNUSED(fd);
+
+	if (state == LWM2M_SOCKET_STATE_ONGOING || state == LWM2M_SOCKET_STATE_ONE_RESPONSE) {
+		sleepy_expect(CONFIG_COAP_INIT_ACK_TIMEOUT_MS * 2);
+	}
+}
+#endif
+
+/**
+ * Execute callback for the reboot resource of the device object
+ */
+static int device_reboot_cb(uint16_t obj_inst_id, uint8_t *args, uint16_t args_len)
+{
+	LOG_INF("Rebooting on request of the LwM2M server");
+	sys_reboot(SYS_REBOOT_COLD);
+
+	return 0;
+}
+
+/**
+ * Thread following the light channel
+ * Setting the values through the engine notifies the observers of both
+ * object views and adds a record to the time series cache. The states are
+ * mirrored in the order they were published, each of them once.
+ */
+static void light_thread(void *p1, void *p2, void *p3)
+{
+	const struct zbus_channel *chan;
+	struct light_state state;
+
+	while (zbus_sub_wait_msg(&lwm2m_light_sub, &chan, &state, K_FOREVER) == 0) {
+		if (!atomic_get(&started)) {
+			continue;
+		}
+
+		lwm2m_set_bool(&LWM2M_OBJ(ON_OFF_OBJECT_ID, 0, 1), state.on);
+
+#if defined(CONFIG_APP_LWM2M_IPSO_LIGHT_CONTROL)
+		lwm2m_set_bool(&LWM2M_OBJ(IPSO_OBJECT_LIGHT_CONTROL_ID, 0, 5850), state.on);
+		lwm2m_set_u8(&LWM2M_OBJ(IPSO_OBJECT_LIGHT_CONTROL_ID, 0, 5851), state.dimmer);
+#endif
+
+#if defined(CONFIG_APP_LWM2M_SEND)
+		// Only the state of object 42769 is cached
+		lwm2m_send_records_added(1);
+#endif
+	}
+}
+
+K_THREAD_DEFINE(lwm2m_light_tid, LIGHT_THREAD_STACK_SIZE, light_thread, NULL, NULL, NULL,
+		LIGHT_THREAD_PRIORITY, 0, 0);
+
+/**
+ * Function used to check whether an engine write comes from the application
+ * The engine calls the post write callbacks from the thread setting the
+ * value, the light thread is the only one mirroring the light into it
+ */
+bool lwm2m_client_is_app_write(void)
+{
+	return k_current_get() == lwm2m_light_tid;
+}
+
+/**
+ * Callback function for the events of the registration client
+ */
+static void rd_client_event(struct lwm2m_ctx *client, enum lwm2m_rd_client_event client_event)
+{
+	switch (client_event) {
+	case LWM2M_RD_CLIENT_EVENT_REGISTRATION_COMPLETE:
+		LOG_INF("Registration complete");
+		last_update_ms = k_uptime_get();
+		atomic_set(&registered, 1);
+		break;
+	case LWM2M_RD_CLIENT_EVENT_REG_UPDATE_COMPLETE:
+		LOG_DBG("Registration update complete");
+		last_update_ms = k_uptime_get();
+		break;
+	case LWM2M_RD_CLIENT_EVENT_REGISTRATION_FAILURE:
+		LOG_ERR("Registration failure");
+		atomic_set(&registered, 0);
+		break;
+	case LWM2M_RD_CLIENT_EVENT_REG_TIMEOUT:
+		LOG_WRN("Registration timeout");
+		atomic_set(&registered, 0);
+		break;
+	case LWM2M_RD_CLIENT_EVENT_DISCONNECT:
+		LOG_INF("Disconnected");
+		atomic_set(&registered, 0);
+		break;
+	case LWM2M_RD_CLIENT_EVENT_QUEUE_MODE_RX_OFF:
+		// Listen window closed, the server queues its operations until the next uplink
+		LOG_DBG("Queue mode listen window closed");
+		break;
+	case LWM2M_RD_CLIENT_EVENT_NETWORK_ERROR:
+		LOG_ERR("Network error");
+		atomic_set(&registered, 0);
+		break;
+	default:
+		break;
+	}
+}
+
+/**
+ * Function used to set up the security, server and device objects
+ */
+static int lwm2m_setup(void)
+{
+	int ret;
+
+	// Security object: plain CoAP server, no bootstrap
+	ret = lwm2m_set_string(&LWM2M_OBJ(0, 0, 0), SERVER_URI);
+	if (ret < 0) {
+		return ret;
+	}
+	lwm2m_set_u8(&LWM2M_OBJ(0, 0, 2), 3);
+	lwm2m_set_u16(&LWM2M_OBJ(0, 0, 10), SERVER_SSID);
+
+	// Server object
+	lwm2m_set_u16(&LWM2M_OBJ(1, 0, 0), SERVER_SSID);
+	lwm2m_set_u32(&LWM2M_OBJ(1, 0, 1), CONFIG_LWM2M_ENGINE_DEFAULT_LIFETIME);
+
+	// Device object
+	lwm2m_set_res_buf(&LWM2M_OBJ(3, 0, 0), CLIENT_MANUFACTURER, sizeof(CLIENT_MANUFACTURER),
+			  sizeof(CLIENT_MANUFACTURER), LWM2M_RES_DATA_FLAG_RO);
+	lwm2m_set_res_buf(&LWM2M_OBJ(3, 0, 1), CLIENT_MODEL_NUMBER, sizeof(CLIENT_MODEL_NUMBER),
+			  sizeof(CLIENT_MODEL_NUMBER), LWM2M_RES_DATA_FLAG_RO);
+	lwm2m_set_res_buf(&LWM2M_OBJ(3, 0, 3), CLIENT_FIRMWARE_VER, sizeof(CLIENT_FIRMWARE_VER),
+			  sizeof(CLIENT_FIRMWARE_VER), LWM2M_RES_DATA_FLAG_RO);
+	lwm2m_register_exec_callback(&LWM2M_OBJ(3, 0, 4), device_reboot_cb);
+
+	return 0;
+}
+
+/**
+ * Function used to initialize the LwM2M client and start the registration
+ */
+int init_lwm2m_client(void)
+{
+	int ret;
+
+	ret = lwm2m_setup();
+	if (ret < 0) {
+		LOG_ERR("Cannot setup LwM2M fields (%d)", ret);
+		return ret;
+	}
+
+#if defined(CONFIG_APP_FW_UPDATE)
+	ret = init_lwm2m_firmware();
+	if (ret < 0) {
+		LOG_ERR("Firmware update not available (%d)", ret);
+	}
+#endif
+
+#if defined(CONFIG_APP_LWM2M_SEND)
+	ret = init_lwm2m_send(&client_ctx);
+	if (ret < 0) {
+		return ret;
+	}
+#endif
+
+#if defined(CONFIG_APP_LWM2M_THREAD_METRICS)
+	ret = init_lwm2m_thread_metrics();
+	if (ret < 0) {
+		LOG_ERR("Thread metrics not available (%d)", ret);
+	}
+#endif
+
+	atomic_set(&started, 1);
+
+#if defined(CONFIG_APP_SLEEPY)
+	client_ctx.set_socket_state = set_socket_state;
+#endif
+
+	ret = lwm2m_rd_client_start(&client_ctx, CONFIG_APP_LWM2M_ENDPOINT, 0,
+				    rd_client_event, NULL);
+	if (ret < 0) {
+		LOG_ERR("Cannot start the registration client (%d)", ret);
+		return ret;
+	}
+
+	LOG_INF("Registering as %s with %s", CONFIG_APP_LWM2M_ENDPOINT, SERVER_URI);
+
+	return 0;
+}
+
+/**
+ * Function used to announce an uplink to the LwM2M client
+ * Once the configured share of the lifetime has passed, the registration
+ * update is triggered right away instead of waiting for the engine to wake
+ * the radio for it on its own shortly before the lifetime expires
+ * In queue mode every uplink sends the update, it tells the server that the
+ * node is listening and opens the listen window for the queued operations
+ * The cached records are pushed with every uplink
+ */
+void lwm2m_client_uplink_hint(void)
+{
+	int64_t threshold_ms = (int64_t)CONFIG_LWM2M_ENGINE_DEFAULT_LIFETIME * MSEC_PER_SEC *
+			       CONFIG_APP_LWM2M_UPDATE_PIGGYBACK_PERCENT / 100;
+
+	if (!atomic_get(&registered)) {
+		return;
+	}
+
+#if defined(CONFIG_APP_LWM2M_SEND)
+	// Push the cached records while the radio is awake
+	(void)lwm2m_send_flush();
+#endif
+
+	if (IS_ENABLED(CONFIG_LWM2M_QUEUE_MODE_ENABLED)) {
+#if defined(CONFIG_APP_SLEEPY)
+		// The link mode stays sleepy, polling fast drains the queued operations
+		sleepy_expect(CONFIG_LWM2M_QUEUE_MODE_UPTIME * MSEC_PER_SEC);
+#endif
+	} else if (k_uptime_get() - last_update_ms < threshold_ms) {
+		return;
+	}
+
+	LOG_DBG("Piggybacking registration update on uplink");
+	last_update_ms = k_uptime_get();
+	lwm2m_rd_client_update();
+}
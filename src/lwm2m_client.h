@@ -0,0 +1,27 @@
+#ifndef __LWM2M_CLIENT_H__
+#define __LWM2M_CLIENT_H__
+
+#include <stdbool.h>
+
+#define ON_OFF_OBJECT_ID 42769
+
+/**
+ * Function used to initialize the LwM2M client and start the registration
+ */
+int init_lwm2m_client(void);
+
+/**
+ * Function used to announce an uplink to the LwM2M client
+ * A pending registration update is sent along with it, so the radio is
+ * woken up once instead of twice
+ */
+void lwm2m_client_uplink_hint(void);
+
+/**
+ * Function used to check whether an engine write comes from the application
+ * Post write callbacks run for the values the light thread mirrors into the
+ * engine as well, those must not be applied to the light again
+ */
+bool lwm2m_client_is_app_write(void);
+
+#endif
@@ -0,0 +1,175 @@
+/*
+ * Firmware update object 5 backed by fw_download.c
+ * Writing a coap:// URI to the Package URI resource starts the pull, an
+ * empty URI cancels it. Executing Update boots into the downloaded image.
+ */
+
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(lwm2m_firmware, LOG_LEVEL_DBG);
+
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/net/lwm2m.h>
+#include <zephyr/sys/reboot.h>
+#if defined(CONFIG_MCUBOOT_IMG_MANAGER)
+#include <zephyr/dfu/mcuboot.h>
+#endif
+
+#include "lwm2m_obj_firmware.h"
+
+#include "fw_download.h"
+#include "lwm2m_firmware.h"
+
+#define FW_URI_MAX_LEN 128
+
+/* Give the engine time to acknowledge the Update before rebooting */
+#define REBOOT_DELAY K_SECONDS(2)
+
+static void reboot_work_handler(struct k_work *work)
+{
+	ARG_UNUSED(work);
+
+	LOG_INF("Rebooting into the new image");
+	sys_reboot(SYS_REBOOT_WARM);
+}
+
+static K_WORK_DELAYABLE_DEFINE(reboot_work, reboot_work_handler);
+
+/**
+ * Function used to translate a download error into an update result
+ */
+static uint8_t error_to_result(int err)
+{
+	switch (err) {
+	case -EINVAL:
+		return RESULT_INVALID_URI;
+	case -EPROTONOSUPPORT:
+		return RESULT_UNSUP_PROTO;
+	case -ENOSPC:
+		return RESULT_NO_STORAGE;
+	case -ENOMEM:
+		return RESULT_OUT_OF_MEM;
+	case -EBADMSG:
+		return RESULT_UNSUP_FW;
+	case -ETIMEDOUT:
+	case -ENOENT:
+		return RESULT_CONNECTION_LOST;
+	default:
+		return RESULT_UPDATE_FAILED;
+	}
+}
+
+/**
+ * Callback function invoked when a download finished or failed
+ */
+static void download_cb(enum fw_download_evt evt, int err)
+{
+	switch (evt) {
+	case FW_DOWNLOAD_EVT_DONE:
+		lwm2m_firmware_set_update_state(STATE_DOWNLOADED);
+		break;
+	case FW_DOWNLOAD_EVT_ERROR:
+		LOG_ERR("Firmware download failed (%d)", err);
+		lwm2m_firmware_set_update_result(error_to_result(err));
+		break;
+	}
+}
+
+/**
+ * Post write callback for the Package URI resource
+ */
+static int package_uri_write_cb(uint16_t obj_inst_id, uint16_t res_id, uint16_t res_inst_id,
+				uint8_t *data, uint16_t data_len, bool last_block,
+				size_t total_size, size_t offset)
+{
+	char uri[FW_URI_MAX_LEN];
+	int ret;
+
+	// Strings may arrive with or without their terminator
+	data_len = strnlen((char *)data, data_len);
+	if (data_len == 0) {
+		LOG_INF("Firmware download cancelled");
+		fw_download_cancel();
+		lwm2m_firmware_set_update_state(STATE_IDLE);
+		return 0;
+	}
+
+	if (data_len >= sizeof(uri)) {
+		lwm2m_firmware_set_update_result(RESULT_INVALID_URI);
+		return -EINVAL;
+	}
+
+	memcpy(uri, data, data_len);
+	uri[data_len] = '\0';
+
+	ret = fw_download_start(uri);
+	if (ret < 0) {
+		lwm2m_firmware_set_update_result(error_to_result(ret));
+		return ret;
+	}
+
+	lwm2m_firmware_set_update_state(STATE_DOWNLOADING);
+
+	return 0;
+}
+
+/**
+ * Execute callback for the Update resource
+ */
+static int update_cb(uint16_t obj_inst_id, uint8_t *args, uint16_t args_len)
+{
+	int ret;
+
+	if (lwm2m_firmware_get_update_state() != STATE_DOWNLOADED) {
+		return -EPERM;
+	}
+
+	lwm2m_firmware_set_update_state(STATE_UPDATING);
+
+	ret = fw_download_apply();
+	if (ret < 0) {
+		LOG_ERR("Cannot mark the image for update (%d)", ret);
+		lwm2m_firmware_set_update_result(RESULT_UPDATE_FAILED);
+		return ret;
+	}
+
+	k_work_schedule(&reboot_work, REBOOT_DELAY);
+
+	return 0;
+}
+
+/**
+ * Function used to connect the firmware update object to the download
+ */
+int init_lwm2m_firmware(void)
+{
+	int ret;
+
+#if defined(CONFIG_MCUBOOT_IMG_MANAGER)
+	// The first boot of an image that was tested by MCUboot makes it permanent
+	if (!boot_is_img_confirmed()) {
+		ret = boot_write_img_confirmed();
+		if (ret < 0) {
+			LOG_ERR("Cannot confirm the image (%d)", ret);
+		} else {
+			LOG_INF("Firmware update confirmed");
+			lwm2m_firmware_set_update_result(RESULT_SUCCESS);
+		}
+	}
+#endif
+
+	lwm2m_register_post_write_callback(&LWM2M_OBJ(5, 0, 1), package_uri_write_cb);
+	lwm2m_firmware_set_update_cb(update_cb);
+
+	ret = init_fw_download(download_cb);
+	if (ret < 0) {
+		LOG_ERR("Cannot initialize the firmware download (%d)", ret);
+		return ret;
+	}
+
+	if (ret > 0) {
+		lwm2m_firmware_set_update_state(STATE_DOWNLOADING);
+	}
+
+	return 0;
+}
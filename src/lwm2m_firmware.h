@@ -0,0 +1,10 @@
+#ifndef __LWM2M_FIRMWARE_H__
+#define __LWM2M_FIRMWARE_H__
+
+/**
+ * Function used to connect the firmware update object to the download
+ * Confirms a freshly updated image and resumes an interrupted download
+ */
+int init_lwm2m_firmware(void);
+
+#endif
@@ -0,0 +1,193 @@
+/*
+ * IPSO Light Control object 3311
+ * Standard view on the light next to the custom object 42769, both read
+ * and write the store of light.c so there is no second copy of the state
+ */
+
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(lwm2m_obj_light_control, LOG_LEVEL_DBG);
+
+#include <string.h>
+#include <zephyr/net/lwm2m.h>
+
+#include "lwm2m_object.h"
+#include "lwm2m_engine.h"
+
+#include "light.h"
+#include "lwm2m_client.h"
+
+#define LIGHT_CONTROL_VERSION_MAJOR 1
+#define LIGHT_CONTROL_VERSION_MINOR 0
+
+#define LIGHT_CONTROL_ON_OFF_RID 5850
+#define LIGHT_CONTROL_DIMMER_RID 5851
+#define LIGHT_CONTROL_ON_TIME_RID 5852
+#define LIGHT_CONTROL_CUMULATIVE_ACTIVE_POWER_RID 5805
+#define LIGHT_CONTROL_POWER_FACTOR_RID 5820
+#define LIGHT_CONTROL_COLOUR_RID 5706
+#define LIGHT_CONTROL_SENSOR_UNITS_RID 5701
+
+#define LIGHT_CONTROL_MAX_ID 7
+
+#define LIGHT_CONTROL_STRING_SIZE 16
+
+/* Energy store unit is mW*ms, the resource unit is Wh */
+#define MW_MS_PER_WH 3600000000.0
+
+static struct lwm2m_engine_obj light_control_obj;
+static struct lwm2m_engine_obj_field fields[] = {
+	OBJ_FIELD_DATA(LIGHT_CONTROL_ON_OFF_RID, RW, BOOL),
+	OBJ_FIELD_DATA(LIGHT_CONTROL_DIMMER_RID, RW_OPT, U8),
+	OBJ_FIELD_DATA(LIGHT_CONTROL_ON_TIME_RID, RW_OPT, S64),
+	OBJ_FIELD_DATA(LIGHT_CONTROL_CUMULATIVE_ACTIVE_POWER_RID, R_OPT, FLOAT),
+	OBJ_FIELD_DATA(LIGHT_CONTROL_POWER_FACTOR_RID, R_OPT, FLOAT),
+	OBJ_FIELD_DATA(LIGHT_CONTROL_COLOUR_RID, RW_OPT, STRING),
+	OBJ_FIELD_DATA(LIGHT_CONTROL_SENSOR_UNITS_RID, R_OPT, STRING),
+};
+
+static struct lwm2m_engine_obj_inst inst;
+static struct lwm2m_engine_res res[LIGHT_CONTROL_MAX_ID];
+static struct lwm2m_engine_res_inst res_inst[LIGHT_CONTROL_MAX_ID];
+
+/*
+ * Exchange buffers for the engine, filled from the light store on read and
+ * applied to it after a write
+ */
+static bool on_off;
+static uint8_t dimmer;
+static int64_t on_time;
+static double cumulative_active_power;
+static double power_factor = 1.0;
+static char colour[LIGHT_CONTROL_STRING_SIZE] = "White";
+static char sensor_units[LIGHT_CONTROL_STRING_SIZE] = "Wh";
+
+/**
+ * Read callback for the resources backed by the light store
+ */
+static void *light_read_cb(uint16_t obj_inst_id, uint16_t res_id, uint16_t res_inst_id,
+			   size_t *data_len)
+{
+	struct light_state state;
+
+	light_get_state(&state);
+
+	switch (res_id) {
+	case LIGHT_CONTROL_ON_OFF_RID:
+		on_off = state.on;
+		*data_len = sizeof(on_off);
+		return &on_off;
+	case LIGHT_CONTROL_DIMMER_RID:
+		dimmer = state.dimmer;
+		*data_len = sizeof(dimmer);
+		return &dimmer;
+	case LIGHT_CONTROL_ON_TIME_RID:
+		on_time = state.on_time_ms / MSEC_PER_SEC;
+		*data_len = sizeof(on_time);
+		return &on_time;
+	case LIGHT_CONTROL_CUMULATIVE_ACTIVE_POWER_RID:
+		cumulative_active_power = state.energy_mw_ms / MW_MS_PER_WH;
+		*data_len = sizeof(cumulative_active_power);
+		return &cumulative_active_power;
+	default:
+		*data_len = 0;
+		return NULL;
+	}
+}
+
+/**
+ * Post write callback for the resources backed by the light store
+ * Values set by the application through the engine come back here as well,
+ * they are a snapshot of the store that may be outdated and are ignored
+ */
+static int light_post_write_cb(uint16_t obj_inst_id, uint16_t res_id, uint16_t res_inst_id,
+			       uint8_t *data, uint16_t data_len, bool last_block,
+			       size_t total_size, size_t offset)
+{
+	if (lwm2m_client_is_app_write()) {
+		return 0;
+	}
+
+	switch (res_id) {
+	case LIGHT_CONTROL_ON_OFF_RID:
+		return light_set(on_off);
+	case LIGHT_CONTROL_DIMMER_RID:
+		return light_set_dimmer(dimmer);
+	case LIGHT_CONTROL_ON_TIME_RID:
+		// Writing 0 resets the counter, other values are not meaningful
+		if (on_time != 0) {
+			return -EINVAL;
+		}
+		light_reset_on_time();
+		return 0;
+	default:
+		return 0;
+	}
+}
+
+/**
+ * Create callback for the single instance of the object
+ */
+static struct lwm2m_engine_obj_inst *light_control_create(uint16_t obj_inst_id)
+{
+	int i = 0, j = 0;
+
+	if (inst.obj) {
+		LOG_ERR("Can not create instance - already existing: %u", obj_inst_id);
+		return NULL;
+	}
+
+	(void)memset(res, 0, sizeof(res));
+	init_res_instance(res_inst, ARRAY_SIZE(res_inst));
+
+	INIT_OBJ_RES(LIGHT_CONTROL_ON_OFF_RID, res, i, res_inst, j, 1, false, true,
+		     &on_off, sizeof(on_off), light_read_cb, NULL, NULL, light_post_write_cb,
+		     NULL);
+	INIT_OBJ_RES(LIGHT_CONTROL_DIMMER_RID, res, i, res_inst, j, 1, false, true,
+		     &dimmer, sizeof(dimmer), light_read_cb, NULL, NULL, light_post_write_cb,
+		     NULL);
+	INIT_OBJ_RES(LIGHT_CONTROL_ON_TIME_RID, res, i, res_inst, j, 1, false, true,
+		     &on_time, sizeof(on_time), light_read_cb, NULL, NULL, light_post_write_cb,
+		     NULL);
+	INIT_OBJ_RES(LIGHT_CONTROL_CUMULATIVE_ACTIVE_POWER_RID, res, i, res_inst, j, 1, false,
+		     true, &cumulative_active_power, sizeof(cumulative_active_power),
+		     light_read_cb, NULL, NULL, NULL, NULL);
+	INIT_OBJ_RES_DATA(LIGHT_CONTROL_POWER_FACTOR_RID, res, i, res_inst, j,
+			  &power_factor, sizeof(power_factor));
+	INIT_OBJ_RES_DATA_LEN(LIGHT_CONTROL_COLOUR_RID, res, i, res_inst, j,
+			      colour, sizeof(colour), strlen(colour) + 1);
+	INIT_OBJ_RES_DATA_LEN(LIGHT_CONTROL_SENSOR_UNITS_RID, res, i, res_inst, j,
+			      sensor_units, sizeof(sensor_units), strlen(sensor_units) + 1);
+
+	inst.resources = res;
+	inst.resource_count = i;
+
+	return &inst;
+}
+
+/**
+ * Function used to register the object and its single instance with the engine
+ */
+static int light_control_init(void)
+{
+	struct lwm2m_engine_obj_inst *obj_inst = NULL;
+	int ret;
+
+	light_control_obj.obj_id = IPSO_OBJECT_LIGHT_CONTROL_ID;
+	light_control_obj.version_major = LIGHT_CONTROL_VERSION_MAJOR;
+	light_control_obj.version_minor = LIGHT_CONTROL_VERSION_MINOR;
+	light_control_obj.is_core = false;
+	light_control_obj.fields = fields;
+	light_control_obj.field_count = ARRAY_SIZE(fields);
+	light_control_obj.max_instance_count = 1U;
+	light_control_obj.create_cb = light_control_create;
+	lwm2m_register_obj(&light_control_obj);
+
+	ret = lwm2m_create_obj_inst(IPSO_OBJECT_LIGHT_CONTROL_ID, 0, &obj_inst);
+	if (ret < 0) {
+		LOG_ERR("Create light control object instance error: %d", ret);
+	}
+
+	return ret;
+}
+
+LWM2M_OBJ_INIT(light_control_init);
@@ -0,0 +1,146 @@
+/*
+ * LwM2M representation of the custom on/off object 42769
+ * Resource 1 holds the state, resources 2 to 4 switch the light on, off
+ * or toggle it, the same as the plain CoAP resources of coap_server.c
+ */
+
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(lwm2m_obj_on_off, LOG_LEVEL_DBG);
+
+#include <string.h>
+#include <zephyr/net/lwm2m.h>
+
+#include "lwm2m_object.h"
+#include "lwm2m_engine.h"
+
+#include "light.h"
+#include "lwm2m_client.h"
+
+#define ON_OFF_VERSION_MAJOR 1
+#define ON_OFF_VERSION_MINOR 0
+
+#define ON_OFF_STATE_RID 1
+#define ON_OFF_ON_RID 2
+#define ON_OFF_OFF_RID 3
+#define ON_OFF_SWITCH_RID 4
+#define ON_OFF_MAX_ID 4
+
+static struct lwm2m_engine_obj on_off_obj;
+static struct lwm2m_engine_obj_field fields[] = {
+	OBJ_FIELD_DATA(ON_OFF_STATE_RID, RW, BOOL),
+	OBJ_FIELD_EXECUTE(ON_OFF_ON_RID),
+	OBJ_FIELD_EXECUTE(ON_OFF_OFF_RID),
+	OBJ_FIELD_EXECUTE(ON_OFF_SWITCH_RID),
+};
+
+static struct lwm2m_engine_obj_inst inst;
+static struct lwm2m_engine_res res[ON_OFF_MAX_ID];
+static struct lwm2m_engine_res_inst res_inst[ON_OFF_MAX_ID];
+
+static bool state;
+
+/**
+ * Read callback for the state resource
+ */
+static void *state_read_cb(uint16_t obj_inst_id, uint16_t res_id, uint16_t res_inst_id,
+			   size_t *data_len)
+{
+	state = light_get();
+	*data_len = sizeof(state);
+
+	return &state;
+}
+
+/**
+ * Post write callback for the state resource
+ */
+static int state_post_write_cb(uint16_t obj_inst_id, uint16_t res_id, uint16_t res_inst_id,
+			       uint8_t *data, uint16_t data_len, bool last_block,
+			       size_t total_size, size_t offset)
+{
+	// The light thread mirrors a snapshot of the light, it may be outdated by now
+	if (lwm2m_client_is_app_write()) {
+		return 0;
+	}
+
+	return light_set(state);
+}
+
+/**
+ * Execute callback for the on resource
+ */
+static int on_execute_cb(uint16_t obj_inst_id, uint8_t *args, uint16_t args_len)
+{
+	return light_set(true);
+}
+
+/**
+ * Execute callback for the off resource
+ */
+static int off_execute_cb(uint16_t obj_inst_id, uint8_t *args, uint16_t args_len)
+{
+	return light_set(false);
+}
+
+/**
+ * Execute callback for the switch resource
+ */
+static int switch_execute_cb(uint16_t obj_inst_id, uint8_t *args, uint16_t args_len)
+{
+	return light_toggle();
+}
+
+/**
+ * Create callback for the single instance of the object
+ */
+static struct lwm2m_engine_obj_inst *on_off_create(uint16_t obj_inst_id)
+{
+	int i = 0, j = 0;
+
+	if (inst.obj) {
+		LOG_ERR("Can not create instance - already existing: %u", obj_inst_id);
+		return NULL;
+	}
+
+	(void)memset(res, 0, sizeof(res));
+	init_res_instance(res_inst, ARRAY_SIZE(res_inst));
+
+	INIT_OBJ_RES(ON_OFF_STATE_RID, res, i, res_inst, j, 1, false, true,
+		     &state, sizeof(state), state_read_cb, NULL, NULL, state_post_write_cb, NULL);
+	INIT_OBJ_RES_EXECUTE(ON_OFF_ON_RID, res, i, on_execute_cb);
+	INIT_OBJ_RES_EXECUTE(ON_OFF_OFF_RID, res, i, off_execute_cb);
+	INIT_OBJ_RES_EXECUTE(ON_OFF_SWITCH_RID, res, i, switch_execute_cb);
+
+	inst.resources = res;
+	inst.resource_count = i;
+
+	return &inst;
+}
+
+/**
+ * Function used to register the object and its single instance with the engine
+ */
+static int on_off_init(void)
+{
+	struct lwm2m_engine_obj_inst *obj_inst = NULL;
+	int ret;
+
+	on_off_obj.obj_id = ON_OFF_OBJECT_ID;
+	on_off_obj.version_major = ON_OFF_VERSION_MAJOR;
+	on_off_obj.version_minor = ON_OFF_VERSION_MINOR;
+	on_off_obj.is_core = false;
+	on_off_obj.fields = fields;
+	on_off_obj.field_count = ARRAY_SIZE(fields);
+	on_off_obj.max_instance_count = 1U;
+	on_off_obj.create_cb = on_off_create;
+	lwm2m_register_obj(&on_off_obj);
+
+	ret = lwm2m_create_obj_inst(ON_OFF_OBJECT_ID, 0, &obj_inst);
+	if (ret < 0) {
+		LOG_ERR("Create on/off object instance error: %d", ret);
+	}
+
+	return ret;
+}
+
+LWM2M_OBJ_INIT(on_off_init);
@@ -0,0 +1,355 @@
+/*
+ * Thread link metrics
+ * Exposes the parent link, partition and the MAC and MLE counters of
+ * OpenThread as vendor object 42771 and fills the radio related resources
+ * of the Connectivity Monitoring object 4. All values are sampled when they
+ * are read, nothing is polled in the background. A small set of them is
+ * sampled periodically into the time series cache and reported in batches
+ * through the Send operation.
+ */
+
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(lwm2m_obj_thread, LOG_LEVEL_DBG);
+
+#include <string.h>
+#include <zephyr/net/lwm2m.h>
+#include <zephyr/net/net_if.h>
+#include <zephyr/net/openthread.h>
+#include <openthread/thread.h>
+#include <openthread/link.h>
+#include <openthread/platform/radio.h>
+
+#include "lwm2m_object.h"
+#include "lwm2m_engine.h"
+
+#include "lwm2m_obj_thread.h"
+#if defined(CONFIG_APP_LWM2M_SEND)
+#include "lwm2m_send.h"
+#endif
+
+#define THREAD_METRICS_VERSION_MAJOR 1
+#define THREAD_METRICS_VERSION_MINOR 0
+#define THREAD_METRICS_MAX_ID 13
+
+#define THREAD_METRICS_ROLE_LEN 10
+
+/* Connectivity Monitoring object 4 */
+#define CONNMON_NETWORK_BEARER_RID 0
+#define CONNMON_AVAILABLE_BEARER_RID 1
+#define CONNMON_RADIO_SIGNAL_STRENGTH_RID 2
+#define CONNMON_LINK_QUALITY_RID 3
+#define CONNMON_IP_ADDRESSES_RID 4
+/* Network bearer IEEE 802.15.4 */
+#define CONNMON_BEARER_802_15_4 23
+
+/**
+ * Snapshot of the metrics
+ */
+struct thread_metrics {
+	int8_t rssi;
+	int8_t link_margin;
+	uint16_t parent_rloc16;
+	uint32_t partition_id;
+	char role[THREAD_METRICS_ROLE_LEN];
+	uint32_t mac_tx_total;
+	uint32_t mac_tx_retry;
+	uint32_t mac_tx_err_cca;
+	uint32_t mac_rx_total;
+	uint32_t mac_rx_err;
+	uint32_t mle_attach_attempts;
+	uint32_t mle_parent_changes;
+	uint32_t mle_partition_changes;
+	/* Values of the Connectivity Monitoring object */
+	int16_t signal_strength;
+	int16_t link_quality;
+	char ip_address[NET_IPV6_ADDR_LEN];
+};
+
+/*
+ * Buffers of the engine, refreshed by the read callbacks on the engine
+ * thread only, the periodic report samples into its own snapshot
+ */
+static struct thread_metrics metrics;
+
+static struct lwm2m_engine_obj thread_obj;
+static struct lwm2m_engine_obj_field fields[] = {
+	OBJ_FIELD_DATA(THREAD_METRICS_RSSI_RID, R, S8),
+	OBJ_FIELD_DATA(THREAD_METRICS_LINK_MARGIN_RID, R, S8),
+	OBJ_FIELD_DATA(THREAD_METRICS_PARENT_RLOC16_RID, R, U16),
+	OBJ_FIELD_DATA(THREAD_METRICS_PARTITION_ID_RID, R, U32),
+	OBJ_FIELD_DATA(THREAD_METRICS_ROLE_RID, R, STRING),
+	OBJ_FIELD_DATA(THREAD_METRICS_MAC_TX_TOTAL_RID, R, U32),
+	OBJ_FIELD_DATA(THREAD_METRICS_MAC_TX_RETRY_RID, R, U32),
+	OBJ_FIELD_DATA(THREAD_METRICS_MAC_TX_ERR_CCA_RID, R, U32),
+	OBJ_FIELD_DATA(THREAD_METRICS_MAC_RX_TOTAL_RID, R, U32),
+	OBJ_FIELD_DATA(THREAD_METRICS_MAC_RX_ERR_RID, R, U32),
+	OBJ_FIELD_DATA(THREAD_METRICS_MLE_ATTACH_ATTEMPTS_RID, R, U32),
+	OBJ_FIELD_DATA(THREAD_METRICS_MLE_PARENT_CHANGES_RID, R, U32),
+	OBJ_FIELD_DATA(THREAD_METRICS_MLE_PARTITION_CHANGES_RID, R, U32),
+};
+
+static struct lwm2m_engine_obj_inst inst;
+static struct lwm2m_engine_res res[THREAD_METRICS_MAX_ID];
+static struct lwm2m_engine_res_inst res_inst[THREAD_METRICS_MAX_ID];
+
+/**
+ * Function used to sample all metrics from the OpenThread instance
+ */
+static void sample(struct thread_metrics *out)
+{
+	struct openthread_context *ot_context = openthread_get_default_context();
+	otInstance *instance = ot_context->instance;
+	const otMacCounters *mac;
+	const otMleCounters *mle;
+	otRouterInfo parent;
+	int8_t rssi = OT_RADIO_RSSI_INVALID;
+	struct net_if *iface = NULL;
+	struct in6_addr *addr;
+
+	openthread_api_mutex_lock(ot_context);
+
+	if (otThreadGetParentAverageRssi(instance, &rssi) != OT_ERROR_NONE) {
+		rssi = OT_RADIO_RSSI_INVALID;
+	}
+
+	memset(&parent, 0, sizeof(parent));
+	(void)otThreadGetParentInfo(instance, &parent);
+
+	out->rssi = rssi;
+	out->link_margin = rssi == OT_RADIO_RSSI_INVALID ? 0 :
+			   MAX(rssi - otPlatRadioGetReceiveSensitivity(instance), 0);
+	out->parent_rloc16 = parent.mRloc16;
+	out->partition_id = otThreadGetPartitionId(instance);
+	strncpy(out->role, otThreadDeviceRoleToString(otThreadGetDeviceRole(instance)),
+		sizeof(out->role) - 1);
+
+	mac = otLinkGetCounters(instance);
+	out->mac_tx_total = mac->mTxTotal;
+	out->mac_tx_retry = mac->mTxRetry;
+	out->mac_tx_err_cca = mac->mTxErrCca;
+	out->mac_rx_total = mac->mRxTotal;
+	out->mac_rx_err = mac->mRxErrNoFrame + mac->mRxErrUnknownNeighbor +
+			  mac->mRxErrInvalidSrcAddr + mac->mRxErrSec + mac->mRxErrFcs +
+			  mac->mRxErrOther;
+
+	mle = otThreadGetMleCounters(instance);
+	out->mle_attach_attempts = mle->mAttachAttempts;
+	out->mle_parent_changes = mle->mParentChanges;
+	out->mle_partition_changes = mle->mPartitionIdChanges;
+
+	openthread_api_mutex_unlock(ot_context);
+
+	out->signal_strength = out->rssi;
+	out->link_quality = parent.mLinkQualityIn;
+
+	addr = net_if_ipv6_get_global_addr(NET_ADDR_PREFERRED, &iface);
+	if (addr == NULL || net_addr_ntop(AF_INET6, addr, out->ip_address,
+					  sizeof(out->ip_address)) == NULL) {
+		out->ip_address[0] = '\0';
+	}
+}
+
+/**
+ * Function used to find the snapshot field of a vendor object resource
+ */
+static void *metric_ptr(uint16_t res_id, size_t *len)
+{
+	switch (res_id) {
+	case THREAD_METRICS_RSSI_RID:
+		*len = sizeof(metrics.rssi);
+		return &metrics.rssi;
+	case THREAD_METRICS_LINK_MARGIN_RID:
+		*len = sizeof(metrics.link_margin);
+		return &metrics.link_margin;
+	case THREAD_METRICS_PARENT_RLOC16_RID:
+		*len = sizeof(metrics.parent_rloc16);
+		return &metrics.parent_rloc16;
+	case THREAD_METRICS_PARTITION_ID_RID:
+		*len = sizeof(metrics.partition_id);
+		return &metrics.partition_id;
+	case THREAD_METRICS_ROLE_RID:
+		*len = strlen(metrics.role);
+		return metrics.role;
+	case THREAD_METRICS_MAC_TX_TOTAL_RID:
+		*len = sizeof(metrics.mac_tx_total);
+		return &metrics.mac_tx_total;
+	case THREAD_METRICS_MAC_TX_RETRY_RID:
+		*len = sizeof(metrics.mac_tx_retry);
+		return &metrics.mac_tx_retry;
+	case THREAD_METRICS_MAC_TX_ERR_CCA_RID:
+		*len = sizeof(metrics.mac_tx_err_cca);
+		return &metrics.mac_tx_err_cca;
+	case THREAD_METRICS_MAC_RX_TOTAL_RID:
+		*len = sizeof(metrics.mac_rx_total);
+		return &metrics.mac_rx_total;
+	case THREAD_METRICS_MAC_RX_ERR_RID:
+		*len = sizeof(metrics.mac_rx_err);
+		return &metrics.mac_rx_err;
+	case THREAD_METRICS_MLE_ATTACH_ATTEMPTS_RID:
+		*len = sizeof(metrics.mle_attach_attempts);
+		return &metrics.mle_attach_attempts;
+	case THREAD_METRICS_MLE_PARENT_CHANGES_RID:
+		*len = sizeof(metrics.mle_parent_changes);
+		return &metrics.mle_parent_changes;
+	case THREAD_METRICS_MLE_PARTITION_CHANGES_RID:
+		*len = sizeof(metrics.mle_partition_changes);
+		return &metrics.mle_partition_changes;
+	default:
+		*len = 0;
+		return NULL;
+	}
+}
+
+/**
+ * Read callback for the resources of the vendor object
+ */
+static void *metric_read_cb(uint16_t obj_inst_id, uint16_t res_id, uint16_t res_inst_id,
+			    size_t *data_len)
+{
+	sample(&metrics);
+
+	return metric_ptr(res_id, data_len);
+}
+
+/**
+ * Read callback for the radio resources of the Connectivity Monitoring object
+ */
+static void *connmon_read_cb(uint16_t obj_inst_id, uint16_t res_id, uint16_t res_inst_id,
+			     size_t *data_len)
+{
+	sample(&metrics);
+
+	switch (res_id) {
+	case CONNMON_RADIO_SIGNAL_STRENGTH_RID:
+		*data_len = sizeof(metrics.signal_strength);
+		return &metrics.signal_strength;
+	case CONNMON_LINK_QUALITY_RID:
+		*data_len = sizeof(metrics.link_quality);
+		return &metrics.link_quality;
+	case CONNMON_IP_ADDRESSES_RID:
+		*data_len = strlen(metrics.ip_address);
+		return metrics.ip_address;
+	default:
+		*data_len = 0;
+		return NULL;
+	}
+}
+
+/**
+ * Create callback for the single instance of the object
+ */
+static struct lwm2m_engine_obj_inst *thread_create(uint16_t obj_inst_id)
+{
+	int i = 0, j = 0;
+
+	if (inst.obj) {
+		LOG_ERR("Can not create instance - already existing: %u", obj_inst_id);
+		return NULL;
+	}
+
+	(void)memset(res, 0, sizeof(res));
+	init_res_instance(res_inst, ARRAY_SIZE(res_inst));
+
+	for (uint16_t rid = 0; rid < THREAD_METRICS_MAX_ID; rid++) {
+		size_t len;
+		void *data = metric_ptr(rid, &len);
+
+		// The role is a string, its buffer is larger than its current length
+		if (rid == THREAD_METRICS_ROLE_RID) {
+			len = sizeof(metrics.role);
+		}
+
+		INIT_OBJ_RES(rid, res, i, res_inst, j, 1, false, true, data, len,
+			     metric_read_cb, NULL, NULL, NULL, NULL);
+	}
+
+	inst.resources = res;
+	inst.resource_count = i;
+
+	return &inst;
+}
+
+/**
+ * Function used to register the object and its single instance with the engine
+ */
+static int thread_metrics_init(void)
+{
+	struct lwm2m_engine_obj_inst *obj_inst = NULL;
+	int ret;
+
+	thread_obj.obj_id = THREAD_METRICS_OBJECT_ID;
+	thread_obj.version_major = THREAD_METRICS_VERSION_MAJOR;
+	thread_obj.version_minor = THREAD_METRICS_VERSION_MINOR;
+	thread_obj.is_core = false;
+	thread_obj.fields = fields;
+	thread_obj.field_count = ARRAY_SIZE(fields);
+	thread_obj.max_instance_count = 1U;
+	thread_obj.create_cb = thread_create;
+	lwm2m_register_obj(&thread_obj);
+
+	ret = lwm2m_create_obj_inst(THREAD_METRICS_OBJECT_ID, 0, &obj_inst);
+	if (ret < 0) {
+		LOG_ERR("Create Thread metrics object instance error: %d", ret);
+	}
+
+	return ret;
+}
+
+LWM2M_OBJ_INIT(thread_metrics_init);
+
+#if defined(CONFIG_APP_LWM2M_SEND)
+/**
+ * Work handler sampling the reported metrics into the time series cache
+ * The records leave with the next batch of the Send module
+ */
+static void report_handler(struct k_work *work)
+{
+	struct k_work_delayable *dwork = k_work_delayable_from_work(work);
+	struct thread_metrics snapshot;
+
+	// Not the engine buffers, the engine thread may read them concurrently
+	memset(&snapshot, 0, sizeof(snapshot));
+	sample(&snapshot);
+
+	lwm2m_set_s8(&LWM2M_OBJ(THREAD_METRICS_OBJECT_ID, 0, THREAD_METRICS_RSSI_RID),
+		     snapshot.rssi);
+	lwm2m_set_s8(&LWM2M_OBJ(THREAD_METRICS_OBJECT_ID, 0, THREAD_METRICS_LINK_MARGIN_RID),
+		     snapshot.link_margin);
+	lwm2m_set_u32(&LWM2M_OBJ(THREAD_METRICS_OBJECT_ID, 0, THREAD_METRICS_MAC_TX_RETRY_RID),
+		      snapshot.mac_tx_retry);
+	// One record per cached resource
+	lwm2m_send_records_added(3);
+
+	k_work_schedule(dwork, K_SECONDS(CONFIG_APP_LWM2M_THREAD_METRICS_REPORT_SEC));
+}
+
+static K_WORK_DELAYABLE_DEFINE(report_work, report_handler);
+#endif
+
+/**
+ * Function used to set up the Connectivity Monitoring object and to start
+ * the periodic metrics report
+ */
+int init_lwm2m_thread_metrics(void)
+{
+	int ret;
+
+	ret = lwm2m_set_u8(&LWM2M_OBJ(4, 0, CONNMON_NETWORK_BEARER_RID), CONNMON_BEARER_802_15_4);
+	if (ret < 0) {
+		return ret;
+	}
+	lwm2m_set_u8(&LWM2M_OBJ(4, 0, CONNMON_AVAILABLE_BEARER_RID, 0), CONNMON_BEARER_802_15_4);
+
+	lwm2m_register_read_callback(&LWM2M_OBJ(4, 0, CONNMON_RADIO_SIGNAL_STRENGTH_RID),
+				     connmon_read_cb);
+	lwm2m_register_read_callback(&LWM2M_OBJ(4, 0, CONNMON_LINK_QUALITY_RID),
+				     connmon_read_cb);
+	lwm2m_register_read_callback(&LWM2M_OBJ(4, 0, CONNMON_IP_ADDRESSES_RID),
+				     connmon_read_cb);
+
+#if defined(CONFIG_APP_LWM2M_SEND)
+	k_work_schedule(&report_work, K_SECONDS(CONFIG_APP_LWM2M_THREAD_METRICS_REPORT_SEC));
+#endif
+
+	return 0;
+}
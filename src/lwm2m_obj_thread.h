@@ -0,0 +1,26 @@
+#ifndef __LWM2M_OBJ_THREAD_H__
+#define __LWM2M_OBJ_THREAD_H__
+
+#define THREAD_METRICS_OBJECT_ID 42771
+
+#define THREAD_METRICS_RSSI_RID 0
+#define THREAD_METRICS_LINK_MARGIN_RID 1
+#define THREAD_METRICS_PARENT_RLOC16_RID 2
+#define THREAD_METRICS_PARTITION_ID_RID 3
+#define THREAD_METRICS_ROLE_RID 4
+#define THREAD_METRICS_MAC_TX_TOTAL_RID 5
+#define THREAD_METRICS_MAC_TX_RETRY_RID 6
+#define THREAD_METRICS_MAC_TX_ERR_CCA_RID 7
+#define THREAD_METRICS_MAC_RX_TOTAL_RID 8
+#define THREAD_METRICS_MAC_RX_ERR_RID 9
+#define THREAD_METRICS_MLE_ATTACH_ATTEMPTS_RID 10
+#define THREAD_METRICS_MLE_PARENT_CHANGES_RID 11
+#define THREAD_METRICS_MLE_PARTITION_CHANGES_RID 12
+
+/**
+ * Function used to set up the Connectivity Monitoring object and to start
+ * the periodic metrics report
+ */
+int init_lwm2m_thread_metrics(void);
+
+#endif
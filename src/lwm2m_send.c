@@ -0,0 +1,129 @@
+/*
+ * Batched LwM2M 1.1 Send of the on/off state and the Thread link metrics
+ * Every state change and every metrics sample is stored as timestamped
+ * record in the time series cache of the engine. The cache is pushed to the server as one SenML CBOR
+ * message once enough records are collected or the oldest record reached
+ * the maximum delay.
+ */
+
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(lwm2m_send, LOG_LEVEL_DBG);
+
+#include <zephyr/kernel.h>
+
+#include "lwm2m_client.h"
+#include "lwm2m_send.h"
+#if defined(CONFIG_APP_LWM2M_THREAD_METRICS)
+#include "lwm2m_obj_thread.h"
+#endif
+
+static struct lwm2m_ctx *client_ctx;
+
+static const struct lwm2m_obj_path send_paths[] = {
+	LWM2M_OBJ(ON_OFF_OBJECT_ID, 0, 1),
+#if defined(CONFIG_APP_LWM2M_THREAD_METRICS)
+	LWM2M_OBJ(THREAD_METRICS_OBJECT_ID, 0, THREAD_METRICS_RSSI_RID),
+	LWM2M_OBJ(THREAD_METRICS_OBJECT_ID, 0, THREAD_METRICS_LINK_MARGIN_RID),
+	LWM2M_OBJ(THREAD_METRICS_OBJECT_ID, 0, THREAD_METRICS_MAC_TX_RETRY_RID),
+#endif
+};
+
+/* One time series cache per pushed resource */
+static struct lwm2m_time_series_elem caches[ARRAY_SIZE(send_paths)]
+					   [CONFIG_APP_LWM2M_SEND_CACHE_SIZE];
+
+/* Records added since the last successful flush */
+static atomic_t pending;
+
+static void flush_work_handler(struct k_work *work);
+static K_WORK_DELAYABLE_DEFINE(flush_work, flush_work_handler);
+
+/**
+ * Callback function for the result of a Send operation
+ */
+static void send_reply_cb(enum lwm2m_send_status status)
+{
+	switch (status) {
+	case LWM2M_SEND_STATUS_SUCCESS:
+		LOG_DBG("Send acknowledged");
+		break;
+	case LWM2M_SEND_STATUS_TIMEOUT:
+		LOG_WRN("Send timed out");
+		break;
+	default:
+		LOG_ERR("Send failed");
+		break;
+	}
+}
+
+/**
+ * Callback function for the flush work item
+ */
+static void flush_work_handler(struct k_work *work)
+{
+	ARG_UNUSED(work);
+
+	(void)lwm2m_send_flush();
+}
+
+/**
+ * Function used to enable the time series cache of the pushed resources
+ */
+int init_lwm2m_send(struct lwm2m_ctx *ctx)
+{
+	int ret;
+
+	client_ctx = ctx;
+
+	for (size_t i = 0; i < ARRAY_SIZE(send_paths); i++) {
+		ret = lwm2m_enable_cache(&send_paths[i], caches[i], ARRAY_SIZE(caches[i]));
+		if (ret < 0) {
+			LOG_ERR("Cannot enable the time series cache (%d)", ret);
+			return ret;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * Function used to account new records in the time series cache
+ */
+void lwm2m_send_records_added(atomic_val_t count)
+{
+	if (atomic_add(&pending, count) + count >= CONFIG_APP_LWM2M_SEND_BATCH_SIZE) {
+		k_work_reschedule(&flush_work, K_NO_WAIT);
+		return;
+	}
+
+	// Only the first record of a batch arms the timer, later ones must not delay it
+	k_work_schedule(&flush_work, K_SECONDS(CONFIG_APP_LWM2M_SEND_MAX_DELAY_SEC));
+}
+
+/**
+ * Function used to push all cached records in a single Send operation
+ * The records stay cached if the Send can not be started, e.g. because the
+ * node is not registered, and go out with the next flush
+ */
+int lwm2m_send_flush(void)
+{
+	atomic_val_t records = atomic_get(&pending);
+	int ret;
+
+	if (records == 0 || !client_ctx) {
+		return 0;
+	}
+
+	ret = lwm2m_send_cb(client_ctx, send_paths, ARRAY_SIZE(send_paths), send_reply_cb);
+	if (ret < 0) {
+		LOG_WRN("Cannot send %ld cached records (%d)", (long)records, ret);
+		k_work_schedule(&flush_work, K_SECONDS(CONFIG_APP_LWM2M_SEND_MAX_DELAY_SEC));
+		return ret;
+	}
+
+	atomic_sub(&pending, records);
+	k_work_cancel_delayable(&flush_work);
+	LOG_DBG("Sent %ld records", (long)records);
+
+	return 0;
+}
@@ -0,0 +1,25 @@
+#ifndef __LWM2M_SEND_H__
+#define __LWM2M_SEND_H__
+
+#include <zephyr/net/lwm2m.h>
+#include <zephyr/sys/atomic.h>
+
+/**
+ * Function used to enable the time series cache of the pushed resources
+ */
+int init_lwm2m_send(struct lwm2m_ctx *ctx);
+
+/**
+ * Function used to account new records in the time series cache
+ * count is the number of cached resources set, flushes the cache once the
+ * batch size is reached and arms the timer that flushes it after the
+ * maximum delay otherwise
+ */
+void lwm2m_send_records_added(atomic_val_t count);
+
+/**
+ * Function used to push all cached records in a single Send operation
+ */
+int lwm2m_send_flush(void);
+
+#endif
@@ -5,6 +5,7 @@
 
 #include <zephyr/kernel.h>
 #include <zephyr/logging/log.h>
+#include <string.h>
 
 LOG_MODULE_REGISTER(main, LOG_LEVEL_DBG);
 
@@ -14,47 +15,62 @@ LOG_MODULE_REGISTER(main, LOG_LEVEL_DBG);
 #include <zephyr/net/coap.h>
 #include <zephyr/net/coap_service.h>
 #include <zephyr/net/coap_link_format.h>
+#include <zephyr/sys/byteorder.h>
 
 #include <zephyr/drivers/gpio.h>
-#include <zephyr/net/openthread.h>
-#include <openthread/thread.h>
 
 #include "coap_client.h"
+#include "coap_server.h"
+#include "button.h"
+#include "connectivity.h"
+#include "events.h"
+#include "journal.h"
+#include "light.h"
+#include "scenario.h"
+#if defined(CONFIG_APP_BRIDGE_DISCOVERY)
+#include "discovery.h"
+#endif
+
+#if defined(CONFIG_APP_SLEEPY)
+#include "sleepy.h"
+#endif
+
+#if defined(CONFIG_APP_THREAD_START)
+#include "thread_start.h"
+#endif
+#if defined(CONFIG_APP_PERSIST)
+#include "persist.h"
+#endif
+#if defined(CONFIG_APP_COAP_BENCH)
+#include "coap_bench.h"
+#endif
+#if defined(CONFIG_APP_COAP_GROUP)
+#include "coap_group.h"
+#endif
+#if defined(CONFIG_LWM2M)
+#include "lwm2m_client.h"
+#endif
 
 // led0 -> Red LED
 // led1 -> Green LED
 // led2 -> Blue LED
 // led3 -> Yellow LED
-// led4 -> User LED
+// led4 -> User LED, driven by light.c
 #define OT_CONNECTION_LED DT_ALIAS(led3)
 #define PROVISIONING_LED DT_ALIAS(led1)
-#define LIGHT_LED DT_ALIAS(led4)
 
 #define COAP_SERVER_WORKQ_STACK_SIZE 1024
 #define COAP_SERVER_WORKQ_PRIORITY 5
 
 #define COAP_PORT 5683
 #define SLEEP_TIME_MS 5000
+#define CONNECTION_BLINK_MS 500
 
 K_THREAD_STACK_DEFINE(coap_server_workq_stack_area, COAP_SERVER_WORKQ_STACK_SIZE);
 
 // LED initialization
 static const struct gpio_dt_spec led_connection = GPIO_DT_SPEC_GET(OT_CONNECTION_LED, gpios);
 static const struct gpio_dt_spec led_provisioning = GPIO_DT_SPEC_GET(PROVISIONING_LED, gpios);
-static const struct gpio_dt_spec led_user = GPIO_DT_SPEC_GET(LIGHT_LED, gpios);
-
-// Button initialization
-static const struct gpio_dt_spec button = {DEVICE_DT_GET(DT_NODELABEL(gpio1)), 12, (GPIO_PULL_UP | GPIO_ACTIVE_LOW)};
-enum button_evt {
-    BUTTON_EVT_PRESSED,
-    BUTTON_EVT_RELEASED
-};
-typedef void (*button_event_handler_t)(enum button_evt evt);
-static button_event_handler_t button_cb;
-static struct gpio_callback button_cb_data;
-
-// CoAP Server Service Definition
-COAP_SERVICE_DEFINE(coap_server, NULL, 5683, COAP_SERVICE_AUTOSTART);
 
 /**
  * Function used to initialize the LEDs
@@ -69,7 +85,8 @@ int init_leds()
 		return 0;
 	}
 
-	ret = gpio_pin_configure_dt(&led_connection, GPIO_OUTPUT_ACTIVE);
+	// Both LEDs are driven by the connectivity state
+	ret = gpio_pin_configure_dt(&led_connection, GPIO_OUTPUT_INACTIVE);
 	if (ret < 0) {
 		LOG_ERR("Error %d: failed to configure %s pin %d\n",
 		       ret, led_connection.port->name, led_connection.pin);
@@ -82,31 +99,15 @@ int init_leds()
 		return 0;
 	}
 
-	ret = gpio_pin_configure_dt(&led_provisioning, GPIO_OUTPUT_ACTIVE);
+	ret = gpio_pin_configure_dt(&led_provisioning, GPIO_OUTPUT_INACTIVE);
 	if (ret < 0) {
 		LOG_ERR("Error %d: failed to configure %s pin %d\n",
 		       ret, led_provisioning.port->name, led_provisioning.pin);
 		return 0;
 	}
 
-	if (!gpio_is_ready_dt(&led_user)) {
-		LOG_ERR("Error: led device %s is not ready\n",
-		       led_user.port->name);
-		return 0;
-	}
-
-	// Configure led_user as input and output pin at the same time so you can read the logical value
-	// See: https://github.com/zephyrproject-rtos/zephyr/issues/48058
-	ret = gpio_pin_configure_dt(&led_user, GPIO_INPUT | GPIO_OUTPUT_ACTIVE);
+	ret = init_light();
 	if (ret < 0) {
-		LOG_ERR("Error %d: failed to configure %s pin %d\n",
-		       ret, led_user.port->name, led_user.pin);
-		return 0;
-	}
-
-	if (!gpio_is_ready_dt(&button)) {
-		LOG_ERR("Error: button device %s is not ready\n",
-		       button.port->name);
 		return 0;
 	}
 
@@ -114,267 +115,107 @@ int init_leds()
 }
 
 /**
- * Callback function for the delayable work item
- * Calls the actual button callback function
+ * Work handler blinking the connection LED while the node attaches
  */
-static void cooldown_expired(struct k_work *work)
+static void connection_blink_handler(struct k_work *work)
 {
-    ARG_UNUSED(work);
-
-    int val = gpio_pin_get_dt(&button);
-    enum button_evt evt = val ? BUTTON_EVT_PRESSED : BUTTON_EVT_RELEASED;
-    if (button_cb) {
-        button_cb(evt);
-    }
-}
+	struct k_work_delayable *dwork = k_work_delayable_from_work(work);
 
-/**
- * Macro to define a delayable work item with its corresponding handler
- */
-static K_WORK_DELAYABLE_DEFINE(cooldown_work, cooldown_expired);
-
-/**
- * Button callback function that sets the deadline for the work
- */
-void button_pressed(const struct device *dev, struct gpio_callback *cb,
-		    uint32_t pins)
-{
-	k_work_reschedule(&cooldown_work, K_MSEC(1000));
+	gpio_pin_toggle_dt(&led_connection);
+	k_work_schedule(dwork, K_MSEC(CONNECTION_BLINK_MS));
 }
 
-/**
- * Helper structure to turn a button event into a string
- */
-static char *helper_button_evt_str(enum button_evt evt)
-{
-	switch (evt) {
-	case BUTTON_EVT_PRESSED:
-		return "Pressed";
-	case BUTTON_EVT_RELEASED:
-		return "Released";
-	default:
-		return "Unknown";
-	}
-}
+static K_WORK_DELAYABLE_DEFINE(connection_blink_work, connection_blink_handler);
 
 /**
- * Button event handler
- * Callback function that is invoked on a button press
- * Sends CoAP requests to the Matter bridge as part of the PoC
+ * Connectivity event handler
+ * The provisioning LED is lit while the node has no credentials, the
+ * connection LED blinks while attaching and is lit once attached
  */
-static void button_event_handler(enum button_evt evt)
+static void conn_event_handler(const struct zbus_channel *chan)
 {
-	LOG_INF("Button event: %s\n", helper_button_evt_str(evt));
-	int ret;
+	const struct conn_event *event = zbus_chan_const_msg(chan);
 
-	ret = init_coap_client();
-	if (ret < 0) {
-		LOG_ERR("Couldn't start CoAP Client");
-		goto end;
-	}
+	gpio_pin_set_dt(&led_provisioning, event->state == CONN_STATE_UNPROVISIONED);
 
-	// Send a PUT request to the Toggle ressource
-	ret = matter_on_off_toggle_put();
-	if (ret < 0) {
-		LOG_ERR("Couldn`t send PUT to Toggle");
-		goto end;
+	if (event->state == CONN_STATE_DETACHED) {
+		k_work_schedule(&connection_blink_work, K_NO_WAIT);
+		return;
 	}
 
-	// Wait 10 seconds
-	k_msleep(10000);
-
-	// Send a PUT request to the OnTime ressource containing the value to write
-	ret = matter_on_off_ontime_put();
-	if (ret < 0) {
-		LOG_ERR("Couldn`t send PUT to OnTime");
-		goto end;
-	}
-
-	// Wait 10 seconds
-	k_msleep(10000);
-
-	// Send a GET request to the OnOff ressource
-	ret = matter_on_off_onoff_get();
-	if (ret < 0) {
-		LOG_ERR("Couldn`t send GET to OnOff");
-		goto end;
-	}
-
-end:
-	close_socket();
-	LOG_INF("Closed CoAP Client");
+	k_work_cancel_delayable(&connection_blink_work);
+	gpio_pin_set_dt(&led_connection, event->state == CONN_STATE_ATTACHED);
 }
 
-/**
- * Function used to initialize the buttons
- */
-int init_buttons(button_event_handler_t handler)
-{
-	int err = -1;
-
-    if (!handler) {
-        return -EINVAL;
-    }
+ZBUS_LISTENER_DEFINE(conn_listener, conn_event_handler);
+ZBUS_CHAN_ADD_OBS(conn_chan, conn_listener, 2);
 
-    button_cb = handler;
-
-	if (!device_is_ready(button.port)) {
-		return -EIO;
-	}
-
-	err = gpio_pin_configure_dt(&button, GPIO_INPUT);
-	if (err) {
-        return err;
-	}
-
-	err = gpio_pin_interrupt_configure_dt(&button, GPIO_INT_EDGE_BOTH);
-	if (err) {
-		return err;
-	}
-
-	gpio_init_callback(&button_cb_data, button_pressed, BIT(button.pin));
-	err = gpio_add_callback(button.port, &button_cb_data);
-    if (err) {
-        return err;
-    }
-
-    return 0;
-}
+// Resources of the Matter On/Off cluster exposed by the bridge
+static const char * const matter_on_off_toggle_path[] = { "42770", "0", "8", NULL };
+static const char * const matter_on_off_onoff_path[] = { "42770", "0", "5", NULL };
+static const char * const matter_on_off_ontime_path[] = { "42770", "0", "3", NULL };
 
 /**
- * GET request handler for the onoff resource
+ * Request sequence of the PoC: toggle, write OnTime and read back OnOff
  */
-static int on_off_object_state_get(struct coap_resource *resource, struct coap_packet *request,
-                  struct sockaddr *addr, socklen_t addr_len)
-{
-	static const char *on_msg = "1";
-	static const char *off_msg = "0";
-
-    uint8_t data[CONFIG_COAP_SERVER_MESSAGE_SIZE];
-    struct coap_packet response;
-    uint16_t id;
-    uint8_t token[COAP_TOKEN_MAX_LEN];
-    uint8_t tkl, type;
-
-    type = coap_header_get_type(request);
-    id = coap_header_get_id(request);
-    tkl = coap_header_get_token(request, token);
-
-    /* Determine response type */
-    type = (type == COAP_TYPE_CON) ? COAP_TYPE_ACK : COAP_TYPE_NON_CON;
-
-    coap_packet_init(&response, data, sizeof(data), COAP_VERSION_1, type, tkl, token,
-                     COAP_RESPONSE_CODE_CONTENT, id);
-
-    /* Set content format */
-    coap_append_option_int(&response, COAP_OPTION_CONTENT_FORMAT,
-                           COAP_CONTENT_FORMAT_TEXT_PLAIN);
-
-    /* Append payload */
-    coap_packet_append_payload_marker(&response);
-	
-    if (gpio_pin_get_dt(&led_user)) {
-		coap_packet_append_payload(&response, (uint8_t *)on_msg, sizeof(on_msg));
-	} else {
-		coap_packet_append_payload(&response, (uint8_t *)off_msg, sizeof(off_msg));
-	}
-
-    /* Send to response back to the client */
-    return coap_resource_send(resource, &response, addr, addr_len, NULL);
-}
-
-/**
- * PUT request handler for the onoff resource
- */
-static int on_off_object_state_put(struct coap_resource *resource, struct coap_packet *request,
-                  struct sockaddr *addr, socklen_t addr_len)
-{
-	const uint8_t *data;
-	uint16_t data_len;
-    data = coap_packet_get_payload(request, &data_len);
-	char converted_data[data_len];
-	strcpy(converted_data, data);
-	if (strncmp(converted_data, "0", 1) == 0) {
-		LOG_INF("Disabling LED");
-		gpio_pin_set_dt(&led_user, 0);
-	} else if (strncmp(converted_data, "1", 1) == 0) {
-		LOG_INF("Enabling LED");
-		gpio_pin_set_dt(&led_user, 1);
-	} else {
-		LOG_INF("Invalid Payload");
-		LOG_INF("Actual String: %s With Length: %i", converted_data, sizeof(converted_data));
-		return COAP_RESPONSE_CODE_BAD_REQUEST;
-	}
-
-    return COAP_RESPONSE_CODE_CHANGED;
-}
-
-/**
- * Add the state ressource as a CoAP ressource
- */
-static const char * const on_off_object_state_path[] = { "42769", "0", "1", NULL};
-COAP_RESOURCE_DEFINE(on_off_object_state_resource, coap_server, {
-    .path = on_off_object_state_path,
-    .get = on_off_object_state_get,
-	.put = on_off_object_state_put,
-});
+SCENARIO_DEFINE(bridge_poc,
+	{ .method = COAP_METHOD_PUT, .path = matter_on_off_toggle_path },
+	{ .method = COAP_METHOD_PUT, .path = matter_on_off_ontime_path, .payload = "20",
+	  .delay_ms = 10000, .cond = SCENARIO_IF_SUCCESS },
+	{ .method = COAP_METHOD_GET, .path = matter_on_off_onoff_path,
+	  .delay_ms = 10000, .cond = SCENARIO_IF_SUCCESS, .retries = 2,
+	  .retry_delay_ms = 2000 },
+);
 
 /**
- * PUT request handler for the on resource
+ * Toggle the bridged light and verify the new state
  */
-static int on_off_object_on_put(struct coap_resource *resource, struct coap_packet *request,
-                  struct sockaddr *addr, socklen_t addr_len)
-{
-	gpio_pin_set_dt(&led_user, 1);
-	return COAP_RESPONSE_CODE_CHANGED;
-}
+SCENARIO_DEFINE(bridge_toggle,
+	{ .method = COAP_METHOD_PUT, .path = matter_on_off_toggle_path, .retries = 2,
+	  .retry_delay_ms = 1000 },
+	{ .method = COAP_METHOD_GET, .path = matter_on_off_onoff_path,
+	  .delay_ms = 500, .cond = SCENARIO_IF_SUCCESS },
+);
 
 /**
- * Add the on ressource as a CoAP ressource
+ * Read the state of the bridged light
  */
-static const char * const on_off_object_on_path[] = { "42769", "0", "2", NULL};
-COAP_RESOURCE_DEFINE(on_off_object_on_resource, coap_server, {
-    .path = on_off_object_on_path,
-    .put = on_off_object_on_put,
-});
+SCENARIO_DEFINE(bridge_status,
+	{ .method = COAP_METHOD_GET, .path = matter_on_off_onoff_path, .retries = 3,
+	  .retry_delay_ms = 1000 },
+);
 
 /**
- * PUT request handler for the off resource
- */
-static int on_off_object_off_put(struct coap_resource *resource, struct coap_packet *request,
-                  struct sockaddr *addr, socklen_t addr_len)
-{
-	gpio_pin_set_dt(&led_user, 0);
-	return COAP_RESPONSE_CODE_CHANGED;
-}
-
-/**
- * Add the off ressource as a CoAP ressource
- */
-static const char * const on_off_object_off_path[] = { "42769", "0", "3", NULL};
-COAP_RESOURCE_DEFINE(on_off_object_off_resource, coap_server, {
-    .path = on_off_object_off_path,
-    .put = on_off_object_off_put,
-});
-
-/**
- * PUT request handler for the switch ressource
+ * Button event handler
+ * Listener of the button channel that is invoked on every button event
+ * Starts the scenario of the gesture, the scenarios run on timers, so the
+ * channel never waits on the network. Gestures are exclusive, an
+ * interaction starts a single scenario, the raw press and release events
+ * start none.
  */
-static int on_off_object_switch_put(struct coap_resource *resource, struct coap_packet *request,
-                  struct sockaddr *addr, socklen_t addr_len)
+static void button_event_handler(const struct zbus_channel *chan)
 {
-	gpio_pin_toggle_dt(&led_user);
-	return COAP_RESPONSE_CODE_CHANGED;
+	const struct button_event *event = zbus_chan_const_msg(chan);
+
+	LOG_INF("Button event: %s\n", button_evt_str(event->evt));
+
+	switch (event->evt) {
+	case BUTTON_EVT_CLICK:
+		scenario_start(&bridge_poc);
+		break;
+	case BUTTON_EVT_DOUBLE_PRESS:
+		scenario_start(&bridge_toggle);
+		break;
+	case BUTTON_EVT_LONG_PRESS:
+		scenario_start(&bridge_status);
+		break;
+	default:
+		break;
+	}
 }
 
-/**
- * Add the switch ressource as a CoAP ressource
- */
-static const char * const on_off_object_switch_path[] = { "42769", "0", "4", NULL};
-COAP_RESOURCE_DEFINE(on_off_object_switch_resource, coap_server, {
-    .path = on_off_object_switch_path,
-    .put = on_off_object_switch_put,
-});
+ZBUS_LISTENER_DEFINE(button_listener, button_event_handler);
+ZBUS_CHAN_ADD_OBS(button_chan, button_listener, 1);
 
 /**
  * Main function
@@ -394,13 +235,90 @@ int main(void)
 		goto end;
 	}
 
+#if defined(CONFIG_APP_PERSIST)
+	// Restore the light before the first request can read it
+	ret = init_persist();
+	if (ret) {
+		LOG_ERR("Could not restore the light state (error: %d)", ret);
+	}
+#endif
+
+	ret = init_coap_server();
+	if (ret < 0) {
+		LOG_ERR("Could not start the CoAP server (error: %d)", ret);
+		goto end;
+	}
+
+	// Restore the requests journaled before a reboot
+	ret = init_journal();
+	if (ret < 0) {
+		LOG_ERR("Cannot restore the journal (error: %d)", ret);
+	}
+
+	// Open the client socket, the scenarios share it
+	ret = init_coap_client();
+	if (ret < 0) {
+		LOG_ERR("Couldn't start CoAP Client (error: %d)", ret);
+	}
+
+#if defined(CONFIG_APP_SLEEPY)
+	// Start with the slow polling mode
+	ret = init_sleepy();
+	if (ret < 0) {
+		LOG_ERR("Cannot set the polling profile (error: %d)", ret);
+	}
+#endif
+
+#if defined(CONFIG_APP_BRIDGE_DISCOVERY)
+	// Resolve the bridges once attached
+	ret = init_discovery();
+	if (ret < 0) {
+		LOG_ERR("Cannot start the bridge discovery (error: %d)", ret);
+	}
+#endif
+
+	// Track the attach state, requests are journaled while detached
+	ret = init_connectivity();
+	if (ret < 0) {
+		LOG_ERR("Cannot track the connectivity (error: %d)", ret);
+	}
+
+#if defined(CONFIG_APP_THREAD_START)
+	// Attach with the stored dataset, join only without one
+	ret = init_thread_start();
+	if (ret < 0) {
+		LOG_ERR("Cannot start Thread (error: %d)", ret);
+	}
+#endif
+
 	// Initialize the buttons
-	ret = init_buttons(button_event_handler);
+	ret = init_buttons();
 	if (ret) {
 		LOG_ERR("Cannot init buttons (error: %d)", ret);
 		goto end;
 	}
 
+#if defined(CONFIG_LWM2M)
+	// Register the objects with the LwM2M server
+	ret = init_lwm2m_client();
+	if (ret) {
+		LOG_ERR("Could not start LwM2M client (error: %d)", ret);
+	}
+#endif
+
+#if defined(CONFIG_APP_COAP_GROUP)
+	// Join the CoAP groups so the on/off resources can be switched by group requests
+	ret = coap_group_init();
+	if (ret) {
+		LOG_ERR("Could not join all CoAP groups (error: %d)", ret);
+	}
+#endif
+
+#if defined(CONFIG_APP_COAP_BENCH)
+	// Numbers of the build, later runs with the bench shell command
+	coap_bench_run(CONFIG_APP_COAP_BENCH_ITERATIONS);
+#endif
+
 	// Endless loop to keep
 	while (true)
 	{
@@ -0,0 +1,195 @@
+/*
+ * Persistent light state
+ * Changes only mark their values dirty and arm the flush timer, so a burst
+ * of toggles ends up as a single write of the last state per value once the
+ * timer expires. The timer is not pushed back by later changes, which bounds
+ * the time a change can be lost by a power cut to the flush delay.
+ */
+
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(persist, LOG_LEVEL_DBG);
+
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/settings/settings.h>
+
+#include "events.h"
+#include "persist.h"
+
+#define PERSIST_ROOT "light"
+
+enum persist_value {
+	PERSIST_ON,
+	PERSIST_DIMMER,
+	PERSIST_ON_TIME,
+	PERSIST_ENERGY,
+	PERSIST_COUNT
+};
+
+static const char * const persist_keys[PERSIST_COUNT] = {
+	[PERSIST_ON] = "on",
+	[PERSIST_DIMMER] = "dimmer",
+	[PERSIST_ON_TIME] = "on_time",
+	[PERSIST_ENERGY] = "energy",
+};
+
+/* Values written last, changes are compared against them */
+static struct light_state stored;
+static atomic_t dirty;
+
+static void flush_work_handler(struct k_work *work);
+static K_WORK_DELAYABLE_DEFINE(flush_work, flush_work_handler);
+
+/**
+ * Function used to get the location of a value within a light state
+ */
+static void *value_ptr(struct light_state *state, enum persist_value value, size_t *len)
+{
+	switch (value) {
+	case PERSIST_ON:
+		*len = sizeof(state->on);
+		return &state->on;
+	case PERSIST_DIMMER:
+		*len = sizeof(state->dimmer);
+		return &state->dimmer;
+	case PERSIST_ON_TIME:
+		*len = sizeof(state->on_time_ms);
+		return &state->on_time_ms;
+	case PERSIST_ENERGY:
+		*len = sizeof(state->energy_mw_ms);
+		return &state->energy_mw_ms;
+	default:
+		*len = 0;
+		return NULL;
+	}
+}
+
+/**
+ * Listener of the light channel
+ * Only marks the changed values, the write happens in the flush work
+ */
+static void light_changed(const struct zbus_channel *chan)
+{
+	const struct light_state *state = zbus_chan_const_msg(chan);
+	atomic_val_t changes = BIT(PERSIST_ON_TIME) | BIT(PERSIST_ENERGY);
+
+	if (state->on != stored.on) {
+		changes |= BIT(PERSIST_ON);
+	}
+	if (state->dimmer != stored.dimmer) {
+		changes |= BIT(PERSIST_DIMMER);
+	}
+
+	atomic_or(&dirty, changes);
+	k_work_schedule(&flush_work, K_MSEC(CONFIG_APP_PERSIST_FLUSH_DELAY_MS));
+}
+
+// Enabled once the stored state is restored
+ZBUS_LISTENER_DEFINE_WITH_ENABLE(persist_listener, light_changed, false);
+ZBUS_CHAN_ADD_OBS(light_chan, persist_listener, 1);
+
+/**
+ * Callback function for the flush work item
+ */
+static void flush_work_handler(struct k_work *work)
+{
+	ARG_UNUSED(work);
+
+	(void)persist_flush();
+}
+
+/**
+ * Function used to write all pending changes to flash right away
+ */
+int persist_flush(void)
+{
+	char key[sizeof(PERSIST_ROOT "/") + 8];
+	struct light_state state;
+	atomic_val_t pending;
+	int ret = 0;
+
+	pending = atomic_clear(&dirty);
+	if (!pending) {
+		return 0;
+	}
+
+	light_get_state(&state);
+
+	for (int i = 0; i < PERSIST_COUNT; i++) {
+		size_t len;
+		void *value = value_ptr(&state, i, &len);
+		int err;
+
+		if (!(pending & BIT(i))) {
+			continue;
+		}
+
+		snprintk(key, sizeof(key), PERSIST_ROOT "/%s", persist_keys[i]);
+		err = settings_save_one(key, value, len);
+		if (err < 0) {
+			LOG_ERR("Cannot store %s (%d)", key, err);
+			// Keep it dirty so the next flush tries again
+			atomic_or(&dirty, BIT(i));
+			ret = err;
+			continue;
+		}
+
+		memcpy(value_ptr(&stored, i, &len), value, len);
+	}
+
+	LOG_DBG("Flushed light state (0x%02lx)", (unsigned long)pending);
+
+	return ret;
+}
+
+/**
+ * Callback function for loading the stored values from settings
+ */
+static int settings_load_cb(const char *key, size_t len, settings_read_cb read_cb,
+			    void *cb_arg, void *param)
+{
+	struct light_state *state = param;
+
+	for (int i = 0; i < PERSIST_COUNT; i++) {
+		size_t value_len;
+		void *value = value_ptr(state, i, &value_len);
+
+		if (strcmp(key, persist_keys[i]) == 0 && len == value_len) {
+			(void)read_cb(cb_arg, value, value_len);
+			break;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * Function used to restore the stored state of the light
+ */
+int init_persist(void)
+{
+	struct light_state state;
+	int ret;
+
+	ret = settings_subsys_init();
+	if (ret < 0) {
+		LOG_ERR("Cannot initialize settings (%d)", ret);
+		return ret;
+	}
+
+	// Values that were never stored keep their defaults
+	light_get_state(&state);
+
+	ret = settings_load_subtree_direct(PERSIST_ROOT, settings_load_cb, &state);
+	if (ret < 0) {
+		LOG_ERR("Cannot load the light state (%d)", ret);
+	} else {
+		ret = light_restore(&state);
+		LOG_INF("Restored light %s at %u %%", state.on ? "on" : "off", state.dimmer);
+	}
+
+	stored = state;
+	zbus_obs_set_enable(&persist_listener, true);
+
+	return ret;
+}
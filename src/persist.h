@@ -0,0 +1,15 @@
+#ifndef __PERSIST_H__
+#define __PERSIST_H__
+
+/**
+ * Function used to restore the stored state of the light
+ * Must run before the CoAP service starts, so no request sees the defaults
+ */
+int init_persist(void);
+
+/**
+ * Function used to write all pending changes to flash right away
+ */
+int persist_flush(void);
+
+#endif
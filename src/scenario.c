@@ -0,0 +1,174 @@
+/*
+ * Table driven request scenarios
+ * Every running scenario owns a delayable work item. A step is sent from the
+ * work item, its response callback decides whether the step is repeated or
+ * the next step is scheduled, no thread waits between the steps.
+ */
+
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(scenario, LOG_LEVEL_DBG);
+
+#include <zephyr/kernel.h>
+#include <zephyr/net/coap.h>
+#include <string.h>
+
+#include "coap_client.h"
+#include "scenario.h"
+
+/**
+ * State of a running scenario
+ */
+struct scenario_run {
+	struct k_work_delayable work;
+	/* NULL if the run is free */
+	const struct scenario *scenario;
+	size_t step;
+	uint8_t attempt;
+	/* Result of the previous step, response code or negative error */
+	int last_result;
+};
+
+static struct scenario_run runs[CONFIG_APP_SCENARIO_MAX_RUNS];
+static K_MUTEX_DEFINE(runs_mutex);
+
+/**
+ * Function used to check whether a result is a success
+ */
+static bool result_ok(int result)
+{
+	return result >= 0 && COAP_RESPONSE_CODE_CLASS(result) == 2;
+}
+
+/**
+ * Function used to check the condition of the current step
+ */
+static bool step_cond_holds(const struct scenario_run *run)
+{
+	switch (run->scenario->steps[run->step].cond) {
+	case SCENARIO_IF_SUCCESS:
+		return result_ok(run->last_result);
+	case SCENARIO_IF_FAILURE:
+		return !result_ok(run->last_result);
+	default:
+		return true;
+	}
+}
+
+/**
+ * Function used to finish a run and release it
+ */
+static void run_finish(struct scenario_run *run)
+{
+	LOG_INF("Scenario %s finished (last result: %d)", run->scenario->name,
+		run->last_result);
+
+	k_mutex_lock(&runs_mutex, K_FOREVER);
+	run->scenario = NULL;
+	k_mutex_unlock(&runs_mutex);
+}
+
+/**
+ * Function used to move a run to its next step
+ */
+static void run_advance(struct scenario_run *run, int result)
+{
+	run->last_result = result;
+	run->attempt = 0;
+	run->step++;
+
+	if (run->step >= run->scenario->num_steps) {
+		run_finish(run);
+		return;
+	}
+
+	k_work_schedule(&run->work, K_MSEC(run->scenario->steps[run->step].delay_ms));
+}
+
+/**
+ * Callback for the response of the current step
+ */
+static void step_response(int code, const uint8_t *payload, uint16_t len, void *user_data)
+{
+	struct scenario_run *run = user_data;
+	const struct scenario_step *step = &run->scenario->steps[run->step];
+
+	LOG_INF("Scenario %s step %zu: %d.%02d", run->scenario->name, run->step,
+		code < 0 ? code : COAP_RESPONSE_CODE_CLASS(code),
+		code < 0 ? 0 : COAP_RESPONSE_CODE_DETAIL(code));
+
+	if (len > 0) {
+		LOG_HEXDUMP_DBG(payload, len, "Payload");
+	}
+
+	if (!result_ok(code) && run->attempt < step->retries) {
+		run->attempt++;
+		k_work_schedule(&run->work, K_MSEC(step->retry_delay_ms));
+		return;
+	}
+
+	run_advance(run, code);
+}
+
+/**
+ * Work handler sending the current step of a run
+ */
+static void step_handler(struct k_work *work)
+{
+	struct k_work_delayable *dwork = k_work_delayable_from_work(work);
+	struct scenario_run *run = CONTAINER_OF(dwork, struct scenario_run, work);
+	const struct scenario_step *step = &run->scenario->steps[run->step];
+	int ret;
+
+	if (!step_cond_holds(run)) {
+		// A skipped step keeps the result of the step before
+		run_advance(run, run->last_result);
+		return;
+	}
+
+	ret = coap_request_send(step->method, step->path, (const uint8_t *)step->payload,
+				step->payload ? strlen(step->payload) : 0, step_response, run);
+	if (ret < 0) {
+		LOG_ERR("Scenario %s step %zu not sent (%d)", run->scenario->name, run->step, ret);
+		step_response(ret, NULL, 0, run);
+	}
+}
+
+/**
+ * Function used to start a scenario
+ */
+int scenario_start(const struct scenario *scenario)
+{
+	struct scenario_run *run = NULL;
+
+	if (scenario->num_steps == 0) {
+		return -EINVAL;
+	}
+
+	k_mutex_lock(&runs_mutex, K_FOREVER);
+
+	for (size_t i = 0; i < ARRAY_SIZE(runs); i++) {
+		if (runs[i].scenario == NULL) {
+			run = &runs[i];
+			run->scenario = scenario;
+			break;
+		}
+	}
+
+	k_mutex_unlock(&runs_mutex);
+
+	if (run == NULL) {
+		LOG_WRN("No free run for scenario %s", scenario->name);
+		return -EBUSY;
+	}
+
+	LOG_INF("Starting scenario %s", scenario->name);
+
+	run->step = 0;
+	run->attempt = 0;
+	// The first step sees a successful previous step
+	run->last_result = COAP_RESPONSE_CODE_OK;
+	k_work_init_delayable(&run->work, step_handler);
+	k_work_schedule(&run->work, K_MSEC(scenario->steps[0].delay_ms));
+
+	return 0;
+}
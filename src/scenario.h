@@ -0,0 +1,59 @@
+#ifndef __SCENARIO_H__
+#define __SCENARIO_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Condition on the response of the previous step
+ */
+enum scenario_cond {
+	SCENARIO_ALWAYS,
+	/* Previous step got a 2.xx response */
+	SCENARIO_IF_SUCCESS,
+	/* Previous step failed or got no response */
+	SCENARIO_IF_FAILURE,
+};
+
+/**
+ * Single request of a scenario
+ */
+struct scenario_step {
+	uint8_t method;
+	const char * const *path;
+	/* Optional payload sent with the request */
+	const char *payload;
+	/* Delay before the request is sent in ms */
+	uint32_t delay_ms;
+	/* Steps whose condition does not hold are skipped */
+	enum scenario_cond cond;
+	/* Number of times the request is repeated on failure */
+	uint8_t retries;
+	/* Delay before a repeated request in ms */
+	uint32_t retry_delay_ms;
+};
+
+/**
+ * Named sequence of requests to the bridge
+ */
+struct scenario {
+	const char *name;
+	const struct scenario_step *steps;
+	size_t num_steps;
+};
+
+#define SCENARIO_DEFINE(_name, ...)					\
+	static const struct scenario_step _name##_steps[] = { __VA_ARGS__ };	\
+	static const struct scenario _name = {				\
+		.name = #_name,						\
+		.steps = _name##_steps,					\
+		.num_steps = ARRAY_SIZE(_name##_steps),			\
+	}
+
+/**
+ * Function used to start a scenario
+ * Scenarios run on timers and response callbacks, several can be interleaved
+ */
+int scenario_start(const struct scenario *scenario);
+
+#endif
@@ -0,0 +1,255 @@
+/*
+ * Sleepy child polling profile
+ * The data poll period (SED) or the CSL period (SSED) is short while CoAP
+ * exchanges are in flight and long otherwise, so responses arrive within a
+ * fast period without keeping the radio busy when idle. The fast mode
+ * lingers for a moment after the last exchange to catch separate responses
+ * and follow-up requests.
+ *
+ * The current draw of a mode is estimated from the sleep current and the
+ * charge of a single poll or CSL sample, it is not measured.
+ */
+
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(sleepy, LOG_LEVEL_DBG);
+
+#include <zephyr/kernel.h>
+#include <zephyr/net/openthread.h>
+#include <openthread/link.h>
+
+#include "sleepy.h"
+
+static const uint32_t mode_period_ms[SLEEPY_MODE_COUNT] = {
+#if defined(CONFIG_OPENTHREAD_CSL_RECEIVER)
+	[SLEEPY_MODE_FAST] = CONFIG_APP_SLEEPY_FAST_CSL_PERIOD_MS,
+	[SLEEPY_MODE_SLOW] = CONFIG_APP_SLEEPY_SLOW_CSL_PERIOD_MS,
+#else
+	[SLEEPY_MODE_FAST] = CONFIG_APP_SLEEPY_FAST_POLL_MS,
+	[SLEEPY_MODE_SLOW] = CONFIG_OPENTHREAD_POLL_PERIOD,
+#endif
+};
+
+static struct {
+	enum sleepy_mode mode;
+	/* Exchanges in flight */
+	uint32_t active;
+	/* Uptime until which the fast mode is kept at least */
+	int64_t hold_until_ms;
+	/* Uptime at which the current mode was entered */
+	int64_t entered_ms;
+	uint64_t time_ms[SLEEPY_MODE_COUNT];
+	uint32_t rtt_count[SLEEPY_MODE_COUNT];
+	uint64_t rtt_sum_ms[SLEEPY_MODE_COUNT];
+	uint32_t rtt_max_ms[SLEEPY_MODE_COUNT];
+} sleepy;
+
+static K_MUTEX_DEFINE(sleepy_mutex);
+
+static void slow_handler(struct k_work *work);
+static K_WORK_DELAYABLE_DEFINE(slow_work, slow_handler);
+
+/**
+ * Function used to apply the period of a mode to the link
+ * Must be called with sleepy_mutex held
+ */
+static void set_mode(enum sleepy_mode mode)
+{
+	struct openthread_context *ot_context = openthread_get_default_context();
+	int64_t now = k_uptime_get();
+	otError error;
+
+	if (mode == sleepy.mode) {
+		return;
+	}
+
+	sleepy.time_ms[sleepy.mode] += now - sleepy.entered_ms;
+	sleepy.entered_ms = now;
+	sleepy.mode = mode;
+
+	openthread_api_mutex_lock(ot_context);
+#if defined(CONFIG_OPENTHREAD_CSL_RECEIVER)
+	error = otLinkSetCslPeriod(ot_context->instance, mode_period_ms[mode] * USEC_PER_MSEC);
+#else
+	error = otLinkSetPollPeriod(ot_context->instance, mode_period_ms[mode]);
+#endif
+	openthread_api_mutex_unlock(ot_context);
+
+	if (error != OT_ERROR_NONE) {
+		LOG_WRN("Cannot set period of %s mode (%d)", sleepy_mode_str(mode), error);
+	}
+}
+
+/**
+ * Function used to return to the slow mode once nothing keeps the fast one
+ * Must be called with sleepy_mutex held
+ */
+static void schedule_slow(void)
+{
+	int64_t remaining = sleepy.hold_until_ms - k_uptime_get();
+
+	if (sleepy.active > 0) {
+		return;
+	}
+
+	k_work_reschedule(&slow_work, K_MSEC(MAX(remaining, 0)));
+}
+
+/**
+ * Work handler switching to the slow mode
+ */
+static void slow_handler(struct k_work *work)
+{
+	k_mutex_lock(&sleepy_mutex, K_FOREVER);
+
+	if (sleepy.active == 0 && sleepy.hold_until_ms <= k_uptime_get()) {
+		set_mode(SLEEPY_MODE_SLOW);
+	}
+
+	k_mutex_unlock(&sleepy_mutex);
+}
+
+#if CONFIG_APP_SLEEPY_REPORT_SEC > 0
+/**
+ * Work handler logging the statistics of both modes
+ */
+static void report_handler(struct k_work *work)
+{
+	struct k_work_delayable *dwork = k_work_delayable_from_work(work);
+	struct sleepy_stats stats;
+
+	sleepy_get_stats(&stats);
+
+	for (int i = 0; i < SLEEPY_MODE_COUNT; i++) {
+		LOG_INF("%s: period %u ms, %llu s, rtt avg %u ms max %u ms (%u), ~%u uA",
+			sleepy_mode_str(i), stats.modes[i].period_ms,
+			(unsigned long long)(stats.modes[i].time_ms / MSEC_PER_SEC),
+			stats.modes[i].rtt_avg_ms,
+			stats.modes[i].rtt_max_ms, stats.modes[i].rtt_count,
+			stats.modes[i].current_ua);
+	}
+
+	k_work_schedule(dwork, K_SECONDS(CONFIG_APP_SLEEPY_REPORT_SEC));
+}
+
+static K_WORK_DELAYABLE_DEFINE(report_work, report_handler);
+#endif
+
+/**
+ * Function used to start in the slow mode
+ */
+int init_sleepy(void)
+{
+	k_mutex_lock(&sleepy_mutex, K_FOREVER);
+	sleepy.entered_ms = k_uptime_get();
+	// Forces the period of the slow mode onto the link
+	sleepy.mode = SLEEPY_MODE_FAST;
+	set_mode(SLEEPY_MODE_SLOW);
+	k_mutex_unlock(&sleepy_mutex);
+
+#if CONFIG_APP_SLEEPY_REPORT_SEC > 0
+	k_work_schedule(&report_work, K_SECONDS(CONFIG_APP_SLEEPY_REPORT_SEC));
+#endif
+
+	return 0;
+}
+
+/**
+ * Function used to note the start of an exchange
+ */
+enum sleepy_mode sleepy_activity_begin(void)
+{
+	enum sleepy_mode mode;
+
+	k_mutex_lock(&sleepy_mutex, K_FOREVER);
+	mode = sleepy.mode;
+	sleepy.active++;
+	k_work_cancel_delayable(&slow_work);
+	set_mode(SLEEPY_MODE_FAST);
+	k_mutex_unlock(&sleepy_mutex);
+
+	return mode;
+}
+
+/**
+ * Function used to note the end of an exchange
+ */
+void sleepy_activity_end(enum sleepy_mode mode, int32_t rtt_ms)
+{
+	k_mutex_lock(&sleepy_mutex, K_FOREVER);
+
+	// The round trip is accounted to the mode the exchange started in, every
+	// exchange completes in the fast mode
+	if (rtt_ms >= 0) {
+		sleepy.rtt_count[mode]++;
+		sleepy.rtt_sum_ms[mode] += rtt_ms;
+		sleepy.rtt_max_ms[mode] = MAX(sleepy.rtt_max_ms[mode], rtt_ms);
+	}
+
+	if (sleepy.active > 0) {
+		sleepy.active--;
+	}
+
+	sleepy.hold_until_ms = MAX(sleepy.hold_until_ms,
+				   k_uptime_get() + CONFIG_APP_SLEEPY_LINGER_MS);
+	schedule_slow();
+
+	k_mutex_unlock(&sleepy_mutex);
+}
+
+/**
+ * Function used to keep the fast mode for a time, e.g. for an expected ACK
+ */
+void sleepy_expect(uint32_t ms)
+{
+	k_mutex_lock(&sleepy_mutex, K_FOREVER);
+	sleepy.hold_until_ms = MAX(sleepy.hold_until_ms, k_uptime_get() + ms);
+	set_mode(SLEEPY_MODE_FAST);
+	schedule_slow();
+	k_mutex_unlock(&sleepy_mutex);
+}
+
+/**
+ * Function used to read the statistics of both modes
+ */
+void sleepy_get_stats(struct sleepy_stats *stats)
+{
+	k_mutex_lock(&sleepy_mutex, K_FOREVER);
+
+	stats->mode = sleepy.mode;
+
+	for (int i = 0; i < SLEEPY_MODE_COUNT; i++) {
+		struct sleepy_mode_stats *mode = &stats->modes[i];
+
+		mode->period_ms = mode_period_ms[i];
+		mode->time_ms = sleepy.time_ms[i];
+		if (i == sleepy.mode) {
+			mode->time_ms += k_uptime_get() - sleepy.entered_ms;
+		}
+
+		mode->rtt_count = sleepy.rtt_count[i];
+		mode->rtt_avg_ms = sleepy.rtt_count[i] ?
+				   sleepy.rtt_sum_ms[i] / sleepy.rtt_count[i] : 0;
+		mode->rtt_max_ms = sleepy.rtt_max_ms[i];
+
+		// Every period costs one poll or CSL sample on top of the sleep current
+		mode->current_ua = CONFIG_APP_SLEEPY_SLEEP_CURRENT_UA +
+				   CONFIG_APP_SLEEPY_SAMPLE_CHARGE_NC / mode_period_ms[i];
+	}
+
+	k_mutex_unlock(&sleepy_mutex);
+}
+
+/**
+ * Helper function to turn a mode into a string
+ */
+const char *sleepy_mode_str(enum sleepy_mode mode)
+{
+	switch (mode) {
+	case SLEEPY_MODE_FAST:
+		return "fast";
+	case SLEEPY_MODE_SLOW:
+		return "slow";
+	default:
+		return "unknown";
+	}
+}
@@ -0,0 +1,72 @@
+#ifndef __SLEEPY_H__
+#define __SLEEPY_H__
+
+#include <stdint.h>
+
+/**
+ * Polling mode of the sleepy child
+ */
+enum sleepy_mode {
+	/* Exchanges are in flight, short poll or CSL period */
+	SLEEPY_MODE_FAST,
+	/* Idle, long poll or CSL period */
+	SLEEPY_MODE_SLOW,
+	SLEEPY_MODE_COUNT
+};
+
+/**
+ * Statistics of a polling mode
+ */
+struct sleepy_mode_stats {
+	/* Poll or CSL period of the mode in ms */
+	uint32_t period_ms;
+	/* Time spent in the mode in ms */
+	uint64_t time_ms;
+	/* Round trips of requests started in the mode */
+	uint32_t rtt_count;
+	uint32_t rtt_avg_ms;
+	uint32_t rtt_max_ms;
+	/* Estimated average current draw in the mode in uA */
+	uint32_t current_ua;
+};
+
+struct sleepy_stats {
+	enum sleepy_mode mode;
+	struct sleepy_mode_stats modes[SLEEPY_MODE_COUNT];
+};
+
+/**
+ * Function used to start in the slow mode
+ */
+int init_sleepy(void);
+
+/**
+ * Function used to note the start of an exchange
+ * The fast mode is kept until every exchange ended, returns the mode the
+ * exchange started in
+ */
+enum sleepy_mode sleepy_activity_begin(void);
+
+/**
+ * Function used to note the end of an exchange
+ * mode is the mode returned by sleepy_activity_begin(), rtt_ms the round
+ * trip time, negative if no response arrived
+ */
+void sleepy_activity_end(enum sleepy_mode mode, int32_t rtt_ms);
+
+/**
+ * Function used to keep the fast mode for a time, e.g. for an expected ACK
+ */
+void sleepy_expect(uint32_t ms);
+
+/**
+ * Function used to read the statistics of both modes
+ */
+void sleepy_get_stats(struct sleepy_stats *stats);
+
+/**
+ * Helper function to turn a mode into a string
+ */
+const char *sleepy_mode_str(enum sleepy_mode mode);
+
+#endif
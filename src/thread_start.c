@@ -0,0 +1,148 @@
+/*
+ * Thread start up
+ * OpenThread keeps the active operational dataset in settings. If one is
+ * stored the node enables Thread with it and attaches straight away, the
+ * stored network information lets it restore its previous role without the
+ * commissioner. Only a node without dataset runs the joiner, its start is
+ * jittered so a whole installation powering up at once does not hit the
+ * commissioner in the same moment.
+ *
+ * The time from boot to the attach and to the first completed request is
+ * logged once.
+ */
+
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(thread_start, LOG_LEVEL_DBG);
+
+#include <zephyr/kernel.h>
+#include <zephyr/random/random.h>
+#include <zephyr/net/openthread.h>
+#include <openthread/dataset.h>
+#include <openthread/ip6.h>
+#include <openthread/joiner.h>
+#include <openthread/thread.h>
+
+#include "events.h"
+#include "thread_start.h"
+
+#define JOINER_VENDOR_NAME "lwm2m-node"
+#define JOINER_VENDOR_MODEL "Nano 33 BLE"
+#define JOINER_VENDOR_SW_VERSION "1.0"
+
+/* Uptime of the attach, 0 until attached */
+static int64_t attached_ms;
+static atomic_t first_request_done;
+static bool dataset_restored;
+
+/* Delay before the next joiner attempt */
+static uint32_t joiner_backoff_sec = CONFIG_APP_THREAD_JOINER_RETRY_SEC;
+
+static void joiner_handler(struct k_work *work);
+static K_WORK_DELAYABLE_DEFINE(joiner_work, joiner_handler);
+
+/**
+ * Callback for the result of the joiner
+ * Runs in the OpenThread context
+ */
+static void joiner_cb(otError error, void *context)
+{
+	struct openthread_context *ot_context = context;
+
+	if (error != OT_ERROR_NONE) {
+		LOG_WRN("Joiner failed (%d), retrying in %u s", error, joiner_backoff_sec);
+		k_work_schedule(&joiner_work, K_SECONDS(joiner_backoff_sec));
+		joiner_backoff_sec = MIN(joiner_backoff_sec * 2,
+					 CONFIG_APP_THREAD_JOINER_RETRY_MAX_SEC);
+		return;
+	}
+
+	LOG_INF("Joined, attaching");
+	(void)otThreadSetEnabled(ot_context->instance, true);
+}
+
+/**
+ * Work handler starting the joiner
+ */
+static void joiner_handler(struct k_work *work)
+{
+	struct openthread_context *ot_context = openthread_get_default_context();
+	otError error;
+
+	openthread_api_mutex_lock(ot_context);
+	error = otJoinerStart(ot_context->instance, CONFIG_OPENTHREAD_JOINER_PSKD, NULL,
+			      JOINER_VENDOR_NAME, JOINER_VENDOR_MODEL, JOINER_VENDOR_SW_VERSION,
+			      NULL, joiner_cb, ot_context);
+	openthread_api_mutex_unlock(ot_context);
+
+	if (error != OT_ERROR_NONE) {
+		LOG_ERR("Cannot start the joiner (%d)", error);
+		k_work_schedule(&joiner_work, K_SECONDS(joiner_backoff_sec));
+	}
+}
+
+/**
+ * Listener used to measure the time to attach
+ */
+static void conn_event_handler(const struct zbus_channel *chan)
+{
+	const struct conn_event *event = zbus_chan_const_msg(chan);
+
+	if (event->state == CONN_STATE_ATTACHED && attached_ms == 0) {
+		attached_ms = k_uptime_get();
+		LOG_INF("Attached %lld ms after boot (%s)", attached_ms,
+			dataset_restored ? "stored dataset" : "joined");
+	}
+}
+
+ZBUS_LISTENER_DEFINE(thread_start_conn_listener, conn_event_handler);
+ZBUS_CHAN_ADD_OBS(conn_chan, thread_start_conn_listener, 4);
+
+/**
+ * Function used to bring up Thread
+ */
+int init_thread_start(void)
+{
+	struct openthread_context *ot_context = openthread_get_default_context();
+	otError error;
+
+	openthread_api_mutex_lock(ot_context);
+
+	error = otIp6SetEnabled(ot_context->instance, true);
+	if (error == OT_ERROR_NONE) {
+		dataset_restored = otDatasetIsCommissioned(ot_context->instance);
+		if (dataset_restored) {
+			error = otThreadSetEnabled(ot_context->instance, true);
+		}
+	}
+
+	openthread_api_mutex_unlock(ot_context);
+
+	if (error != OT_ERROR_NONE) {
+		LOG_ERR("Cannot enable Thread (%d)", error);
+		return -EIO;
+	}
+
+	if (dataset_restored) {
+		LOG_INF("Attaching with the stored dataset");
+		return 0;
+	}
+
+	LOG_INF("No dataset stored, starting the joiner");
+	k_work_schedule(&joiner_work,
+			K_MSEC(sys_rand32_get() % (CONFIG_APP_THREAD_JOINER_JITTER_MS + 1)));
+
+	return 0;
+}
+
+/**
+ * Function used to note a completed request to the bridge
+ */
+void thread_start_request_done(void)
+{
+	if (atomic_set(&first_request_done, 1)) {
+		return;
+	}
+
+	LOG_INF("First request completed %lld ms after boot, %lld ms after attach",
+		k_uptime_get(), attached_ms ? k_uptime_get() - attached_ms : -1LL);
+}
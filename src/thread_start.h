@@ -0,0 +1,17 @@
+#ifndef __THREAD_START_H__
+#define __THREAD_START_H__
+
+/**
+ * Function used to bring up Thread
+ * Attaches with the stored dataset right away, the joiner only runs if
+ * there is none
+ */
+int init_thread_start(void);
+
+/**
+ * Function used to note a completed request to the bridge
+ * The first one after boot ends the start up measurement
+ */
+void thread_start_request_done(void);
+
+#endif
@@ -0,0 +1,555 @@
+/*
+ * Tests of the CoAP server handlers
+ * Encoded requests are sent to the running CoAP service over the loopback
+ * interface and the responses are compared byte for byte with hand encoded
+ * messages. A group request is sent to the All-CoAP-Nodes group, which the
+ * node joins on the loopback interface. Afterwards the profile of every
+ * handler has to be free of heap allocations and, where the cycle counter
+ * runs with the CPU, within the budget. The request builder of the CoAP
+ * client is checked against the same hand encoded requests.
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/ztest.h>
+#include <errno.h>
+#include <string.h>
+#include <zephyr/net/socket.h>
+#include <zephyr/net/coap.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/iterable_sections.h>
+
+#include "coap_client.h"
+#include "coap_group.h"
+#include "coap_server.h"
+#include "handler_profile.h"
+#include "light.h"
+
+#define COAP_PORT 5683
+#define ALL_COAP_NODES_REALM_LOCAL "ff03::fd"
+#define RESPONSE_TIMEOUT_MS 1000
+#define MAX_MSG_LEN 64
+
+// Requests of the cost test per handler
+#define COST_ROUNDS 10
+
+#define PAYLOAD_MARKER 0xFF
+
+// Every request uses the same token and message ID, the responses echo them
+#define TKL 2
+#define TOKEN 0xA1, 0xB2
+#define MSG_ID 0x1234
+
+#define HEADER(_type, _code)								\
+	(0x40 | ((_type) << 4) | TKL), (_code), (MSG_ID >> 8), (MSG_ID & 0xFF), TOKEN
+
+// Uri-Path /42769/0/<_rid>, _prev is the number of the option before it
+#define URI_PATH(_prev, _rid)								\
+	((COAP_OPTION_URI_PATH - (_prev)) << 4) | 5, '4', '2', '7', '6', '9',		\
+	0x01, '0', 0x01, (_rid)
+
+static const uint8_t state_get[] = {
+	HEADER(COAP_TYPE_CON, COAP_METHOD_GET), URI_PATH(0, '1'),
+};
+
+static const uint8_t state_get_non[] = {
+	HEADER(COAP_TYPE_NON_CON, COAP_METHOD_GET), URI_PATH(0, '1'),
+};
+
+static const uint8_t state_put_on[] = {
+	HEADER(COAP_TYPE_CON, COAP_METHOD_PUT), URI_PATH(0, '1'), PAYLOAD_MARKER, '1',
+};
+
+static const uint8_t state_put_off[] = {
+	HEADER(COAP_TYPE_CON, COAP_METHOD_PUT), URI_PATH(0, '1'), PAYLOAD_MARKER, '0',
+};
+
+static const uint8_t state_put_invalid[] = {
+	HEADER(COAP_TYPE_CON, COAP_METHOD_PUT), URI_PATH(0, '1'), PAYLOAD_MARKER, 'x',
+};
+
+static const uint8_t state_put_empty[] = {
+	HEADER(COAP_TYPE_CON, COAP_METHOD_PUT), URI_PATH(0, '1'),
+};
+
+static const uint8_t state_observe[] = {
+	HEADER(COAP_TYPE_CON, COAP_METHOD_GET), (COAP_OPTION_OBSERVE << 4),
+	URI_PATH(COAP_OPTION_OBSERVE, '1'),
+};
+
+static const uint8_t state_observe_cancel[] = {
+	HEADER(COAP_TYPE_CON, COAP_METHOD_GET), (COAP_OPTION_OBSERVE << 4) | 1, 0x01,
+	URI_PATH(COAP_OPTION_OBSERVE, '1'),
+};
+
+static const uint8_t on_put[] = {
+	HEADER(COAP_TYPE_CON, COAP_METHOD_PUT), URI_PATH(0, '2'),
+};
+
+static const uint8_t off_put[] = {
+	HEADER(COAP_TYPE_CON, COAP_METHOD_PUT), URI_PATH(0, '3'),
+};
+
+static const uint8_t switch_put[] = {
+	HEADER(COAP_TYPE_CON, COAP_METHOD_PUT), URI_PATH(0, '4'),
+};
+
+static const uint8_t dimmer_get[] = {
+	HEADER(COAP_TYPE_CON, COAP_METHOD_GET), URI_PATH(0, '5'),
+};
+
+static const uint8_t dimmer_put_40[] = {
+	HEADER(COAP_TYPE_CON, COAP_METHOD_PUT), URI_PATH(0, '5'), PAYLOAD_MARKER, '4', '0',
+};
+
+static const uint8_t dimmer_put_60_tt[] = {
+	HEADER(COAP_TYPE_CON, COAP_METHOD_PUT), URI_PATH(0, '5'),
+	((COAP_OPTION_URI_QUERY - COAP_OPTION_URI_PATH) << 4) | 6, 't', 't', '=', '5', '0', '0',
+	PAYLOAD_MARKER, '6', '0',
+};
+
+static const uint8_t dimmer_put_over[] = {
+	HEADER(COAP_TYPE_CON, COAP_METHOD_PUT), URI_PATH(0, '5'), PAYLOAD_MARKER, '1', '0', '1',
+};
+
+static const uint8_t dimmer_put_invalid_tt[] = {
+	HEADER(COAP_TYPE_CON, COAP_METHOD_PUT), URI_PATH(0, '5'),
+	((COAP_OPTION_URI_QUERY - COAP_OPTION_URI_PATH) << 4) | 4, 't', 't', '=', 'x',
+	PAYLOAD_MARKER, '6', '0',
+};
+
+static const uint8_t switch_put_non[] = {
+	HEADER(COAP_TYPE_NON_CON, COAP_METHOD_PUT), URI_PATH(0, '4'),
+};
+
+static const uint8_t changed[] = { HEADER(COAP_TYPE_ACK, COAP_RESPONSE_CODE_CHANGED) };
+static const uint8_t bad_request[] = { HEADER(COAP_TYPE_ACK, COAP_RESPONSE_CODE_BAD_REQUEST) };
+
+// Handlers that have to be exercised, within the budget and without heap
+static const char * const profiled_handlers[] = {
+	"on_off_object_state_get",
+	"on_off_object_state_put",
+	"on_off_object_on_put",
+	"on_off_object_off_put",
+	"on_off_object_switch_put",
+	"on_off_object_dimmer_get",
+	"on_off_object_dimmer_put",
+	"state_notify",
+};
+
+HANDLER_PROFILE_DEFINE(test_alloc);
+
+static int sock = -1;
+
+/**
+ * Function used to receive the next message of the CoAP service
+ */
+static size_t receive(uint8_t *buf, size_t size)
+{
+	struct zsock_pollfd fds = {
+		.fd = sock,
+		.events = ZSOCK_POLLIN,
+	};
+	ssize_t len;
+
+	zassert_equal(zsock_poll(&fds, 1, RESPONSE_TIMEOUT_MS), 1, "No message received");
+
+	len = zsock_recv(sock, buf, size, 0);
+	zassert_true(len > 0, "Cannot receive (%d)", errno);
+
+	return len;
+}
+
+/**
+ * Function used to send a request and check the response byte for byte
+ */
+static void exchange(const uint8_t *request, size_t request_len, const uint8_t *expected,
+		     size_t expected_len)
+{
+	uint8_t response[MAX_MSG_LEN];
+	size_t len;
+
+	zassert_equal(zsock_send(sock, request, request_len, 0), request_len,
+		      "Cannot send the request (%d)", errno);
+
+	len = receive(response, sizeof(response));
+	zassert_equal(len, expected_len, "Response of %zu bytes, expected %zu", len,
+		      expected_len);
+	zassert_mem_equal(response, expected, expected_len, "Response differs");
+}
+
+#define EXCHANGE(_request, _expected)							\
+	exchange(_request, sizeof(_request), _expected, sizeof(_expected))
+
+/**
+ * Function used to encode the expected response of the state resource
+ * The ETag and Observe sequence come from the current light version
+ */
+static size_t state_response(uint8_t *buf, uint8_t type, uint8_t code, uint16_t id,
+			     bool observe)
+{
+	struct light_state state;
+	uint16_t prev = COAP_OPTION_ETAG;
+	size_t len = 0;
+
+	light_get_state(&state);
+
+	buf[len++] = 0x40 | (type << 4) | TKL;
+	buf[len++] = code;
+	sys_put_be16(id, &buf[len]);
+	len += sizeof(uint16_t);
+	buf[len++] = 0xA1;
+	buf[len++] = 0xB2;
+
+	buf[len++] = (COAP_OPTION_ETAG << 4) | sizeof(uint32_t);
+	sys_put_be32(state.version, &buf[len]);
+	len += sizeof(uint32_t);
+
+	if (observe) {
+		uint32_t seq = state.version & 0xFFFFFF;
+		uint8_t seq_len = seq > 0xFFFF ? 3 : seq > 0xFF ? 2 : seq > 0 ? 1 : 0;
+
+		buf[len++] = ((COAP_OPTION_OBSERVE - prev) << 4) | seq_len;
+		for (int i = seq_len - 1; i >= 0; i--) {
+			buf[len++] = seq >> (8 * i);
+		}
+		prev = COAP_OPTION_OBSERVE;
+	}
+
+	if (code == COAP_RESPONSE_CODE_VALID) {
+		return len;
+	}
+
+	// text/plain is content format 0, which is encoded without value
+	buf[len++] = (COAP_OPTION_CONTENT_FORMAT - prev) << 4;
+	buf[len++] = PAYLOAD_MARKER;
+	buf[len++] = state.on ? '1' : '0';
+
+	return len;
+}
+
+/**
+ * Function used to check the response of the state resource to a GET
+ */
+static void exchange_state_get(const uint8_t *request, size_t request_len, uint8_t type,
+			       uint8_t code, bool observe)
+{
+	uint8_t expected[MAX_MSG_LEN];
+	size_t len = state_response(expected, type, code, MSG_ID, observe);
+
+	exchange(request, request_len, expected, len);
+}
+
+/**
+ * Function used to encode the expected response of the dimmer resource
+ */
+static size_t dimmer_response(uint8_t *buf, uint8_t level)
+{
+	const uint8_t header[] = {
+		HEADER(COAP_TYPE_ACK, COAP_RESPONSE_CODE_CONTENT),
+		COAP_OPTION_CONTENT_FORMAT << 4, PAYLOAD_MARKER,
+	};
+
+	memcpy(buf, header, sizeof(header));
+
+	return sizeof(header) + snprintk((char *)&buf[sizeof(header)],
+					 MAX_MSG_LEN - sizeof(header), "%u", level);
+}
+
+/**
+ * Function used to check the response of the dimmer resource to a GET
+ */
+static void exchange_dimmer_get(uint8_t level)
+{
+	uint8_t expected[MAX_MSG_LEN];
+	size_t len = dimmer_response(expected, level);
+
+	exchange(dimmer_get, sizeof(dimmer_get), expected, len);
+}
+
+/**
+ * Function used to look up the profile of a handler
+ */
+static struct handler_profile *find_profile(const char *name)
+{
+	STRUCT_SECTION_FOREACH(handler_profile, profile) {
+		if (strcmp(profile->name, name) == 0) {
+			return profile;
+		}
+	}
+
+	return NULL;
+}
+
+static void *handlers_setup(void)
+{
+	struct sockaddr_in6 server = {
+		.sin6_family = AF_INET6,
+		.sin6_port = htons(COAP_PORT),
+		.sin6_addr = IN6ADDR_LOOPBACK_INIT,
+	};
+
+	zassert_ok(init_light(), "Cannot initialize the light");
+	zassert_ok(init_coap_server(), "Cannot start the CoAP server");
+	zassert_ok(coap_group_init(), "Cannot join the CoAP groups");
+
+	sock = zsock_socket(AF_INET6, SOCK_DGRAM, IPPROTO_UDP);
+	zassert_true(sock >= 0, "Cannot create the socket (%d)", errno);
+	zassert_ok(zsock_connect(sock, (struct sockaddr *)&server, sizeof(server)),
+		   "Cannot connect to the CoAP server (%d)", errno);
+
+	return NULL;
+}
+
+static void handlers_before(void *fixture)
+{
+	uint8_t buf[MAX_MSG_LEN];
+
+	ARG_UNUSED(fixture);
+
+	zassert_ok(light_set(false));
+	zassert_ok(light_set_dimmer(LIGHT_DIMMER_MAX));
+
+	// Drop anything a previous test left unread
+	while (zsock_recv(sock, buf, sizeof(buf), ZSOCK_MSG_DONTWAIT) > 0) {
+	}
+}
+
+ZTEST(handlers, test_state_get)
+{
+	exchange_state_get(state_get, sizeof(state_get), COAP_TYPE_ACK,
+			   COAP_RESPONSE_CODE_CONTENT, false);
+	exchange_state_get(state_get_non, sizeof(state_get_non), COAP_TYPE_NON_CON,
+			   COAP_RESPONSE_CODE_CONTENT, false);
+}
+
+ZTEST(handlers, test_state_get_etag)
+{
+	uint8_t request[] = {
+		HEADER(COAP_TYPE_CON, COAP_METHOD_GET),
+		(COAP_OPTION_ETAG << 4) | sizeof(uint32_t), 0, 0, 0, 0,
+		URI_PATH(COAP_OPTION_ETAG, '1'),
+	};
+
+	sys_put_be32(light_get_version(), &request[4 + TKL + 1]);
+	exchange_state_get(request, sizeof(request), COAP_TYPE_ACK, COAP_RESPONSE_CODE_VALID,
+			   false);
+
+	// A stale tag gets the full representation
+	zassert_ok(light_set(true));
+	exchange_state_get(request, sizeof(request), COAP_TYPE_ACK, COAP_RESPONSE_CODE_CONTENT,
+			   false);
+}
+
+ZTEST(handlers, test_state_put)
+{
+	EXCHANGE(state_put_on, changed);
+	zassert_true(light_get());
+
+	EXCHANGE(state_put_off, changed);
+	zassert_false(light_get());
+
+	EXCHANGE(state_put_invalid, bad_request);
+	EXCHANGE(state_put_empty, bad_request);
+	zassert_false(light_get());
+}
+
+ZTEST(handlers, test_state_observe)
+{
+	uint8_t notification[MAX_MSG_LEN];
+	uint8_t expected[MAX_MSG_LEN];
+	uint8_t ack[] = { 0x40 | (COAP_TYPE_ACK << 4), COAP_CODE_EMPTY, 0, 0 };
+	size_t expected_len;
+	size_t len;
+
+	exchange_state_get(state_observe, sizeof(state_observe), COAP_TYPE_ACK,
+			   COAP_RESPONSE_CODE_CONTENT, true);
+
+	// The notification carries a message ID of the server
+	zassert_ok(light_set(true));
+	len = receive(notification, sizeof(notification));
+	expected_len = state_response(expected, COAP_TYPE_CON, COAP_RESPONSE_CODE_CONTENT,
+				      sys_get_be16(&notification[2]), true);
+	zassert_equal(len, expected_len, "Notification of %zu bytes, expected %zu", len,
+		      expected_len);
+	zassert_mem_equal(notification, expected, expected_len, "Notification differs");
+
+	// Acknowledge it, so the server does not retransmit
+	memcpy(&ack[2], &notification[2], sizeof(uint16_t));
+	zassert_equal(zsock_send(sock, ack, sizeof(ack), 0), sizeof(ack));
+
+	exchange_state_get(state_observe_cancel, sizeof(state_observe_cancel), COAP_TYPE_ACK,
+			   COAP_RESPONSE_CODE_CONTENT, false);
+}
+
+ZTEST(handlers, test_on_off_switch)
+{
+	EXCHANGE(on_put, changed);
+	zassert_true(light_get());
+
+	EXCHANGE(off_put, changed);
+	zassert_false(light_get());
+
+	EXCHANGE(switch_put, changed);
+	zassert_true(light_get());
+}
+
+ZTEST(handlers, test_group_switch)
+{
+	struct sockaddr_in6 group = {
+		.sin6_family = AF_INET6,
+		.sin6_port = htons(COAP_PORT),
+	};
+	uint32_t version = light_get_version();
+	int fd;
+
+	zassert_ok(net_addr_pton(AF_INET6, ALL_COAP_NODES_REALM_LOCAL, &group.sin6_addr));
+
+	fd = zsock_socket(AF_INET6, SOCK_DGRAM, IPPROTO_UDP);
+	zassert_true(fd >= 0, "Cannot create the socket (%d)", errno);
+
+	zassert_equal(zsock_sendto(fd, switch_put_non, sizeof(switch_put_non), 0,
+				   (struct sockaddr *)&group, sizeof(group)),
+		      sizeof(switch_put_non), "Cannot send the group request (%d)", errno);
+
+	// A group request without response, give every receiver the time to handle it
+	k_msleep(100);
+	zsock_close(fd);
+
+	// Every copy of the datagram handled would toggle the light once more
+	zassert_true(light_get());
+	zassert_equal(light_get_version(), version + 1, "Group request handled %u times",
+		      light_get_version() - version);
+}
+
+ZTEST(handlers, test_dimmer)
+{
+	exchange_dimmer_get(LIGHT_DIMMER_MAX);
+
+	EXCHANGE(dimmer_put_40, changed);
+	exchange_dimmer_get(40);
+
+	EXCHANGE(dimmer_put_60_tt, changed);
+	exchange_dimmer_get(60);
+
+	EXCHANGE(dimmer_put_over, bad_request);
+	EXCHANGE(dimmer_put_invalid_tt, bad_request);
+	exchange_dimmer_get(60);
+}
+
+ZTEST(handlers, test_profile_heap)
+{
+	struct handler_probe probe;
+	void *mem;
+
+	test_alloc_profile = (struct handler_profile){ .name = "test_alloc" };
+
+	// The probe has to see an allocation of its own thread
+	HANDLER_PROFILE_BEGIN(&probe);
+	mem = k_malloc(16);
+	HANDLER_PROFILE_END(test_alloc, &probe);
+	k_free(mem);
+
+	zassert_not_null(mem);
+	zassert_equal(test_alloc_profile.heap_calls, 1);
+	zassert_true(test_alloc_profile.heap_max_bytes >= 16);
+}
+
+/**
+ * Function used to call every profiled handler COST_ROUNDS times on fresh
+ * statistics
+ */
+static void exercise_handlers(void)
+{
+	STRUCT_SECTION_FOREACH(handler_profile, profile) {
+		const char *name = profile->name;
+
+		*profile = (struct handler_profile){ .name = name };
+	}
+
+	for (int i = 0; i < COST_ROUNDS; i++) {
+		exchange_state_get(state_get, sizeof(state_get), COAP_TYPE_ACK,
+				   COAP_RESPONSE_CODE_CONTENT, false);
+		EXCHANGE(state_put_on, changed);
+		EXCHANGE(state_put_invalid, bad_request);
+		EXCHANGE(off_put, changed);
+		EXCHANGE(on_put, changed);
+		EXCHANGE(switch_put, changed);
+		exchange_dimmer_get(LIGHT_DIMMER_MAX);
+		EXCHANGE(dimmer_put_over, bad_request);
+		EXCHANGE(dimmer_put_40, changed);
+		zassert_ok(light_set_dimmer(LIGHT_DIMMER_MAX));
+	}
+
+	// Let the last notification work run
+	k_msleep(10);
+
+	ARRAY_FOR_EACH(profiled_handlers, i) {
+		const struct handler_profile *profile = find_profile(profiled_handlers[i]);
+
+		zassert_not_null(profile, "%s is not profiled", profiled_handlers[i]);
+		zassert_true(profile->count > 0, "%s was not called", profile->name);
+	}
+}
+
+ZTEST(handlers, test_cost_heap)
+{
+	exercise_handlers();
+
+	ARRAY_FOR_EACH(profiled_handlers, i) {
+		const struct handler_profile *profile = find_profile(profiled_handlers[i]);
+
+		zassert_equal(profile->heap_calls, 0, "%s allocated up to %zu bytes",
+			      profile->name, profile->heap_max_bytes);
+	}
+}
+
+ZTEST(handlers, test_cost_budget)
+{
+	// The cycle counter of native_sim is the simulated time, which does not
+	// advance while code runs, so every call would measure 0 us
+	Z_TEST_SKIP_IFDEF(CONFIG_ARCH_POSIX);
+
+	exercise_handlers();
+
+	ARRAY_FOR_EACH(profiled_handlers, i) {
+		const struct handler_profile *profile = find_profile(profiled_handlers[i]);
+		uint32_t max_us = k_cyc_to_us_ceil32(profile->max_cycles);
+
+		zassert_true(max_us <= CONFIG_APP_HANDLER_PROFILE_BUDGET_US,
+			     "%s took %u us, budget %u us", profile->name, max_us,
+			     CONFIG_APP_HANDLER_PROFILE_BUDGET_US);
+		zassert_equal(profile->overruns, 0, "%s overran its budget %u times",
+			      profile->name, profile->overruns);
+	}
+}
+
+ZTEST_SUITE(handlers, NULL, handlers_setup, handlers_before, NULL, NULL);
+
+ZTEST(client, test_request_build)
+{
+	static const char * const path[] = { "42769", "0", "1", NULL };
+	static const uint8_t token[] = { TOKEN };
+	static const uint8_t payload[] = { '1' };
+	struct coap_packet request;
+	uint8_t buf[MAX_MSG_LEN];
+
+	// Header, token and Uri-Path only
+	zassert_ok(coap_request_build(&request, buf, sizeof(buf), COAP_TYPE_CON,
+				      COAP_METHOD_GET, token, TKL, MSG_ID, path, NULL, 0));
+	zassert_equal(request.offset, sizeof(state_get));
+	zassert_mem_equal(buf, state_get, sizeof(state_get));
+
+	// Payload after the marker
+	zassert_ok(coap_request_build(&request, buf, sizeof(buf), COAP_TYPE_CON,
+				      COAP_METHOD_PUT, token, TKL, MSG_ID, path, payload,
+				      sizeof(payload)));
+	zassert_equal(request.offset, sizeof(state_put_on));
+	zassert_mem_equal(buf, state_put_on, sizeof(state_put_on));
+
+	// The payload does not fit behind the options
+	zassert_true(coap_request_build(&request, buf, sizeof(state_put_on) - 1, COAP_TYPE_CON,
+					COAP_METHOD_PUT, token, TKL, MSG_ID, path, payload,
+					sizeof(payload)) < 0);
+}
+
+ZTEST_SUITE(client, NULL, NULL, NULL, NULL, NULL);
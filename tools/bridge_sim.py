@@ -0,0 +1,175 @@
+#!/usr/bin/env python3
+"""
+Matter-LwM2M-Bridge stand-in for running the node on native_sim.
+
+Answers the resources of the Matter On/Off cluster object 42770 the node
+uses: OnTime (3), OnOff (5) and the Toggle command (8). Every request is
+logged, an optional delay and loss emulate a slow or lossy path through
+the border router.
+
+Loss is emulated below CoAP: the node talks to a UDP proxy that drops
+datagrams in both directions and forwards the rest to the CoAP server on
+the loopback interface, so the retransmissions of the node really run.
+
+Requires aiocoap: pip install aiocoap
+"""
+
+import argparse
+import asyncio
+import logging
+import random
+
+import aiocoap
+import aiocoap.resource as resource
+
+log = logging.getLogger("bridge-sim")
+
+
+class OnOffCluster:
+    def __init__(self):
+        self.on_off = False
+        self.on_time = 0
+
+
+class LossyProxy(asyncio.DatagramProtocol):
+    """Forwards the datagrams of the nodes to the server, dropping some"""
+
+    def __init__(self, server, loss):
+        self.server = server
+        self.loss = loss
+        self.transport = None
+        self.links = {}
+
+    def connection_made(self, transport):
+        self.transport = transport
+
+    def datagram_received(self, data, addr):
+        if self.lost("request", addr):
+            return
+
+        link = self.links.get(addr)
+        if link is None:
+            link = ProxyLink(self, addr)
+            self.links[addr] = link
+            asyncio.ensure_future(asyncio.get_running_loop().create_datagram_endpoint(
+                lambda: link, remote_addr=self.server))
+        link.send(data)
+
+    def reply(self, data, addr):
+        if self.lost("response", addr):
+            return
+        self.transport.sendto(data, addr)
+
+    def lost(self, what, addr):
+        if random.random() >= self.loss:
+            return False
+        log.info("Dropped %s of [%s]:%d", what, addr[0], addr[1])
+        return True
+
+
+class ProxyLink(asyncio.DatagramProtocol):
+    """Socket of a single node towards the server, carries its responses back"""
+
+    def __init__(self, proxy, addr):
+        self.proxy = proxy
+        self.addr = addr
+        self.transport = None
+        self.pending = []
+
+    def connection_made(self, transport):
+        self.transport = transport
+        for data in self.pending:
+            transport.sendto(data)
+        self.pending.clear()
+
+    def send(self, data):
+        if self.transport is None:
+            self.pending.append(data)
+        else:
+            self.transport.sendto(data)
+
+    def datagram_received(self, data, addr):
+        self.proxy.reply(data, self.addr)
+
+
+class DelayedResource(resource.Resource):
+    def __init__(self, cluster, delay):
+        super().__init__()
+        self.cluster = cluster
+        self.delay = delay
+
+    async def render(self, request):
+        if self.delay:
+            await asyncio.sleep(self.delay / 1000)
+
+        response = await super().render(request)
+        log.info("%s /%s -> %s", request.code, "/".join(request.opt.uri_path),
+                 response.code)
+        return response
+
+
+class OnTimeResource(DelayedResource):
+    async def render_get(self, request):
+        return aiocoap.Message(payload=str(self.cluster.on_time).encode())
+
+    async def render_put(self, request):
+        try:
+            self.cluster.on_time = int(request.payload.decode())
+        except ValueError:
+            return aiocoap.Message(code=aiocoap.BAD_REQUEST)
+        return aiocoap.Message(code=aiocoap.CHANGED)
+
+
+class OnOffResource(DelayedResource):
+    async def render_get(self, request):
+        return aiocoap.Message(payload=b"1" if self.cluster.on_off else b"0")
+
+    async def render_put(self, request):
+        if request.payload not in (b"0", b"1"):
+            return aiocoap.Message(code=aiocoap.BAD_REQUEST)
+        self.cluster.on_off = request.payload == b"1"
+        return aiocoap.Message(code=aiocoap.CHANGED)
+
+
+class ToggleResource(DelayedResource):
+    async def render_put(self, request):
+        self.cluster.on_off = not self.cluster.on_off
+        log.info("Light %s", "on" if self.cluster.on_off else "off")
+        return aiocoap.Message(code=aiocoap.CHANGED)
+
+
+async def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument("--bind", default="2001:db8::2",
+                        help="address of the zeth interface of the host")
+    parser.add_argument("--port", type=int, default=5683)
+    parser.add_argument("--delay", type=int, default=0,
+                        help="delay of every response in ms")
+    parser.add_argument("--loss", type=float, default=0.0,
+                        help="share of datagrams to drop in each direction, 0.0 to 1.0")
+    parser.add_argument("--server-port", type=int, default=5683,
+                        help="port of the CoAP server on ::1 behind the lossy proxy")
+    args = parser.parse_args()
+
+    logging.basicConfig(level=logging.INFO, format="%(asctime)s %(message)s")
+
+    cluster = OnOffCluster()
+    root = resource.Site()
+    root.add_resource(["42770", "0", "3"], OnTimeResource(cluster, args.delay))
+    root.add_resource(["42770", "0", "5"], OnOffResource(cluster, args.delay))
+    root.add_resource(["42770", "0", "8"], ToggleResource(cluster, args.delay))
+
+    if args.loss > 0:
+        server = ("::1", args.server_port)
+        await aiocoap.Context.create_server_context(root, bind=server)
+        await asyncio.get_running_loop().create_datagram_endpoint(
+            lambda: LossyProxy(server, args.loss), local_addr=(args.bind, args.port))
+    else:
+        await aiocoap.Context.create_server_context(root, bind=(args.bind, args.port))
+    log.info("Bridge listening on [%s]:%d", args.bind, args.port)
+
+    await asyncio.get_running_loop().create_future()
+
+
+if __name__ == "__main__":
+    asyncio.run(main())
@@ -0,0 +1,75 @@
+#!/usr/bin/env python3
+"""
+CoAP file server stand-in for testing the firmware download of the node.
+
+Serves the files of a directory with Block2 and an ETag per file, so
+resumed downloads can detect a changed image. Optionally drops a share of
+the requests to exercise the block size adaptation.
+
+Requires aiocoap: pip install aiocoap
+"""
+
+import argparse
+import asyncio
+import hashlib
+import logging
+import pathlib
+import random
+
+import aiocoap
+import aiocoap.resource as resource
+
+log = logging.getLogger("coap-file-server")
+
+
+class FileResource(resource.Resource, resource.PathCapable):
+    def __init__(self, root, loss):
+        super().__init__()
+        self.root = root
+        self.loss = loss
+
+    async def render(self, request):
+        if request.code != aiocoap.GET:
+            return aiocoap.Message(code=aiocoap.METHOD_NOT_ALLOWED)
+
+        path = (self.root / "/".join(request.opt.uri_path)).resolve()
+        if self.root not in path.parents or not path.is_file():
+            return aiocoap.Message(code=aiocoap.NOT_FOUND)
+
+        if random.random() < self.loss:
+            # Never answered, the client has to ask again
+            await asyncio.sleep(3600)
+
+        data = path.read_bytes()
+        block2 = request.opt.block2
+        if block2 is not None:
+            log.info("%s block %d of %d bytes", path.name,
+                     block2.block_number, block2.size)
+
+        response = aiocoap.Message(code=aiocoap.CONTENT, payload=data)
+        response.opt.etag = hashlib.sha256(data).digest()[:8]
+        return response
+
+
+async def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument("directory", type=pathlib.Path)
+    parser.add_argument("--bind", default="::")
+    parser.add_argument("--port", type=int, default=5683)
+    parser.add_argument("--loss", type=float, default=0.0,
+                        help="share of requests to drop, 0.0 to 1.0")
+    args = parser.parse_args()
+
+    logging.basicConfig(level=logging.INFO, format="%(asctime)s %(message)s")
+
+    root = resource.Site()
+    root.add_resource([], FileResource(args.directory.resolve(), args.loss))
+
+    await aiocoap.Context.create_server_context(root, bind=(args.bind, args.port))
+    log.info("Serving %s on [%s]:%d", args.directory, args.bind, args.port)
+
+    await asyncio.get_running_loop().create_future()
+
+
+if __name__ == "__main__":
+    asyncio.run(main())
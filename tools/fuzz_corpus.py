@@ -0,0 +1,96 @@
+#!/usr/bin/env python3
+"""
+Writes the seed corpus of the CoAP server fuzz harness.
+
+Every seed is a single CoAP datagram: valid requests for each 42769
+resource and the discovery resource, plus a few malformed messages that
+stop at different stages of the parser.
+"""
+
+import argparse
+import pathlib
+
+CON, NON = 0, 1
+GET, PUT = 1, 3
+
+OPT_ETAG = 4
+OPT_OBSERVE = 6
+OPT_URI_PATH = 11
+OPT_CONTENT_FORMAT = 12
+OPT_URI_QUERY = 15
+
+
+def option_nibble(value):
+    if value < 13:
+        return value, b""
+    if value < 269:
+        return 13, bytes([value - 13])
+    return 14, (value - 269).to_bytes(2, "big")
+
+
+def encode(code, path=(), options=(), payload=b"", msg_type=CON, token=b"\x01\x02",
+           msg_id=0x1234):
+    data = bytearray([0x40 | msg_type << 4 | len(token), code])
+    data += msg_id.to_bytes(2, "big") + token
+
+    opts = [(OPT_URI_PATH, p.encode()) for p in path] + list(options)
+    last = 0
+    for number, value in sorted(opts, key=lambda o: o[0]):
+        delta, delta_ext = option_nibble(number - last)
+        length, length_ext = option_nibble(len(value))
+        data += bytes([delta << 4 | length]) + delta_ext + length_ext + value
+        last = number
+
+    if payload:
+        data += b"\xff" + payload
+    return bytes(data)
+
+
+def seeds():
+    state = ("42769", "0", "1")
+    dimmer = ("42769", "0", "5")
+
+    yield "state_get", encode(GET, state)
+    yield "state_get_non", encode(GET, state, msg_type=NON)
+    yield "state_observe", encode(GET, state, [(OPT_OBSERVE, b"")])
+    yield "state_observe_cancel", encode(GET, state, [(OPT_OBSERVE, b"\x01")])
+    yield "state_get_etag", encode(GET, state, [(OPT_ETAG, b"\x00\x00\x00\x01")])
+    yield "state_put_on", encode(PUT, state, payload=b"1")
+    yield "state_put_off", encode(PUT, state, payload=b"0")
+    yield "state_put_empty", encode(PUT, state)
+    yield "state_put_invalid", encode(PUT, state, payload=b"on")
+    yield "state_put_long", encode(PUT, state, payload=b"1" * 200)
+    yield "on_put", encode(PUT, ("42769", "0", "2"))
+    yield "off_put", encode(PUT, ("42769", "0", "3"))
+    yield "switch_put", encode(PUT, ("42769", "0", "4"))
+    yield "dimmer_get", encode(GET, dimmer)
+    yield "dimmer_put", encode(PUT, dimmer, [(OPT_CONTENT_FORMAT, b"")], payload=b"50")
+    yield "dimmer_put_tt", encode(PUT, dimmer, [(OPT_URI_QUERY, b"tt=2000")], payload=b"75")
+    yield "dimmer_put_range", encode(PUT, dimmer, payload=b"99999999999")
+    yield "dimmer_put_queries", encode(PUT, dimmer,
+                                       [(OPT_URI_QUERY, b"tt=%d" % i) for i in range(6)],
+                                       payload=b"10")
+    yield "well_known_core", encode(GET, (".well-known", "core"))
+    yield "unknown_path", encode(GET, ("42769", "9", "9"))
+
+    # Malformed messages
+    yield "header_only", encode(GET, token=b"")[:4]
+    yield "truncated_token", bytes([0x48, GET, 0x12, 0x34, 1, 2])
+    yield "bad_version", bytes([0x80, GET, 0x12, 0x34])
+    yield "option_overflow", encode(GET, state)[:-1] + b"\xdd"
+    yield "payload_marker_only", encode(PUT, state) + b"\xff"
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument("directory", type=pathlib.Path, nargs="?",
+                        default=pathlib.Path(__file__).parent.parent / "fuzz" / "corpus")
+    args = parser.parse_args()
+
+    args.directory.mkdir(parents=True, exist_ok=True)
+    for name, data in seeds():
+        (args.directory / f"{name}.bin").write_bytes(data)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,23 @@
+#!/bin/sh
+# Builds the CoAP server fuzz harness, replays the seed corpus and fuzzes for
+# a limited time. Any crash, sanitizer report or stack overflow fails the job.
+#
+# Usage: tools/fuzz_regress.sh [seconds]
+
+set -e
+
+cd "$(dirname "$0")/.."
+
+SECONDS_TO_FUZZ=${1:-60}
+BUILD_DIR=build-fuzz
+
+ZEPHYR_TOOLCHAIN_VARIANT=llvm west build -b native_sim/native/64 -d "$BUILD_DIR" -- \
+	-DOVERLAY_CONFIG=overlay-fuzz.conf
+
+# Replay every seed once
+"$BUILD_DIR"/zephyr/zephyr.exe -runs=0 fuzz/corpus
+
+# New inputs go to a scratch corpus, interesting ones can be copied to fuzz/corpus
+mkdir -p "$BUILD_DIR"/corpus
+"$BUILD_DIR"/zephyr/zephyr.exe -max_total_time="$SECONDS_TO_FUZZ" \
+	-artifact_prefix="$BUILD_DIR"/ "$BUILD_DIR"/corpus fuzz/corpus
@@ -0,0 +1,195 @@
+#!/usr/bin/env python3
+"""
+Minimal LwM2M server stand-in for testing the LwM2M client mode of the node.
+
+Implements the registration interface like Leshan does (register, update,
+de-register), keeps track of the registration lifetimes and reads the
+state of the on/off object 42769 after every registration. With
+--firmware-uri it also writes the Package URI of the firmware update object
+and executes the update once the node reports the image as downloaded.
+
+Requires aiocoap: pip install aiocoap
+"""
+
+import argparse
+import asyncio
+import itertools
+import logging
+import time
+
+import aiocoap
+import aiocoap.resource as resource
+
+log = logging.getLogger("lwm2m-server")
+
+
+class Registration:
+    def __init__(self, endpoint, lifetime, remote, links):
+        self.endpoint = endpoint
+        self.lifetime = lifetime
+        self.remote = remote
+        self.links = links
+        self.updated = time.monotonic()
+        self.updates = 0
+
+    def expired(self):
+        return time.monotonic() - self.updated > self.lifetime
+
+
+class RegistrationDirectory(resource.Resource, resource.PathCapable):
+    """Handles POST /rd, POST /rd/<id> and DELETE /rd/<id>"""
+
+    def __init__(self, context_getter, firmware_uri=None):
+        super().__init__()
+        self.registrations = {}
+        self.ids = itertools.count(1)
+        self.context_getter = context_getter
+        self.firmware_uri = firmware_uri
+
+    @staticmethod
+    def parse_query(request):
+        query = {}
+        for item in request.opt.uri_query:
+            key, _, value = item.partition("=")
+            query[key] = value
+        return query
+
+    async def render(self, request):
+        path = request.opt.uri_path
+        if request.code == aiocoap.POST and not path:
+            return self.register(request)
+        if request.code == aiocoap.POST and len(path) == 1:
+            return self.update(request, path[0])
+        if request.code == aiocoap.DELETE and len(path) == 1:
+            return self.deregister(path[0])
+        return aiocoap.Message(code=aiocoap.METHOD_NOT_ALLOWED)
+
+    def register(self, request):
+        query = self.parse_query(request)
+        if "ep" not in query:
+            return aiocoap.Message(code=aiocoap.BAD_REQUEST)
+
+        reg_id = str(next(self.ids))
+        links = request.payload.decode(errors="replace")
+        self.registrations[reg_id] = Registration(
+            query["ep"], int(query.get("lt", 86400)), request.remote, links)
+        log.info("Registered %s as rd/%s (lifetime %ss, binding %s): %s",
+                 query["ep"], reg_id, query.get("lt", "86400"),
+                 query.get("b", "U"), links)
+
+        asyncio.get_event_loop().create_task(self.read_state(reg_id))
+        if self.firmware_uri and "</5/0>" in links:
+            asyncio.get_event_loop().create_task(self.update_firmware(reg_id))
+
+        response = aiocoap.Message(code=aiocoap.CREATED)
+        response.opt.location_path = ("rd", reg_id)
+        return response
+
+    def update(self, request, reg_id):
+        registration = self.registrations.get(reg_id)
+        if registration is None:
+            return aiocoap.Message(code=aiocoap.NOT_FOUND)
+
+        since = time.monotonic() - registration.updated
+        query = self.parse_query(request)
+        if "lt" in query:
+            registration.lifetime = int(query["lt"])
+        registration.updated = time.monotonic()
+        registration.remote = request.remote
+        registration.updates += 1
+        log.info("Update from %s after %.1fs (%d updates)",
+                 registration.endpoint, since, registration.updates)
+        return aiocoap.Message(code=aiocoap.CHANGED)
+
+    def deregister(self, reg_id):
+        registration = self.registrations.pop(reg_id, None)
+        if registration is None:
+            return aiocoap.Message(code=aiocoap.NOT_FOUND)
+
+        log.info("De-registered %s", registration.endpoint)
+        return aiocoap.Message(code=aiocoap.DELETED)
+
+    async def read_state(self, reg_id):
+        registration = self.registrations.get(reg_id)
+        if registration is None:
+            return
+
+        request = aiocoap.Message(
+            code=aiocoap.GET,
+            uri=f"coap://{registration.remote.hostinfo}/42769/0/1")
+        try:
+            response = await self.context_getter().request(request).response
+            log.info("%s 42769/0/1: %s %s", registration.endpoint,
+                     response.code, response.payload.hex())
+        except Exception as error:
+            log.warning("Reading 42769/0/1 from %s failed: %s",
+                        registration.endpoint, error)
+
+    async def update_firmware(self, reg_id):
+        registration = self.registrations.get(reg_id)
+        if registration is None:
+            return
+
+        context = self.context_getter()
+        base = f"coap://{registration.remote.hostinfo}/5/0"
+
+        write = aiocoap.Message(code=aiocoap.PUT, uri=f"{base}/1",
+                                payload=self.firmware_uri.encode())
+        write.opt.content_format = 0
+        response = await context.request(write).response
+        log.info("Package URI written: %s", response.code)
+        if not response.code.is_successful():
+            return
+
+        while reg_id in self.registrations:
+            await asyncio.sleep(5)
+            read = aiocoap.Message(code=aiocoap.GET, uri=f"{base}/3")
+            read.opt.accept = 0
+            try:
+                response = await context.request(read).response
+            except Exception as error:
+                log.warning("Reading the update state failed: %s", error)
+                continue
+
+            state = response.payload.decode(errors="replace")
+            log.info("Firmware update state: %s", state)
+            if state == "2":
+                execute = aiocoap.Message(code=aiocoap.POST, uri=f"{base}/2")
+                response = await context.request(execute).response
+                log.info("Update executed: %s", response.code)
+                return
+
+    async def expire(self):
+        while True:
+            await asyncio.sleep(1)
+            for reg_id, registration in list(self.registrations.items()):
+                if registration.expired():
+                    log.warning("Registration of %s expired",
+                                registration.endpoint)
+                    del self.registrations[reg_id]
+
+
+async def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument("--bind", default="::", help="address to listen on")
+    parser.add_argument("--port", type=int, default=5683)
+    parser.add_argument("--firmware-uri",
+                        help="coap:// URI of an image to push to every node")
+    args = parser.parse_args()
+
+    logging.basicConfig(level=logging.INFO, format="%(asctime)s %(message)s")
+
+    context = None
+    directory = RegistrationDirectory(lambda: context, args.firmware_uri)
+    root = resource.Site()
+    root.add_resource(["rd"], directory)
+
+    context = await aiocoap.Context.create_server_context(
+        root, bind=(args.bind, args.port))
+    log.info("LwM2M server stand-in listening on [%s]:%d", args.bind, args.port)
+
+    await directory.expire()
+
+
+if __name__ == "__main__":
+    asyncio.run(main())